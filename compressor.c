@@ -7,119 +7,298 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "utils/batch.h"
 #include "utils/bitmap.h"
 #include "utils/codec.h"
 #include "utils/huffman.h"
+#include "utils/parallel.h"
+#include "utils/pipeline.h"
 #include "utils/test.h"
 
-int main(int argc, char *argv[]) {
-    // Verifica se o número de argumentos está correto e exibe a mensagem de uso correto
-    if (argc < 3 || argc > 4) {
-        printf("Uso correto: ./compressor <original.bmp> <comprimido.bin> [qualidade]\n");
-        printf("    -> qualidade (opcional - default 50) varia entre 1 e 100.\n");
-        return 1;
-    }
+void print_usage() {
+    printf("Uso correto: ./compressor <original.bmp> <comprimido.bin> [qualidade] [-j threads] [--effort nivel] [--adaptive] [--matrices arquivo] [--cbp] [--index linhas] [--restart macroblocos] [--pipeline | --target-size bytes | --qualities q1,q2,...]\n");
+    printf("        ou: ./compressor --batch <manifesto|diretório> <diretório_saida> [qualidade] [-j threads] [--effort nivel] [--adaptive] [--matrices arquivo] [--cbp] [--index linhas] [--restart macroblocos]\n");
+    printf("    -> qualidade (opcional - default 50) varia entre 1 e 100.\n");
+    printf("    -> threads (opcional - default 1) número de threads usadas na compressão.\n");
+    printf("    -> nivel (opcional - default 0) 1 escolhe cada coeficiente pela relação entre bits e distorção\n");
+    printf("       (quantização taxa-distorção): arquivos menores para a mesma qualidade visual, compressão mais lenta.\n");
+    printf("    -> --adaptive ajusta a quantização de cada macrobloco pela sua textura: passos menores em áreas lisas,\n");
+    printf("       onde os blocos aparecem, e maiores em texturas, que escondem o erro (o nível vai no arquivo).\n");
+    printf("    -> arquivo (opcional) matrizes base de quantização no lugar das do padrão JPEG: 64 valores de luminância\n");
+    printf("       e 64 de crominância (1 a 255, linha por linha), escalados pela qualidade (usados sem escala na 50).\n");
+    printf("       As matrizes efetivas vão no header do arquivo comprimido.\n");
+    printf("    -> --cbp grava em cada macrobloco quais dos seus 6 blocos têm coeficientes e omite os vazios\n");
+    printf("       (arquivos menores, principalmente em qualidades baixas e em imagens com áreas lisas).\n");
+    printf("    -> linhas (opcional) grava um índice com uma entrada a cada 'linhas' linhas de macroblocos,\n");
+    printf("       permitindo que o descompressor decodifique trechos em paralelo.\n");
+    printf("    -> macroblocos (opcional) reinicia a predição DC a cada 'macroblocos' macroblocos,\n");
+    printf("       tornando cada intervalo decodificável de forma independente.\n");
+    printf("    -> --batch comprime todos os .bmp do diretório (ou os caminhos do manifesto, um por linha)\n");
+    printf("       para <diretório_saida>, dividindo os arquivos entre as threads.\n");
+    printf("    -> --pipeline sobrepõe leitura, DCT (com 'threads' threads) e Huffman em estágios ligados por filas\n");
+    printf("       e mostra quanto cada estágio esperou pelos outros.\n");
+    printf("    -> --target-size escolhe a maior qualidade cujo arquivo cabe em 'bytes' bytes (aceita os sufixos K e M),\n");
+    printf("       fazendo a conversão de cores e a DCT uma única vez; a qualidade informada é ignorada.\n");
+    printf("    -> --qualities grava uma versão por qualidade da lista (<comprimido>_q<qualidade>.bin), compartilhando\n");
+    printf("       a conversão de cores e a DCT e comprimindo as versões em paralelo.\n");
+}
 
-    const char *input_filename = argv[1];
-    const char *output_filename = argv[2];
-    int quality = 50; // Qualidade padrão
+#define MAX_RENDITIONS 100
 
-    if (argc == 4) {
-        quality = atof(argv[3]);
-        if (quality < 1 || quality > 100) {
-            printf("Erro: Qualidade deve ser um valor entre 1 e 100.\n");
-            return 1;
-        }
+static int parse_qualities(const char *list, int *qualities) {
+    /*
+     * Lê uma lista de qualidades separadas por vírgula (ex.: "30,50,75,90").
+     * Retorna quantas foram lidas, ou 0 se a lista for inválida.
+     */
+    int count = 0;
+    const char *position = list;
+    while (*position) {
+        char *end;
+        long quality = strtol(position, &end, 10);
+        if (end == position || quality < 1 || quality > 100 || count == MAX_RENDITIONS || (*end != ',' && *end != '\0')) return 0;
+        qualities[count++] = (int)quality;
+        position = *end == ',' ? end + 1 : end;
     }
+    return count;
+}
 
-    /* --- PIPELINE DE COMPRESSÃO --- */
+static char* rendition_filename(const char *output_filename, int quality) {
+    /*
+     * Nome do arquivo de uma versão: "_q<qualidade>" inserido antes da extensão
+     * (saida.bin -> saida_q75.bin). Retorna NULL se faltar memória.
+     */
+    const char *slash = strrchr(output_filename, '/');
+    const char *backslash = strrchr(output_filename, '\\');
+    if (backslash && (!slash || backslash > slash)) slash = backslash;
+    const char *dot = strrchr(output_filename, '.');
+    size_t stem = (dot && (!slash || dot > slash)) ? (size_t)(dot - output_filename) : strlen(output_filename);
 
-    // 1. Abre o arquivo BMP de entrada e lê os cabeçalhos
-    FILE *input_file = fopen(input_filename, "rb");
-    if (!input_file) {
-        printf("Erro ao abrir o arquivo BMP\n");
-        return 1;
-    }
+    size_t size = strlen(output_filename) + 16;
+    char *name = (char *)malloc(size);
+    if (name) snprintf(name, size, "%.*s_q%d%s", (int)stem, output_filename, quality, output_filename + stem);
+    return name;
+}
 
-    BITMAPFILEHEADER file_header;
-    BITMAPINFOHEADER info_header;
-    loadBMPHeaders(input_file, &file_header, &info_header);
+static void print_compression_ratio(const char *input_filename, const char *output_filename) {
+    // Pega o tamanho do arquivo original e comprimido usando a função fsize()
+    long original_size = fsize(input_filename);
+    long compressed_size = fsize(output_filename);
 
-    // 2. Lê os pixels RGB do arquivo BMP
-    int width = info_header.Width;
-    int height = info_header.Height;
-    if (width % 8 != 0 || height % 8 != 0) {
-        printf("Erro: Dimensões da imagem devem ser múltiplas de 8.\n");
-        fclose(input_file);
-        return 1;
+    // Calcula e imprime a taxa de compressão
+    if (compressed_size > 0 && original_size > 0) {
+        float ratio = (float)original_size / compressed_size;
+        float reduction_percentage = (1.0f - (float)compressed_size / original_size) * 100.0f;
+        printf("Taxa de compressao aproximada: 1:%.2f (%.2f%% menor)\n", ratio, reduction_percentage);
     }
-    int tam = width * height;
-    PIXELRGB *pixels_rgb = (PIXELRGB *)calloc(tam, sizeof(PIXELRGB));
-    if (!pixels_rgb) {
-        printf("Erro ao alocar memória para os pixels RGB.\n");
-        fclose(input_file);
-        return 1;
+}
+
+static int compress_renditions(const char *input_filename, const char *output_filename, const int *qualities, int count, const CODEC_OPTIONS *options) {
+    /*
+     * Grava uma versão comprimida por qualidade com compress_file_qualities e imprime a taxa de cada uma.
+     * Retorna 1 em caso de sucesso, 0 em caso de erro.
+     */
+    char *names[MAX_RENDITIONS];
+    int named = 0;
+    for (; named < count; named++) {
+        names[named] = rendition_filename(output_filename, qualities[named]);
+        if (!names[named]) break;
     }
-    readPixels(input_file, info_header, file_header, pixels_rgb);
-    fclose(input_file); // Fecha o arquivo BMP após leituras finalizadas
-
-    // 3. Converte os pixels RGB para YCbCr
-    PIXELYCBCR *pixels_ycbcr = (PIXELYCBCR *)calloc(tam, sizeof(PIXELYCBCR));
-    if (!pixels_ycbcr) {
-        printf("Erro ao alocar memória para os pixels YCbCr.\n");
-        free(pixels_rgb);
-        return 1;
+
+    int ok = named == count && compress_file_qualities(input_filename, (const char *const *)names, qualities, count, options, NULL);
+    for (int i = 0; ok && i < count; i++) {
+        printf("Qualidade %d comprimida com sucesso para %s\n", qualities[i], names[i]);
+        print_compression_ratio(input_filename, names[i]);
     }
-    convertToYCBCR(pixels_rgb, pixels_ycbcr, tam);
-    
-    // 4. Aplica a DCT e o subsampling 4:2:0
-    int macroblock_count = 0;
-    MACROBLOCO *macroblocks = encodeImageYCbCr(pixels_ycbcr, width, height, &macroblock_count);
-
-    // 5. Aplica a quantização
-    quantizeMacroblocks(macroblocks, macroblock_count, quality);
-
-    // 6. Faz a vetorização zig-zag dos macroblocos
-    MACROBLOCO_VETORIZADO *vectorized_macroblocks = (MACROBLOCO_VETORIZADO *)calloc(macroblock_count, sizeof(MACROBLOCO_VETORIZADO));
-    if (!vectorized_macroblocks) { 
-        printf("Erro ao alocar memória para os macroblocos vetorizados.\n");
-        free(pixels_rgb); free(pixels_ycbcr); free(macroblocks);
-        return 1;
+    for (int i = 0; i < named; i++) {
+        free(names[i]);
+    }
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    const char *input_filename = NULL;
+    const char *output_filename = NULL;
+    int quality = 50; // Qualidade padrão
+    int num_threads = 1;
+    int effort = 0; // 0 = quantização por arredondamento
+    int adaptive = 0; // 0 = mesma quantização em todos os macroblocos
+    QUANT_MATRICES custom_matrices;
+    const QUANT_MATRICES *matrices = NULL; // NULL = matrizes do padrão JPEG
+    int cbp = 0; // 0 = todos os blocos gravados
+    int index_interval = 0; // 0 = sem índice
+    int restart_interval = 0; // 0 = sem reinícios
+    int batch = 0;
+    int pipeline = 0;
+    size_t target_size = 0; // 0 = qualidade fixa
+    int qualities[MAX_RENDITIONS];
+    int rendition_count = 0; // 0 = uma única qualidade
+    int positional = 0;
+
+    // Lê os argumentos posicionais (entrada, saída e qualidade) e as opções
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipeline = 1;
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            adaptive = 1;
+        } else if (strcmp(argv[i], "--cbp") == 0) {
+            cbp = 1;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            num_threads = atoi(argv[++i]);
+            if (num_threads < 1) {
+                printf("Erro: Número de threads deve ser maior que 0.\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--effort") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            effort = atoi(argv[++i]);
+            if (effort < 0 || effort > 1) {
+                printf("Erro: Nível de esforço deve ser 0 ou 1.\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--matrices") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            if (!load_quant_matrices(argv[++i], &custom_matrices)) return 1;
+            matrices = &custom_matrices;
+        } else if (strcmp(argv[i], "--index") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            index_interval = atoi(argv[++i]);
+            if (index_interval < 1) {
+                printf("Erro: Intervalo do índice deve ser maior que 0.\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--target-size") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            // Aceita K e M como múltiplos de 1024 bytes
+            char *suffix;
+            double value = strtod(argv[++i], &suffix);
+            if (*suffix == 'K' || *suffix == 'k') value *= 1024.0;
+            else if (*suffix == 'M' || *suffix == 'm') value *= 1024.0 * 1024.0;
+            else if (*suffix != '\0') value = 0;
+            if (value < 1) {
+                printf("Erro: Tamanho alvo deve ser maior que 0.\n");
+                return 1;
+            }
+            target_size = (size_t)value;
+        } else if (strcmp(argv[i], "--qualities") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            rendition_count = parse_qualities(argv[++i], qualities);
+            if (rendition_count == 0) {
+                printf("Erro: Lista de qualidades inválida (use valores de 1 a 100 separados por vírgula).\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--restart") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            restart_interval = atoi(argv[++i]);
+            if (restart_interval < 1) {
+                printf("Erro: Intervalo de reinício deve ser maior que 0.\n");
+                return 1;
+            }
+        } else if (positional == 0) {
+            input_filename = argv[i];
+            positional++;
+        } else if (positional == 1) {
+            output_filename = argv[i];
+            positional++;
+        } else if (positional == 2) {
+            quality = atof(argv[i]);
+            if (quality < 1 || quality > 100) {
+                printf("Erro: Qualidade deve ser um valor entre 1 e 100.\n");
+                return 1;
+            }
+            positional++;
+        } else {
+            print_usage();
+            return 1;
+        }
     }
-    vectorize_macroblocks(macroblocks, vectorized_macroblocks, macroblock_count);
 
-    // 7. Faz a codificação RLE e diferencial dos macroblocos vetorizados
-    MACROBLOCO_RLE_DIFERENCIAL *rle_diff_macroblocks = (MACROBLOCO_RLE_DIFERENCIAL *)calloc(macroblock_count, sizeof(MACROBLOCO_RLE_DIFERENCIAL));
-    if (!rle_diff_macroblocks) { 
-        printf("Erro ao alocar memória para os macroblocos com RLE e diferencial.\n");
-        free(pixels_rgb); free(pixels_ycbcr); free(macroblocks); free(vectorized_macroblocks);
+    // Verifica se o número de argumentos está correto e exibe a mensagem de uso correto
+    if (positional < 2 || (batch && pipeline) || (target_size > 0 && (batch || pipeline)) ||
+        (rendition_count > 0 && (batch || pipeline || target_size > 0))) {
+        print_usage();
         return 1;
     }
-    rle_encode_macroblocks(rle_diff_macroblocks, vectorized_macroblocks, macroblock_count);
-    differential_encode_dc(rle_diff_macroblocks, macroblock_count);
 
-    // 8. Aplica a codificação Huffman e escreve os macroblocos comprimidos em um arquivo binário
-    write_macroblocks_huffman(output_filename, rle_diff_macroblocks, macroblock_count, file_header, info_header, quality);
+    /* --- PIPELINE DE COMPRESSÃO --- */
 
-    printf("Imagem comprimida com sucesso para %s\n", output_filename);
+    CODEC_OPTIONS options = {
+        .quality = quality,
+        .restart_interval = restart_interval,
+        .index_interval = index_interval,
+        .num_threads = num_threads,
+        .effort = effort,
+        .adaptive = adaptive,
+        .matrices = matrices,
+        .cbp = cbp
+    };
 
-    // Pega o tamanho do arquivo original e comprimido usando a função fsize()
-    long original_size = fsize(input_filename);
-    long compressed_size = fsize(output_filename);
+    // No modo em lote, os arquivos são distribuídos entre as threads
+    if (batch) {
+        BATCH_OPTIONS batch_options = {.mode = BATCH_COMPRESS, .encode = options};
+        return run_batch(input_filename, output_filename, &batch_options, num_threads) ? 0 : 1;
+    }
 
-    // Calcula e imprime a taxa de compressão
-    if (compressed_size > 0 && original_size > 0) {
-        float ratio = (float)original_size / compressed_size;
-        float reduction_percentage = (1.0f - (float)compressed_size / original_size) * 100.0f;
-        printf("Taxa de compressao aproximada: 1:%.2f (%.2f%% menor)\n", ratio, reduction_percentage);
+    // Lê o BMP, converte para YCbCr, aplica a DCT com subsampling 4:2:0, quantiza, vetoriza em zig-zag,
+    // codifica com RLE e diferencial e aplica Huffman, dividindo as linhas de macroblocos entre as threads,
+    // e escreve os macroblocos comprimidos (e o índice, se pedido) em um arquivo binário.
+    // Com --pipeline, as etapas rodam ao mesmo tempo em estágios, cada linha de macroblocos passando de um para o outro
+    // Com --qualities, a DCT é compartilhada e só a quantização em diante é feita para cada versão
+    if (rendition_count > 0) {
+        if (!compress_renditions(input_filename, output_filename, qualities, rendition_count, &options)) {
+            printf("Erro ao comprimir a imagem.\n");
+            return 1;
+        }
+        return 0;
     }
 
-    // 9. Limpa a memória alocada
-    free(pixels_rgb);
-    free(pixels_ycbcr);
-    free(macroblocks);
-    free(vectorized_macroblocks);
-    free(rle_diff_macroblocks);
+    // Com --target-size, a DCT é feita uma vez e a qualidade é buscada refazendo só a quantização e o Huffman
+    PIPELINE_STATS stats;
+    int compressed;
+    int fits = 1;
+    if (target_size > 0) {
+        compressed = compress_file_target_size(input_filename, output_filename, target_size, &options, &quality, &fits, NULL);
+    } else if (pipeline) {
+        compressed = compress_file_pipelined(input_filename, output_filename, &options, &stats);
+    } else {
+        compressed = compress_file(input_filename, output_filename, &options, NULL);
+    }
+    if (!compressed) {
+        printf("Erro ao comprimir a imagem.\n");
+        return 1;
+    }
+    if (pipeline) print_pipeline_stats(&stats);
+    if (target_size > 0 && !fits) {
+        printf("AVISO: Nem a qualidade 1 cabe em %zu bytes; a imagem foi comprimida com qualidade 1.\n", target_size);
+    } else if (target_size > 0) {
+        printf("Qualidade escolhida para caber em %zu bytes: %d\n", target_size, quality);
+    }
 
+    printf("Imagem comprimida com sucesso para %s\n", output_filename);
+    print_compression_ratio(input_filename, output_filename);
     return 0;
 }
\ No newline at end of file
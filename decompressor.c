@@ -8,81 +8,91 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "utils/batch.h"
 #include "utils/bitmap.h"
 #include "utils/codec.h"
 #include "utils/huffman.h"
+#include "utils/parallel.h"
+
+void print_usage() {
+    printf("Uso correto: ./decompressor <comprimido.bin> <reconstruido.bmp> [-j threads] [--scale escala]\n");
+    printf("        ou: ./decompressor --batch <manifesto|diretório> <diretório_saida> [-j threads] [--scale escala]\n");
+    printf("    -> threads (opcional - default 1) número de threads usadas na descompressão.\n");
+    printf("    -> escala (opcional - default 1) 1/2, 1/4 ou 1/8 gera a imagem reduzida nessa proporção na largura\n");
+    printf("       e na altura: cada bloco 8x8 vira 4x4 ou 2x2 pixels por uma IDCT reduzida, ou um pixel calculado só\n");
+    printf("       do seu DC, bem mais rápido que descomprimir e reduzir.\n");
+    printf("    -> --batch descomprime todos os .bin do diretório (ou os caminhos do manifesto, um por linha)\n");
+    printf("       para <diretório_saida>, dividindo os arquivos entre as threads.\n");
+}
 
 int main(int argc, char *argv[]) {
+    const char *input_filename = NULL;
+    const char *output_filename = NULL;
+    int num_threads = 1;
+    int scale = 1;
+    int batch = 0;
+    int positional = 0;
+
+    // Lê os argumentos posicionais (entrada e saída) e as opções
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            num_threads = atoi(argv[++i]);
+            if (num_threads < 1) {
+                printf("Erro: Número de threads deve ser maior que 0.\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--scale") == 0) {
+            if (i + 1 >= argc) {
+                print_usage();
+                return 1;
+            }
+            // Aceita 1/n ou só n (1 = tamanho original)
+            const char *value = argv[++i];
+            if (strncmp(value, "1/", 2) == 0) value += 2;
+            scale = atoi(value);
+            if (!valid_decode_scale(scale)) {
+                printf("Erro: Escala deve ser 1, 1/2, 1/4 ou 1/8.\n");
+                return 1;
+            }
+        } else if (positional == 0) {
+            input_filename = argv[i];
+            positional++;
+        } else if (positional == 1) {
+            output_filename = argv[i];
+            positional++;
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
     // Verifica se o número de argumentos está correto e exibe a mensagem de uso correto
-    if (argc != 3) {
-        printf("Uso correto: ./decompressor <comprimido.bin> <reconstruido.bmp>\n");
+    if (positional != 2) {
+        print_usage();
         return 1;
     }
 
-    const char *input_filename = argv[1];
-    const char *output_filename = argv[2];
-
     /* --- PIPELINE DE DESCOMPRESSÃO --- */
-    
-    BITMAPFILEHEADER fhead;
-    BITMAPINFOHEADER ihead;
-    int quality_read;
-    int count_read;
-    MACROBLOCO_RLE_DIFERENCIAL *read_blocks = NULL;
 
-    // 1. Lê o arquivo comprimido e aplica decodificação huffman nos blocos de macroblocos 
-    if (!read_macroblocks_huffman(input_filename, &read_blocks, &count_read, &fhead, &ihead, &quality_read)) {
-        printf("Falha ao ler ou decodificar o arquivo comprimido.\n");
-        if (read_blocks) free(read_blocks);
-        return 1;
+    // No modo em lote, os arquivos são distribuídos entre as threads
+    if (batch) {
+        BATCH_OPTIONS options = {.mode = BATCH_DECOMPRESS, .scale = scale};
+        return run_batch(input_filename, output_filename, &options, num_threads) ? 0 : 1;
     }
 
-    // Aloca memória para as estruturas intermediárias e inicializa variáveis
-    MACROBLOCO_VETORIZADO *vectorized_macroblocks = (MACROBLOCO_VETORIZADO *)calloc(count_read, sizeof(MACROBLOCO_VETORIZADO));
-    MACROBLOCO *macroblocks = (MACROBLOCO *)calloc(count_read, sizeof(MACROBLOCO));
-    int width = ihead.Width;
-    int height = ihead.Height;
-    int tam = width * height;
-    PIXELYCBCR *pixels_ycbcr = (PIXELYCBCR *)calloc(tam, sizeof(PIXELYCBCR));
-    PIXELRGB *pixels_rgb = (PIXELRGB *)calloc(tam, sizeof(PIXELRGB));
-
-    if (!vectorized_macroblocks || !macroblocks || !pixels_ycbcr || !pixels_rgb) {
-        printf("Erro ao alocar memória para estruturas auxiliares.\n");
+    // Lê o arquivo comprimido e, para cada trecho do índice (ou o arquivo todo, se não houver índice),
+    // aplica decodificação huffman, diferencial dos DC, RLE, desvetorização zig-zag, dequantização,
+    // inversa da DCT com reconstrução da imagem YCbCr e conversão para RGB, e escreve o BMP de saída
+    if (!decompress_file(input_filename, output_filename, num_threads, scale, NULL)) {
         return 1;
     }
+    printf("Arquivo descomprimido com sucesso para %s\n", output_filename);
 
-    // 2. Codificação diferencial dos valores DC e RLE nos AC dos macroblocos
-    differential_decode_dc(read_blocks, count_read);
-    rle_decode_macroblocks(vectorized_macroblocks, read_blocks, count_read);
-    
-    // 3. Desvetorização zig-zag dos macroblocos
-    devectorize_macroblocks(vectorized_macroblocks, macroblocks, count_read);
-
-    // 4. Dequantização dos macroblocos
-    dequantizeMacroblocks(macroblocks, count_read, quality_read);
-
-    // 5. Inversa da DCT e reconstrução da imagem YCbCr
-    decodeImageYCbCr(macroblocks, pixels_ycbcr, width, height);
-
-    // 6. Conversão YCbCr para RGB
-    convertToRGB(pixels_ycbcr, pixels_rgb, tam);
-    
-    // 7. Escrita do arquivo BMP de saída
-    FILE *output_file = fopen(output_filename, "wb");
-    if (!output_file) {
-        printf("Erro ao abrir o arquivo de saída\n");
-    } else {
-        writeBMP(output_file, fhead, ihead, pixels_rgb);
-        fclose(output_file);
-        printf("Arquivo descomprimido com sucesso para %s\n", output_filename);
-    }
-    
-    // 8. Limpeza de memória
-    free(read_blocks);
-    free(vectorized_macroblocks);
-    free(macroblocks);
-    free(pixels_ycbcr);
-    free(pixels_rgb);
-    
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,607 @@
+/*
+ * Otimizador offline das matrizes de quantização.
+ * Lê todos os .bmp de um diretório, faz a conversão de cores e a DCT de cada imagem uma única vez
+ * e procura as matrizes de luminância e crominância que deixam o corpus inteiro menor para um
+ * PSNR alvo. O resultado é um arquivo de matrizes para o compressor (--matrices, na qualidade 50).
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <dirent.h>
+#include "utils/bitmap.h"
+#include "utils/codec.h"
+#include "utils/huffman.h"
+#include "utils/parallel.h"
+
+#define MATRIX_ENTRIES 128          // 64 valores de luminância seguidos de 64 de crominância
+#define SCALE_SEARCH_STEPS 16       // Passos da busca binária pela escala que atinge o PSNR alvo
+#define INITIAL_STEP_FACTOR 1.3     // Fator inicial aplicado a cada valor das matrizes na busca
+#define MIN_STEP_FACTOR 1.02        // Abaixo desse fator a busca para
+#define LUMA_WEIGHT 6.0             // Peso de Y no PSNR ponderado (6:1:1, como nos testes de codecs de vídeo)
+
+void print_usage() {
+    printf("Uso correto: ./optimizer <diretório> <matrizes.txt> [--psnr alvo] [--passes n] [-j threads]\n");
+    printf("    -> diretório: imagens .bmp usadas para ajustar as matrizes.\n");
+    printf("    -> matrizes.txt: arquivo gerado, usado com ./compressor <original.bmp> <comprimido.bin> 50 --matrices matrizes.txt\n");
+    printf("    -> alvo (opcional - default: o PSNR das matrizes do padrão JPEG na qualidade 50) PSNR de Y, Cb e Cr\n");
+    printf("       ponderado 6:1:1, em dB, medido sobre todos os pixels do corpus.\n");
+    printf("    -> n (opcional - default 6) número de passadas pelos 128 valores das matrizes.\n");
+    printf("    -> threads (opcional - default 1) número de threads usadas na avaliação das matrizes candidatas.\n");
+}
+
+// Coeficientes da DCT de uma imagem do corpus, calculados uma única vez
+typedef struct {
+    MACROBLOCO *coefficients;
+    int macroblock_count;
+} CORPUS_IMAGE;
+
+// Tamanho e erro de um conjunto de matrizes sobre uma imagem ou sobre o corpus inteiro
+typedef struct {
+    size_t bytes;               // Bytes dos macroblocos (comprimento + código de Huffman)
+    double squared_error;       // Erro quadrático ponderado (Y com LUMA_WEIGHT, crominância pelos 4 pixels de cada amostra)
+} MATRIX_COST;
+
+// Vetores de trabalho de uma thread
+typedef struct {
+    CODEC_TABLES tables;
+    MACROBLOCO macroblock;
+    MACROBLOCO_VETORIZADO vectorized;
+    MACROBLOCO_RLE_DIFERENCIAL rle;
+} OPTIMIZER_SCRATCH;
+
+// Estado compartilhado pelas tarefas de avaliação
+typedef struct {
+    CORPUS_IMAGE *images;
+    int image_count;
+    OPTIMIZER_SCRATCH *scratch;         // Um por thread
+    const char *const *filenames;       // Arquivos do corpus, lidos por load_image_task
+    const QUANT_MATRICES *matrices;     // Matrizes avaliadas (uma por candidata, ou uma só por imagem)
+    MATRIX_COST *costs;
+} EVALUATION_JOB;
+
+static int has_bmp_extension(const char *filename) {
+    // Verifica, sem diferenciar maiúsculas, se o nome termina com .bmp
+    size_t length = strlen(filename);
+    if (length <= 4) return 0;
+    const char *extension = filename + length - 4;
+    return extension[0] == '.' && tolower((unsigned char)extension[1]) == 'b' &&
+           tolower((unsigned char)extension[2]) == 'm' && tolower((unsigned char)extension[3]) == 'p';
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static char **list_bmp_files(const char *directory, int *count) {
+    /*
+     * Lista os caminhos dos arquivos .bmp do diretório, em ordem alfabética.
+     * Retorna NULL em caso de erro.
+     */
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        printf("Erro ao abrir o diretório %s.\n", directory);
+        return NULL;
+    }
+
+    int capacity = 16;
+    char **names = (char **)malloc(capacity * sizeof(char *));
+    int ok = names != NULL;
+    *count = 0;
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        if (!has_bmp_extension(entry->d_name)) continue;
+        if (*count == capacity) {
+            capacity *= 2;
+            char **grown = (char **)realloc(names, capacity * sizeof(char *));
+            if (!grown) {
+                ok = 0;
+                break;
+            }
+            names = grown;
+        }
+        size_t size = strlen(directory) + 1 + strlen(entry->d_name) + 1;
+        names[*count] = (char *)malloc(size);
+        if (!names[*count]) {
+            ok = 0;
+            break;
+        }
+        snprintf(names[*count], size, "%s/%s", directory, entry->d_name);
+        (*count)++;
+    }
+    closedir(dir);
+
+    if (!ok) {
+        printf("Erro ao alocar memória para a lista de arquivos.\n");
+        for (int i = 0; i < *count; i++) free(names[i]);
+        free(names);
+        return NULL;
+    }
+    if (*count > 0) qsort(names, *count, sizeof(char *), compare_names);
+    return names;
+}
+
+static int load_corpus_image(const char *filename, CODEC_TABLES *tables, CORPUS_IMAGE *image) {
+    /*
+     * Lê um BMP e guarda os coeficientes da DCT de todos os seus macroblocos.
+     * Retorna 1 em caso de sucesso, 0 se a imagem não puder ser usada.
+     *
+     * Parâmetros:
+     * filename: arquivo BMP
+     * tables: tabelas com a matriz da DCT
+     * image: imagem do corpus a ser preenchida
+     */
+    FILE *input_file = fopen(filename, "rb");
+    if (!input_file) {
+        printf("Erro ao abrir o arquivo BMP %s\n", filename);
+        return 0;
+    }
+
+    BITMAPFILEHEADER file_header;
+    BITMAPINFOHEADER info_header;
+    loadBMPHeaders(input_file, &file_header, &info_header);
+    if (info_header.Compression != 0) return 0; // loadBMPHeaders já fechou o arquivo
+
+    int width = info_header.Width;
+    int height = info_header.Height;
+    if (width <= 0 || height <= 0) {
+        printf("Aviso: %s ignorada (dimensões inválidas).\n", filename);
+        fclose(input_file);
+        return 0;
+    }
+
+    size_t pixel_count = (size_t)width * height;
+    int mb_rows = (height + 15) / 16;
+    int macroblock_count = ((width + 15) / 16) * mb_rows;
+    PIXELRGB *pixels_rgb = (PIXELRGB *)malloc(pixel_count * sizeof(PIXELRGB));
+    PIXELYCBCR *pixels_ycbcr = (PIXELYCBCR *)malloc(pixel_count * sizeof(PIXELYCBCR));
+    image->coefficients = (MACROBLOCO *)malloc(macroblock_count * sizeof(MACROBLOCO));
+    if (!pixels_rgb || !pixels_ycbcr || !image->coefficients) {
+        printf("Erro ao alocar memória para a imagem %s.\n", filename);
+        free(pixels_rgb);
+        free(pixels_ycbcr);
+        free(image->coefficients);
+        image->coefficients = NULL;
+        fclose(input_file);
+        return 0;
+    }
+
+    readPixels(input_file, info_header, file_header, pixels_rgb);
+    fclose(input_file);
+    convertToYCBCR(pixels_rgb, pixels_ycbcr, (int)pixel_count);
+    encodeMacroblockRows(pixels_ycbcr, width, height, 0, mb_rows, image->coefficients, tables, 0);
+    image->macroblock_count = macroblock_count;
+
+    free(pixels_rgb);
+    free(pixels_ycbcr);
+    return 1;
+}
+
+static double block_error(const float coefficients[8][8], const float quantized[8][8], int quantization_matrix[8][8]) {
+    // Erro quadrático de um bloco na DCT (ortonormal, então igual ao erro nos pixels)
+    double error = 0.0;
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+            double difference = coefficients[i][j] - quantized[i][j] * quantization_matrix[i][j];
+            error += difference * difference;
+        }
+    }
+    return error;
+}
+
+static MATRIX_COST evaluate_image(const CORPUS_IMAGE *image, OPTIMIZER_SCRATCH *scratch) {
+    /*
+     * Tamanho e erro de uma imagem com as matrizes de scratch->tables: quantização, RLE, DC
+     * diferencial e contagem dos bits do Huffman, macrobloco por macrobloco, como o compressor faz.
+     */
+    MATRIX_COST cost = {0, 0.0};
+    CODEC_TABLES *tables = &scratch->tables;
+    MACROBLOCO *mb = &scratch->macroblock;
+    int predictors[3] = {0, 0, 0};
+
+    for (int i = 0; i < image->macroblock_count; i++) {
+        const MACROBLOCO *original = &image->coefficients[i];
+        *mb = *original;
+        quantizeMacroblocksWithTables(mb, 1, tables);
+
+        for (int b = 0; b < 4; b++) {
+            cost.squared_error += LUMA_WEIGHT * block_error(original->Y[b].block, mb->Y[b].block, tables->quantization_matrix_y);
+        }
+        cost.squared_error += 4.0 * block_error(original->Cb.block, mb->Cb.block, tables->quantization_matrix_chroma);
+        cost.squared_error += 4.0 * block_error(original->Cr.block, mb->Cr.block, tables->quantization_matrix_chroma);
+
+        vectorize_macroblocks(mb, &scratch->vectorized, 1);
+        rle_encode_macroblocks(&scratch->rle, &scratch->vectorized, 1);
+        differential_encode_dc_range(&scratch->rle, 1, predictors);
+        cost.bytes += sizeof(size_t) + huffman_macroblock_size(&scratch->rle, 0, 0);
+    }
+    return cost;
+}
+
+static void evaluate_image_task(void *arg, int index, int thread_id) {
+    // Avalia as matrizes únicas do job em uma imagem do corpus
+    EVALUATION_JOB *job = (EVALUATION_JOB *)arg;
+    OPTIMIZER_SCRATCH *scratch = &job->scratch[thread_id];
+    set_codec_tables_matrices(&scratch->tables, job->matrices);
+    job->costs[index] = evaluate_image(&job->images[index], scratch);
+}
+
+static void evaluate_candidate_task(void *arg, int index, int thread_id) {
+    // Avalia uma matriz candidata no corpus inteiro (as imagens são somadas sempre na mesma ordem)
+    EVALUATION_JOB *job = (EVALUATION_JOB *)arg;
+    OPTIMIZER_SCRATCH *scratch = &job->scratch[thread_id];
+    set_codec_tables_matrices(&scratch->tables, &job->matrices[index]);
+
+    MATRIX_COST total = {0, 0.0};
+    for (int i = 0; i < job->image_count; i++) {
+        MATRIX_COST cost = evaluate_image(&job->images[i], scratch);
+        total.bytes += cost.bytes;
+        total.squared_error += cost.squared_error;
+    }
+    job->costs[index] = total;
+}
+
+// Estado da otimização
+typedef struct {
+    EVALUATION_JOB job;
+    MATRIX_COST *image_costs;           // Um por imagem
+    int num_threads;
+    double sample_count;                // Amostras do corpus, com os pesos de Y, Cb e Cr (crominância contada por pixel)
+    double target_error;                // Erro quadrático total correspondente ao PSNR alvo
+} OPTIMIZER;
+
+static MATRIX_COST evaluate_corpus(OPTIMIZER *optimizer, const QUANT_MATRICES *matrices) {
+    // Avalia um conjunto de matrizes no corpus, com as imagens divididas entre as threads
+    optimizer->job.matrices = matrices;
+    optimizer->job.costs = optimizer->image_costs;
+    run_work_stealing(evaluate_image_task, &optimizer->job, optimizer->job.image_count, optimizer->num_threads);
+
+    MATRIX_COST total = {0, 0.0};
+    for (int i = 0; i < optimizer->job.image_count; i++) {
+        total.bytes += optimizer->image_costs[i].bytes;
+        total.squared_error += optimizer->image_costs[i].squared_error;
+    }
+    return total;
+}
+
+static int round_entry(double value) {
+    // Valor efetivo de uma posição das matrizes (inteiro de 1 a QUANT_MATRIX_MAX_VALUE)
+    long rounded = lround(value);
+    if (rounded < 1) return 1;
+    if (rounded > QUANT_MATRIX_MAX_VALUE) return QUANT_MATRIX_MAX_VALUE;
+    return (int)rounded;
+}
+
+static void shape_to_matrices(const double *shape, double scale, QUANT_MATRICES *matrices) {
+    // Matrizes efetivas de um formato (128 valores reais) multiplicado por uma escala
+    for (int k = 0; k < 64; k++) {
+        matrices->y[k / 8][k % 8] = round_entry(shape[k] * scale);
+        matrices->chroma[k / 8][k % 8] = round_entry(shape[64 + k] * scale);
+    }
+}
+
+static double psnr(const OPTIMIZER *optimizer, double squared_error) {
+    // PSNR ponderado de Y, Cb e Cr (6:1:1) para um erro quadrático total do corpus
+    if (squared_error <= 0.0) return INFINITY;
+    return 10.0 * log10(255.0 * 255.0 * optimizer->sample_count / squared_error);
+}
+
+static int fit_scale(OPTIMIZER *optimizer, double *shape, MATRIX_COST *cost) {
+    /*
+     * Busca binária (em escala logarítmica) pela maior escala do formato que ainda atinge
+     * o PSNR alvo e incorpora essa escala ao formato, que passa a ser as próprias matrizes.
+     * Retorna 0 se nem a menor escala atingir o alvo.
+     *
+     * Parâmetros:
+     * optimizer: estado da otimização
+     * shape: 128 valores das matrizes, reescalados no lugar
+     * cost: tamanho e erro do corpus com as matrizes finais
+     */
+    QUANT_MATRICES matrices;
+    double low = -8.0, high = 8.0;      // log2 da escala
+    int found = 0;
+    MATRIX_COST best = {0, 0.0};
+    for (int step = 0; step < SCALE_SEARCH_STEPS; step++) {
+        double middle = (low + high) / 2.0;
+        shape_to_matrices(shape, exp2(middle), &matrices);
+        MATRIX_COST current = evaluate_corpus(optimizer, &matrices);
+        if (current.squared_error <= optimizer->target_error) {
+            low = middle;
+            best = current;
+            found = 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (!found) {
+        shape_to_matrices(shape, exp2(low), &matrices);
+        best = evaluate_corpus(optimizer, &matrices);
+        if (best.squared_error > optimizer->target_error) return 0;
+    }
+
+    double scale = exp2(low);
+    for (int k = 0; k < MATRIX_ENTRIES; k++) {
+        shape[k] *= scale;
+    }
+    *cost = best;
+    return 1;
+}
+
+static double lagrange_multiplier(OPTIMIZER *optimizer, const double *shape, const MATRIX_COST *cost) {
+    /*
+     * Bytes economizados por unidade de erro perto do ponto atual, medidos com o formato
+     * 3% maior. Usado para comparar candidatas com tamanho e erro diferentes.
+     */
+    QUANT_MATRICES matrices;
+    shape_to_matrices(shape, 1.03, &matrices);
+    MATRIX_COST coarser = evaluate_corpus(optimizer, &matrices);
+    double saved = (double)cost->bytes - (double)coarser.bytes;
+    double added = coarser.squared_error - cost->squared_error;
+    if (saved <= 0.0 || added <= 0.0) return (double)cost->bytes / cost->squared_error;
+    return saved / added;
+}
+
+static double candidate_value(double value, double factor) {
+    // Valor de uma posição multiplicado pelo fator, mudando o valor efetivo em pelo menos 1
+    int current = round_entry(value);
+    double candidate = value * factor;
+    if (round_entry(candidate) == current) candidate = factor > 1.0 ? current + 1 : current - 1;
+    return candidate;
+}
+
+static int optimize_matrices(OPTIMIZER *optimizer, double *shape, int passes, MATRIX_COST *cost) {
+    /*
+     * Descida por coordenadas: em cada passada, cada um dos 128 valores é aumentado e diminuído
+     * pelo fator atual, e todas as 256 candidatas são avaliadas em paralelo com o custo
+     * bytes + lambda * erro. As melhoras são aplicadas juntas (ou só a melhor, se juntas não
+     * reduzirem o corpus), a escala é reajustada ao PSNR alvo e a passada só é mantida se o corpus ficar menor.
+     * Sem melhora, o fator diminui. Retorna 0 em caso de erro.
+     */
+    int candidate_count = 2 * MATRIX_ENTRIES;
+    QUANT_MATRICES *candidates = (QUANT_MATRICES *)malloc((candidate_count + 1) * sizeof(QUANT_MATRICES));
+    MATRIX_COST *costs = (MATRIX_COST *)malloc((candidate_count + 1) * sizeof(MATRIX_COST));
+    double *values = (double *)malloc(candidate_count * sizeof(double));
+    if (!candidates || !costs || !values) {
+        printf("Erro ao alocar memória para as matrizes candidatas.\n");
+        free(candidates);
+        free(costs);
+        free(values);
+        return 0;
+    }
+
+    double factor = INITIAL_STEP_FACTOR;
+    for (int pass = 1; pass <= passes && factor >= MIN_STEP_FACTOR; pass++) {
+        double lambda = lagrange_multiplier(optimizer, shape, cost);
+        double current_cost = cost->bytes + lambda * cost->squared_error;
+
+        // Candidatas: cada posição aumentada e diminuída (as que não mudam nada repetem as matrizes atuais)
+        for (int k = 0; k < MATRIX_ENTRIES; k++) {
+            for (int direction = 0; direction < 2; direction++) {
+                int index = 2 * k + direction;
+                double value = candidate_value(shape[k], direction == 0 ? factor : 1.0 / factor);
+                values[index] = value;
+                double saved = shape[k];
+                shape[k] = value;
+                shape_to_matrices(shape, 1.0, &candidates[index]);
+                shape[k] = saved;
+            }
+        }
+        optimizer->job.matrices = candidates;
+        optimizer->job.costs = costs;
+        run_work_stealing(evaluate_candidate_task, &optimizer->job, candidate_count, optimizer->num_threads);
+
+        // Melhor direção de cada posição que reduz o custo
+        double previous[MATRIX_ENTRIES];
+        memcpy(previous, shape, sizeof(previous));
+        int improved = 0, best_index = -1;
+        double best_cost = current_cost;
+        for (int k = 0; k < MATRIX_ENTRIES; k++) {
+            int chosen = -1;
+            double chosen_cost = current_cost;
+            for (int direction = 0; direction < 2; direction++) {
+                int index = 2 * k + direction;
+                double candidate_cost = costs[index].bytes + lambda * costs[index].squared_error;
+                if (candidate_cost < chosen_cost) {
+                    chosen = index;
+                    chosen_cost = candidate_cost;
+                }
+            }
+            if (chosen < 0) continue;
+            shape[k] = values[chosen];
+            improved++;
+            if (chosen_cost < best_cost) {
+                best_cost = chosen_cost;
+                best_index = chosen;
+            }
+        }
+
+        MATRIX_COST fitted = *cost;
+        int accepted = 0;
+        if (improved > 1) {
+            // Todas as melhoras juntas, se o custo combinado não for pior que o da melhor sozinha
+            shape_to_matrices(shape, 1.0, &candidates[candidate_count]);
+            MATRIX_COST combined = evaluate_corpus(optimizer, &candidates[candidate_count]);
+            if (combined.bytes + lambda * combined.squared_error <= best_cost) {
+                accepted = fit_scale(optimizer, shape, &fitted) && fitted.bytes < cost->bytes;
+            }
+        }
+        if (improved > 0 && !accepted) {
+            // Senão, só a melhor
+            memcpy(shape, previous, sizeof(previous));
+            shape[best_index / 2] = values[best_index];
+            improved = 1;
+            accepted = fit_scale(optimizer, shape, &fitted) && fitted.bytes < cost->bytes;
+        }
+
+        if (accepted) {
+            *cost = fitted;
+        } else {
+            memcpy(shape, previous, sizeof(previous));
+            factor = sqrt(factor);
+        }
+        printf("Passada %d: %d posições alteradas, %zu bytes (PSNR %.2f dB)\n", pass, accepted ? improved : 0, cost->bytes, psnr(optimizer, cost->squared_error));
+    }
+
+    free(candidates);
+    free(costs);
+    free(values);
+    return 1;
+}
+
+static int write_matrices(const char *filename, const QUANT_MATRICES *matrices, double target_psnr, int image_count) {
+    // Grava as matrizes no formato lido por load_quant_matrices. Retorna 1 em caso de sucesso.
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        printf("Erro ao abrir o arquivo %s para escrita\n", filename);
+        return 0;
+    }
+    fprintf(file, "# Matrizes geradas pelo optimizer para PSNR %.2f dB em %d imagens\n", target_psnr, image_count);
+    fprintf(file, "# Uso: ./compressor <original.bmp> <comprimido.bin> 50 --matrices %s\n", filename);
+    for (int m = 0; m < 2; m++) {
+        fprintf(file, m == 0 ? "# Luminância\n" : "# Crominância\n");
+        const int (*matrix)[8] = m == 0 ? matrices->y : matrices->chroma;
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++) {
+                fprintf(file, j < 7 ? "%3d " : "%3d\n", matrix[i][j]);
+            }
+        }
+    }
+    int ok = fclose(file) == 0;
+    if (!ok) printf("Erro ao gravar o arquivo %s.\n", filename);
+    return ok;
+}
+
+static void load_image_task(void *arg, int index, int thread_id) {
+    // Lê uma imagem do corpus e calcula a sua DCT
+    EVALUATION_JOB *job = (EVALUATION_JOB *)arg;
+    CORPUS_IMAGE *image = &job->images[index];
+    if (!load_corpus_image(job->filenames[index], &job->scratch[thread_id].tables, image)) {
+        image->coefficients = NULL;
+        image->macroblock_count = 0;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        print_usage();
+        return 1;
+    }
+
+    const char *directory = argv[1];
+    const char *output_filename = argv[2];
+    double target_psnr = 0.0;
+    int passes = 6;
+    int num_threads = 1;
+    for (int i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "--psnr") == 0 && i + 1 < argc) {
+            target_psnr = atof(argv[++i]);
+            if (target_psnr <= 0.0) {
+                printf("Erro: PSNR alvo deve ser maior que zero.\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--passes") == 0 && i + 1 < argc) {
+            passes = atoi(argv[++i]);
+            if (passes < 1) {
+                printf("Erro: Número de passadas deve ser maior que zero.\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+            if (num_threads < 1) {
+                printf("Erro: Número de threads deve ser maior que zero.\n");
+                return 1;
+            }
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    int file_count;
+    char **names = list_bmp_files(directory, &file_count);
+    if (!names) return 1;
+    if (file_count == 0) {
+        printf("Erro: Nenhum arquivo .bmp em %s.\n", directory);
+        free(names);
+        return 1;
+    }
+
+    OPTIMIZER optimizer;
+    memset(&optimizer, 0, sizeof(optimizer));
+    optimizer.num_threads = num_threads;
+    optimizer.job.images = (CORPUS_IMAGE *)calloc(file_count, sizeof(CORPUS_IMAGE));
+    optimizer.job.scratch = (OPTIMIZER_SCRATCH *)malloc(num_threads * sizeof(OPTIMIZER_SCRATCH));
+    optimizer.image_costs = (MATRIX_COST *)malloc(file_count * sizeof(MATRIX_COST));
+    if (!optimizer.job.images || !optimizer.job.scratch || !optimizer.image_costs) {
+        printf("Erro ao alocar memória para o corpus.\n");
+        return 1;
+    }
+    for (int t = 0; t < num_threads; t++) {
+        init_codec_tables(&optimizer.job.scratch[t].tables, 50);
+    }
+
+    // 1. Conversão de cores e DCT de cada imagem, uma única vez
+    optimizer.job.filenames = (const char *const *)names;
+    run_work_stealing(load_image_task, &optimizer.job, file_count, num_threads);
+
+    // Remove as imagens que não puderam ser lidas
+    int image_count = 0;
+    long macroblock_total = 0;
+    for (int i = 0; i < file_count; i++) {
+        if (!optimizer.job.images[i].coefficients) continue;
+        macroblock_total += optimizer.job.images[i].macroblock_count;
+        optimizer.job.images[image_count++] = optimizer.job.images[i];
+    }
+    optimizer.job.image_count = image_count;
+    optimizer.sample_count = (LUMA_WEIGHT + 2.0) * 256.0 * macroblock_total;
+    if (image_count == 0) {
+        printf("Erro: Nenhuma imagem de %s pôde ser usada.\n", directory);
+        return 1;
+    }
+    printf("Corpus: %d imagens, %ld macroblocos\n", image_count, macroblock_total);
+
+    // 2. Ponto de partida: as matrizes do Anexo K, e o PSNR delas na qualidade 50 se nenhum alvo foi dado
+    QUANT_MATRICES matrices;
+    get_codec_tables_matrices(&optimizer.job.scratch[0].tables, &matrices);
+    double shape[MATRIX_ENTRIES];
+    for (int k = 0; k < 64; k++) {
+        shape[k] = matrices.y[k / 8][k % 8];
+        shape[64 + k] = matrices.chroma[k / 8][k % 8];
+    }
+    if (target_psnr == 0.0) {
+        MATRIX_COST reference = evaluate_corpus(&optimizer, &matrices);
+        target_psnr = psnr(&optimizer, reference.squared_error);
+    }
+    optimizer.target_error = 255.0 * 255.0 * optimizer.sample_count / pow(10.0, target_psnr / 10.0);
+
+    MATRIX_COST cost;
+    if (!fit_scale(&optimizer, shape, &cost)) {
+        printf("Erro: PSNR alvo de %.2f dB inalcançável.\n", target_psnr);
+        return 1;
+    }
+    size_t reference_bytes = cost.bytes;
+    printf("PSNR alvo: %.2f dB\n", target_psnr);
+    printf("Anexo K: %zu bytes (PSNR %.2f dB)\n", cost.bytes, psnr(&optimizer, cost.squared_error));
+
+    // 3. Busca pelas matrizes
+    int ok = optimize_matrices(&optimizer, shape, passes, &cost);
+    if (ok) {
+        shape_to_matrices(shape, 1.0, &matrices);
+        printf("Otimizadas: %zu bytes (%.2f%% menor que o Anexo K)\n", cost.bytes, 100.0 * (1.0 - (double)cost.bytes / reference_bytes));
+        ok = write_matrices(output_filename, &matrices, target_psnr, image_count);
+    }
+
+    for (int i = 0; i < image_count; i++) {
+        free(optimizer.job.images[i].coefficients);
+    }
+    for (int i = 0; i < file_count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(optimizer.job.images);
+    free(optimizer.job.scratch);
+    free(optimizer.image_costs);
+    return ok ? 0 : 1;
+}
@@ -35,7 +35,14 @@ echo Creating output directories...
 mkdir compressed_files >nul 2>nul
 mkdir reconstructed_images >nul 2>nul
 
-REM 5. Main loop that iterates from 1 to 100
+REM 5. Compress every quality in a single run: colour conversion and DCT are done only once
+REM    and the compressor writes compressed_files\compressed_q<quality>.bin for each quality
+echo Compressing qualities 1 to 100...
+SET "QUALITIES=1"
+FOR /L %%q IN (2, 1, 100) DO SET "QUALITIES=!QUALITIES!,%%q"
+compressor.exe "%INPUT_IMAGE%" "compressed_files\compressed.bin" --qualities !QUALITIES! >nul
+
+REM 6. Main loop that iterates from 1 to 100
 FOR /L %%q IN (1, 1, 100) DO (
     echo --- Testing Quality: %%q/100 ---
 
@@ -43,10 +50,6 @@ FOR /L %%q IN (1, 1, 100) DO (
     SET "COMPRESSED_FILE=compressed_files\compressed_q%%q.bin"
     SET "RECONSTRUCTED_FILE=reconstructed_images\reconstructed_q%%q.bmp"
 
-    REM Run the compressor
-    echo Compressing with quality %%q...
-    compressor.exe "%INPUT_IMAGE%" "!COMPRESSED_FILE!" %%q
-
     REM Check if compression was successful before decompressing
     if exist "!COMPRESSED_FILE!" (
         REM Run the decompressor
@@ -31,7 +31,13 @@ echo "Criando diretórios de saída..."
 mkdir -p compressed_files
 mkdir -p reconstructed_images
 
-# 5. Loop principal que itera de 1 a 100
+# 5. Comprime todas as qualidades de uma vez: a conversão de cores e a DCT são feitas uma única vez
+#    e o compressor grava compressed_files/compressed_q<qualidade>.bin para cada qualidade
+echo "Comprimindo as qualidades 1 a 100..."
+QUALITIES=$(seq -s, 1 100)
+./compressor "$INPUT_IMAGE" "compressed_files/compressed.bin" --qualities "$QUALITIES" > /dev/null
+
+# 6. Loop principal que itera de 1 a 100
 for q in {1..100}
 do
     echo "--- Testando Qualidade: $q/100 ---"
@@ -40,10 +46,6 @@ do
     COMPRESSED_FILE="compressed_files/compressed_q${q}.bin"
     RECONSTRUCTED_FILE="reconstructed_images/reconstructed_q${q}.bmp"
 
-    # Executa o compressor
-    echo "Comprimindo com qualidade $q..."
-    ./compressor "$INPUT_IMAGE" "$COMPRESSED_FILE" "$q"
-
     # Verifica se a compressão foi bem-sucedida antes de descomprimir
     if [ -f "$COMPRESSED_FILE" ]; then
         # Executa o descompressor
@@ -0,0 +1,93 @@
+/* Esse arquivo implementa a arena de memória usada pelos contextos e pelo pipeline (arena.h).
+ * Toda a memória temporária de uma imagem vem de um único bloco alinhado: cortar um vetor é só
+ * avançar um deslocamento, e a imagem inteira é devolvida com um reset, sem caminhos de limpeza
+ * separados para cada vetor.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+void* aligned_malloc(size_t size) {
+    /*
+     * Aloca size bytes alinhados em ARENA_ALIGNMENT bytes. O ponteiro original fica guardado
+     * logo antes do bloco retornado, para aligned_free. Retorna NULL se faltar memória.
+     *
+     * Parâmetros:
+     * size: número de bytes
+     */
+    uint8_t *raw = (uint8_t *)malloc(size + ARENA_ALIGNMENT + sizeof(void *));
+    if (!raw) return NULL;
+    uintptr_t address = (uintptr_t)(raw + sizeof(void *));
+    uint8_t *aligned = raw + sizeof(void *) + (ARENA_ALIGNMENT - address % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+    memcpy(aligned - sizeof(void *), &raw, sizeof(void *));
+    return aligned;
+}
+
+void aligned_free(void *pointer) {
+    /*
+     * Libera um bloco obtido com aligned_malloc (NULL é ignorado).
+     */
+    if (!pointer) return;
+    void *raw;
+    memcpy(&raw, (uint8_t *)pointer - sizeof(void *), sizeof(void *));
+    free(raw);
+}
+
+size_t arena_size(size_t size) {
+    /*
+     * Espaço que um vetor de size bytes ocupa na arena (arredondado para o alinhamento).
+     * Somando arena_size de cada vetor obtém-se a capacidade a reservar para uma imagem.
+     */
+    return (size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+}
+
+int arena_reserve(ARENA *arena, size_t capacity, long *allocations) {
+    /*
+     * Garante que a arena tem pelo menos capacity bytes. Se precisar crescer, o bloco antigo é
+     * trocado por um novo (o conteúdo não é preservado) e a arena volta a ficar vazia.
+     * Retorna 1 em caso de sucesso, 0 se faltar memória (a arena fica vazia e sem bloco).
+     *
+     * Parâmetros:
+     * arena: arena a ser garantida (zerada antes do primeiro uso)
+     * capacity: bytes necessários
+     * allocations: contador incrementado a cada alocação (pode ser NULL)
+     */
+    if (capacity <= arena->capacity) return 1;
+    arena_free(arena);
+    arena->base = (uint8_t *)aligned_malloc(capacity);
+    if (!arena->base) return 0;
+    arena->capacity = capacity;
+    if (allocations) (*allocations)++;
+    return 1;
+}
+
+void* arena_alloc(ARENA *arena, size_t size) {
+    /*
+     * Corta um vetor de size bytes alinhado em ARENA_ALIGNMENT. Retorna NULL se não couber.
+     *
+     * Parâmetros:
+     * arena: arena de onde o vetor é cortado
+     * size: número de bytes
+     */
+    size_t needed = arena_size(size);
+    if (!arena->base || needed > arena->capacity - arena->used) return NULL;
+    void *pointer = arena->base + arena->used;
+    arena->used += needed;
+    return pointer;
+}
+
+void arena_reset(ARENA *arena) {
+    /*
+     * Devolve de uma vez todos os vetores cortados da arena, mantendo o bloco para a próxima imagem.
+     */
+    arena->used = 0;
+}
+
+void arena_free(ARENA *arena) {
+    /*
+     * Libera o bloco da arena e volta a estrutura para o estado vazio.
+     */
+    aligned_free(arena->base);
+    memset(arena, 0, sizeof(*arena));
+}
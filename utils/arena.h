@@ -0,0 +1,25 @@
+#ifndef ARENA_H
+    #define ARENA_H
+
+    #include <stddef.h>
+    #include <stdint.h>
+
+    // Alinhamento de cada vetor servido pela arena (uma linha de cache, suficiente para SIMD)
+    #define ARENA_ALIGNMENT 64
+
+    // Arena de memória: um único bloco do qual os vetores de uma imagem são cortados em sequência
+    // e devolvidos todos de uma vez com arena_reset, sem liberar nada individualmente
+    typedef struct {
+        uint8_t *base;
+        size_t capacity;            // Tamanho do bloco em bytes
+        size_t used;                // Bytes cortados desde o último reset
+    } ARENA;
+
+    void* aligned_malloc(size_t size);
+    void aligned_free(void *pointer);
+    size_t arena_size(size_t size);
+    int arena_reserve(ARENA *arena, size_t capacity, long *allocations);
+    void* arena_alloc(ARENA *arena, size_t size);
+    void arena_reset(ARENA *arena);
+    void arena_free(ARENA *arena);
+#endif
@@ -0,0 +1,310 @@
+/* Esse arquivo é responsável pelo modo em lote do compressor e do descompressor.
+ * Os arquivos vêm de um manifesto (um caminho por linha) ou de um diretório e são distribuídos
+ * entre as threads com roubo de tarefas (run_work_stealing), de modo que imagens grandes e pequenas
+ * fiquem equilibradas. Cada thread reaproveita os mesmos vetores de trabalho entre as imagens.
+ */
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+    #include <direct.h>
+    #define make_directory(path) _mkdir(path)
+#else
+    #define make_directory(path) mkdir(path, 0755)
+#endif
+
+#include "batch.h"
+#include "parallel.h"
+#include "test.h"
+
+#define MAX_PATH_LENGTH 4096
+
+// Um arquivo do lote
+typedef struct {
+    char *input;
+    char *output;
+    long input_size;
+    long output_size;
+    long allocations;           // Alocações feitas pelo contexto da thread durante o arquivo
+    int warm;                   // O contexto já tinha processado outro arquivo antes deste
+    int ok;
+} BATCH_FILE;
+
+// Estado compartilhado pelas threads durante o lote
+typedef struct {
+    const BATCH_OPTIONS *options;
+    BATCH_FILE *files;
+    ENCODER_CONTEXT *encoders;  // Contextos de cada thread (só os do modo em uso são criados)
+    DECODER_CONTEXT *decoders;
+    int *processed;             // Arquivos já processados por cada thread
+    int file_threads;           // Threads usadas dentro de cada arquivo
+} BATCH_JOB;
+
+static char *copy_string(const char *text) {
+    // Cópia alocada de uma string (NULL se faltar memória)
+    char *copy = (char *)malloc(strlen(text) + 1);
+    if (copy) strcpy(copy, text);
+    return copy;
+}
+
+static int has_extension(const char *filename, const char *extension) {
+    // Verifica, sem diferenciar maiúsculas, se o nome termina com a extensão
+    size_t length = strlen(filename);
+    size_t extension_length = strlen(extension);
+    if (length <= extension_length) return 0;
+    for (size_t i = 0; i < extension_length; i++) {
+        if (tolower((unsigned char)filename[length - extension_length + i]) != tolower((unsigned char)extension[i])) return 0;
+    }
+    return 1;
+}
+
+static char *output_path(const char *output_dir, const char *input, const char *extension) {
+    /*
+     * Monta o caminho de saída: diretório de saída + nome do arquivo de entrada
+     * sem diretório e sem extensão + nova extensão.
+     */
+    const char *name = input;
+    for (const char *c = input; *c; c++) {
+        if (*c == '/' || *c == '\\') name = c + 1;
+    }
+    size_t name_length = strlen(name);
+    const char *dot = strrchr(name, '.');
+    if (dot && dot != name) name_length = (size_t)(dot - name);
+
+    size_t size = strlen(output_dir) + 1 + name_length + strlen(extension) + 1;
+    char *path = (char *)malloc(size);
+    if (path) snprintf(path, size, "%s/%.*s%s", output_dir, (int)name_length, name, extension);
+    return path;
+}
+
+static int add_file(BATCH_FILE **files, int *count, int *capacity, const char *input, const char *output_dir, const char *extension) {
+    // Acrescenta um arquivo à lista do lote. Retorna 0 se faltar memória.
+    if (*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 16;
+        BATCH_FILE *grown = (BATCH_FILE *)realloc(*files, new_capacity * sizeof(BATCH_FILE));
+        if (!grown) return 0;
+        *files = grown;
+        *capacity = new_capacity;
+    }
+    BATCH_FILE *file = &(*files)[*count];
+    memset(file, 0, sizeof(*file));
+    file->input = copy_string(input);
+    file->output = output_path(output_dir, input, extension);
+    if (!file->input || !file->output) {
+        free(file->input);
+        free(file->output);
+        return 0;
+    }
+    (*count)++;
+    return 1;
+}
+
+static int compare_files(const void *a, const void *b) {
+    return strcmp(((const BATCH_FILE *)a)->input, ((const BATCH_FILE *)b)->input);
+}
+
+static int list_directory(const char *directory, const char *input_extension, const char *output_dir, const char *output_extension, BATCH_FILE **files, int *count) {
+    /*
+     * Lista os arquivos do diretório com a extensão de entrada, em ordem alfabética.
+     * Retorna 1 em caso de sucesso, 0 em caso de erro.
+     */
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        printf("Erro ao abrir o diretório %s.\n", directory);
+        return 0;
+    }
+
+    int capacity = 0;
+    int ok = 1;
+    char path[MAX_PATH_LENGTH];
+    struct dirent *entry;
+    while (ok && (entry = readdir(dir)) != NULL) {
+        if (!has_extension(entry->d_name, input_extension)) continue;
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        ok = add_file(files, count, &capacity, path, output_dir, output_extension);
+    }
+    closedir(dir);
+
+    if (ok) qsort(*files, *count, sizeof(BATCH_FILE), compare_files);
+    return ok;
+}
+
+static int read_manifest(const char *manifest, const char *output_dir, const char *output_extension, BATCH_FILE **files, int *count) {
+    /*
+     * Lê um manifesto com um caminho por linha. Linhas vazias e começadas por '#' são ignoradas.
+     * Retorna 1 em caso de sucesso, 0 em caso de erro.
+     */
+    FILE *manifest_file = fopen(manifest, "r");
+    if (!manifest_file) {
+        printf("Erro ao abrir o manifesto %s.\n", manifest);
+        return 0;
+    }
+
+    int capacity = 0;
+    int ok = 1;
+    char line[MAX_PATH_LENGTH];
+    while (ok && fgets(line, sizeof(line), manifest_file)) {
+        // Remove a quebra de linha e os espaços das pontas
+        size_t length = strlen(line);
+        while (length > 0 && isspace((unsigned char)line[length - 1])) line[--length] = '\0';
+        char *start = line;
+        while (isspace((unsigned char)*start)) start++;
+        if (*start == '\0' || *start == '#') continue;
+
+        ok = add_file(files, count, &capacity, start, output_dir, output_extension);
+    }
+    fclose(manifest_file);
+    return ok;
+}
+
+static void batch_task(void *arg, int index, int thread_id) {
+    /*
+     * Processa um arquivo do lote com o contexto da thread, anotando quantas alocações ele exigiu.
+     */
+    BATCH_JOB *job = (BATCH_JOB *)arg;
+    BATCH_FILE *file = &job->files[index];
+    const BATCH_OPTIONS *options = job->options;
+    file->warm = job->processed[thread_id]++ > 0;
+
+    if (options->mode == BATCH_COMPRESS) {
+        ENCODER_CONTEXT *context = &job->encoders[thread_id];
+        CODEC_OPTIONS encode = options->encode;
+        encode.num_threads = job->file_threads;
+        long before = context->work.allocations;
+        file->ok = compress_file(file->input, file->output, &encode, context);
+        file->allocations = context->work.allocations - before;
+    } else {
+        DECODER_CONTEXT *context = &job->decoders[thread_id];
+        long before = context->work.allocations;
+        file->ok = decompress_file(file->input, file->output, job->file_threads, options->scale, context);
+        file->allocations = context->work.allocations - before;
+    }
+
+    if (file->ok) {
+        file->input_size = fsize(file->input);
+        file->output_size = fsize(file->output);
+    } else {
+        printf("Falha ao processar %s.\n", file->input);
+    }
+}
+
+static double elapsed_seconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int run_batch(const char *source, const char *output_dir, const BATCH_OPTIONS *options, int num_threads) {
+    /*
+     * Comprime ou descomprime todos os arquivos de um manifesto ou diretório, gravando os
+     * resultados em output_dir com o mesmo nome e a nova extensão, e imprime a vazão agregada.
+     * Retorna 1 se todos os arquivos foram processados, 0 se algum falhou.
+     *
+     * Parâmetros:
+     * source: manifesto (um caminho por linha) ou diretório com os arquivos de entrada
+     *         (.bmp na compressão, .bin na descompressão)
+     * output_dir: diretório de saída (criado se não existir)
+     * options: operação e parâmetros de compressão
+     * num_threads: número de threads a serem usadas
+     */
+    const char *input_extension = options->mode == BATCH_COMPRESS ? ".bmp" : ".bin";
+    const char *output_extension = options->mode == BATCH_COMPRESS ? ".bin" : ".bmp";
+
+    struct stat info;
+    if (stat(output_dir, &info) != 0 && make_directory(output_dir) != 0) {
+        printf("Erro ao criar o diretório de saída %s.\n", output_dir);
+        return 0;
+    }
+
+    BATCH_FILE *files = NULL;
+    int file_count = 0;
+    int listed;
+    if (stat(source, &info) == 0 && S_ISDIR(info.st_mode)) {
+        listed = list_directory(source, input_extension, output_dir, output_extension, &files, &file_count);
+    } else {
+        listed = read_manifest(source, output_dir, output_extension, &files, &file_count);
+    }
+    if (!listed || file_count == 0) {
+        if (listed) printf("Nenhum arquivo %s encontrado em %s.\n", input_extension, source);
+        for (int i = 0; i < file_count; i++) {
+            free(files[i].input);
+            free(files[i].output);
+        }
+        free(files);
+        return 0;
+    }
+
+    // Com menos arquivos que threads, as threads que sobram ajudam dentro de cada arquivo
+    int workers = num_threads < file_count ? num_threads : file_count;
+    BATCH_JOB job;
+    job.options = options;
+    job.files = files;
+    job.file_threads = num_threads / workers;
+    job.encoders = NULL;
+    job.decoders = NULL;
+    if (options->mode == BATCH_COMPRESS) {
+        job.encoders = (ENCODER_CONTEXT *)calloc(workers, sizeof(ENCODER_CONTEXT));
+        for (int t = 0; job.encoders && t < workers; t++) init_encoder_context(&job.encoders[t]);
+    } else {
+        job.decoders = (DECODER_CONTEXT *)calloc(workers, sizeof(DECODER_CONTEXT));
+        for (int t = 0; job.decoders && t < workers; t++) init_decoder_context(&job.decoders[t]);
+    }
+    job.processed = (int *)calloc(workers, sizeof(int));
+
+    int ok = 0;
+    if ((!job.encoders && !job.decoders) || !job.processed) {
+        printf("Erro ao alocar memória para o lote.\n");
+    } else {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ok = run_work_stealing(batch_task, &job, file_count, workers);
+        double seconds = elapsed_seconds(&start);
+
+        // Relatório agregado
+        int failures = 0;
+        double input_bytes = 0, output_bytes = 0;
+        long allocations = 0, warm_allocations = 0;
+        for (int i = 0; i < file_count; i++) {
+            allocations += files[i].allocations;
+            if (files[i].warm) warm_allocations += files[i].allocations;
+            if (!files[i].ok) {
+                failures++;
+                continue;
+            }
+            input_bytes += files[i].input_size;
+            output_bytes += files[i].output_size;
+        }
+        int done = file_count - failures;
+        if (seconds <= 0) seconds = 1e-9;
+
+        printf("Lote concluído: %d de %d arquivos em %.3f s com %d threads (%d falhas)\n", done, file_count, seconds, num_threads, failures);
+        printf("Entrada: %.2f MB | Saída: %.2f MB\n", input_bytes / 1e6, output_bytes / 1e6);
+        printf("Vazão: %.2f arquivos/s | %.2f MB/s de entrada | %.2f MB/s de saída\n", done / seconds, input_bytes / 1e6 / seconds, output_bytes / 1e6 / seconds);
+        if (options->mode == BATCH_COMPRESS && output_bytes > 0) {
+            printf("Taxa de compressao agregada: 1:%.2f (%.2f%% menor)\n", input_bytes / output_bytes, (1.0 - output_bytes / input_bytes) * 100.0);
+        }
+        // Depois do primeiro arquivo de cada thread, só imagens maiores que as anteriores deveriam alocar
+        printf("Alocações dos contextos: %ld (%ld depois do primeiro arquivo de cada thread)\n", allocations, warm_allocations);
+        ok = ok && failures == 0;
+    }
+
+    for (int t = 0; t < workers; t++) {
+        if (job.encoders) free_encoder_context(&job.encoders[t]);
+        if (job.decoders) free_decoder_context(&job.decoders[t]);
+    }
+    free(job.encoders);
+    free(job.decoders);
+    free(job.processed);
+
+    for (int i = 0; i < file_count; i++) {
+        free(files[i].input);
+        free(files[i].output);
+    }
+    free(files);
+    return ok;
+}
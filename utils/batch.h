@@ -0,0 +1,17 @@
+#ifndef BATCH_H
+    #define BATCH_H
+
+    #include "codec.h"
+
+    // Operação aplicada a cada arquivo do lote
+    #define BATCH_COMPRESS 0
+    #define BATCH_DECOMPRESS 1
+
+    typedef struct {
+        int mode;                   // BATCH_COMPRESS ou BATCH_DECOMPRESS
+        CODEC_OPTIONS encode;       // Opções da compressão (num_threads é ignorado: cada arquivo usa as threads do lote)
+        int scale;                  // Denominador da escala da descompressão (1 = tamanho original)
+    } BATCH_OPTIONS;
+
+    int run_batch(const char *source, const char *output_dir, const BATCH_OPTIONS *options, int num_threads);
+#endif
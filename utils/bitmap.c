@@ -76,6 +76,11 @@ void printHeaders (BITMAPFILEHEADER *FileHeader,  BITMAPINFOHEADER *InfoHeader)
     printf("Number of important colors: %d\n", InfoHeader->ImportantColours); 
 }
 
+// Bytes de preenchimento no fim de cada linha de pixels do BMP, que ocupa um múltiplo de 4 bytes
+static int row_padding(int width) {
+    return (4 - (width * 3) % 4) % 4;
+}
+
 void readPixels(FILE *input, BITMAPINFOHEADER InfoHeader, BITMAPFILEHEADER FileHeader, PIXELRGB *Image) {
     /* 
      * Lê os pixels do arquivo BMP e armazena no vetor de pixels Image.
@@ -83,14 +88,53 @@ void readPixels(FILE *input, BITMAPINFOHEADER InfoHeader, BITMAPFILEHEADER FileH
      */    
     fseek(input, FileHeader.OffBits, SEEK_SET); // pular o header
     
-    int tam = InfoHeader.Height * InfoHeader.Width;
-    for (int i = 0; i < tam; i++) {
-        Image[i].B = fgetc(input);
-        Image[i].G = fgetc(input);
-        Image[i].R = fgetc(input);
+    readPixelRows(input, InfoHeader.Width, InfoHeader.Height, Image);
+}
+
+void readPixelRows(FILE *input, int width, int row_count, PIXELRGB *Image) {
+    /*
+     * Lê row_count linhas de pixels a partir da posição atual do arquivo, em ordem BGR,
+     * pulando o preenchimento do fim de cada linha (larguras cujas linhas não têm múltiplo de 4 bytes).
+     * Permite ler a imagem em faixas, uma depois da outra, depois de readPixels ou de um fseek para OffBits.
+     */
+    int padding = row_padding(width);
+    for (int y = 0; y < row_count; y++) {
+        PIXELRGB *row = Image + (size_t)y * width;
+        for (int x = 0; x < width; x++) {
+            row[x].B = fgetc(input);
+            row[x].G = fgetc(input);
+            row[x].R = fgetc(input);
+        }
+        for (int i = 0; i < padding; i++) fgetc(input);
     }
 }
 
+void createBMPHeaders(int width, int height, BITMAPFILEHEADER *FileHeader, BITMAPINFOHEADER *InfoHeader) {
+    /*
+     * Preenche os cabeçalhos de um BMP de 24 bits sem compressão com as dimensões dadas,
+     * para imagens que não vieram de um arquivo BMP.
+     */
+    unsigned int data_size = (unsigned int)(width * 3 + row_padding(width)) * height;
+
+    FileHeader->Type = BF_TYPE;
+    FileHeader->Size = 54 + data_size;
+    FileHeader->Reserved1 = 0;
+    FileHeader->Reserved2 = 0;
+    FileHeader->OffBits = 54;
+
+    InfoHeader->Size = 40;
+    InfoHeader->Width = width;
+    InfoHeader->Height = height;
+    InfoHeader->Planes = 1;
+    InfoHeader->BitCount = 24;
+    InfoHeader->Compression = 0;
+    InfoHeader->SizeImage = data_size;
+    InfoHeader->XResolution = 2835; // 72 DPI
+    InfoHeader->YResolution = 2835;
+    InfoHeader->NColours = 0;
+    InfoHeader->ImportantColours = 0;
+}
+
 void writeHeaders(FILE *output, BITMAPFILEHEADER FileHeader, BITMAPINFOHEADER InfoHeader) {
     /*
      * Escreve os cabeçalhos do arquivo BMP no arquivo de saída.
@@ -122,11 +166,16 @@ void writeBMP(FILE *output, BITMAPFILEHEADER FileHeader, BITMAPINFOHEADER InfoHe
     // Escreve os cabeçalhos
     writeHeaders(output, FileHeader, InfoHeader);
 
-    // Escreve os pixels
-    for (int i = 0; i < (InfoHeader.Height * InfoHeader.Width); i++) {
-        fputc(Image[i].B, output);
-        fputc(Image[i].G, output);
-        fputc(Image[i].R, output);
+    // Escreve os pixels, completando cada linha com zeros até um múltiplo de 4 bytes
+    int padding = row_padding(InfoHeader.Width);
+    for (int y = 0; y < InfoHeader.Height; y++) {
+        PIXELRGB *row = Image + (size_t)y * InfoHeader.Width;
+        for (int x = 0; x < InfoHeader.Width; x++) {
+            fputc(row[x].B, output);
+            fputc(row[x].G, output);
+            fputc(row[x].R, output);
+        }
+        for (int i = 0; i < padding; i++) fputc(0, output);
     }
 }
 
@@ -140,7 +189,7 @@ unsigned char clampFloatToByte(float value) {
     return (unsigned char)(value + 0.5f); // arredonda
 }
 
-void convertToYCBCR(PIXELRGB *Image, PIXELYCBCR *ImageYCbCr, int tam) {
+void convertToYCBCR(const PIXELRGB *Image, PIXELYCBCR *ImageYCbCr, int tam) {
     /* 
      * Converte pixels de uma imagem RGB para YCbCr.
      */
@@ -41,9 +41,11 @@
     void readInfoHeader(FILE *F, BITMAPINFOHEADER *INFO_H);
     void readHeader(FILE *F, BITMAPFILEHEADER *H);
     void readPixels(FILE *input, BITMAPINFOHEADER InfoHeader, BITMAPFILEHEADER FileHeader, PIXELRGB *Image);
+    void readPixelRows(FILE *input, int width, int row_count, PIXELRGB *Image);
     void printHeaders (BITMAPFILEHEADER *FileHeader,  BITMAPINFOHEADER *InfoHeader);
+    void createBMPHeaders(int width, int height, BITMAPFILEHEADER *FileHeader, BITMAPINFOHEADER *InfoHeader);
     void writeHeaders(FILE *output, BITMAPFILEHEADER FileHeader, BITMAPINFOHEADER InfoHeader);
     void writeBMP(FILE *output, BITMAPFILEHEADER FileHeader, BITMAPINFOHEADER InfoHeader, PIXELRGB *Image);
-    void convertToYCBCR(PIXELRGB *Image, PIXELYCBCR *ImageYCbCr, int tam);
+    void convertToYCBCR(const PIXELRGB *Image, PIXELYCBCR *ImageYCbCr, int tam);
     void convertToRGB(PIXELYCBCR *ImageYCbCr, PIXELRGB *Image, int tam);
 #endif
\ No newline at end of file
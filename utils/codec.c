@@ -2,12 +2,18 @@
  * da crominância usando 4:2:0, aplicar a DCT sobre esses blocos, fazer a quantização,
  * fazer a codificação por carreira e diferencial. E o inverso. 
  * */
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
+#ifdef __AVX2__
+    #include <immintrin.h>
+#endif
 
 #include "codec.h"
 #include "dct.h"
+#include "huffman.h"
 
 // Clamp usado para fazer o padding se acessar um pixel fora da imagem
 // Se o pixel estiver fora da imagem, retorna o pixel da borda
@@ -111,35 +117,146 @@ void reconstructBlock8x8_CbCr420(PIXELYCBCR *dst, float block[8][8], int start_x
     }
 }
 
-MACROBLOCO* encodeImageYCbCr(PIXELYCBCR *image, int width, int height, int *out_macroblock_count) {
+// Primeira amostra de um canal ('Y', 'B' para Cb ou 'R' para Cr) de um pixel; as amostras seguintes
+// do mesmo canal ficam a cada sizeof(PIXELYCBCR) bytes
+static unsigned char *channel_samples(PIXELYCBCR *pixel, char channel) {
+    if (channel == 'B') return &pixel->Cb;
+    if (channel == 'R') return &pixel->Cr;
+    return &pixel->Y;
+}
+
+static void extract_block_y_interior(PIXELYCBCR *image, float block[8][8], int start_x, int start_y, int width) {
+    // extract_block_y para um bloco inteiro dentro da imagem: cada linha é lida direto, sem padding_clamp
+    for (int y = 0; y < 8; y++) {
+        const PIXELYCBCR *row = image + (size_t)(start_y + y) * width + start_x;
+        for (int x = 0; x < 8; x++) {
+            block[y][x] = (float)row[x].Y - 128.0f;
+        }
+    }
+}
+
+static void extract_block_chroma420_interior(PIXELYCBCR *image, float block[8][8], int start_x, int start_y, int width, char channel) {
+    // extract_block_chroma420 para um macrobloco inteiro dentro da imagem: cada par de linhas é lido
+    // direto, somando as 4 amostras na mesma ordem da versão com padding_clamp
+    const size_t step = sizeof(PIXELYCBCR);
+    for (int y = 0; y < 8; y++) {
+        const unsigned char *top = channel_samples(image + (size_t)(start_y + y * 2) * width + start_x, channel);
+        const unsigned char *bottom = top + (size_t)width * step;
+        for (int x = 0; x < 8; x++) {
+            float sum = 0;
+            sum += top[(x * 2) * step] - 128.0f;
+            sum += top[(x * 2 + 1) * step] - 128.0f;
+            sum += bottom[(x * 2) * step] - 128.0f;
+            sum += bottom[(x * 2 + 1) * step] - 128.0f;
+            block[y][x] = sum / 4.0f;
+        }
+    }
+}
+
+static void samples_from_row(const float row[8], unsigned char samples[8]) {
+    // Desfaz a centralização de uma linha reconstruída e limita a 0..255, o mesmo que
+    // (unsigned char)clamp(valor + 128.5f, 0, 255) em cada posição; com AVX2, a linha inteira de uma vez
+#ifdef __AVX2__
+    __m256 values = _mm256_add_ps(_mm256_loadu_ps(row), _mm256_set1_ps(128.5f));
+    values = _mm256_min_ps(_mm256_max_ps(values, _mm256_setzero_ps()), _mm256_set1_ps(255.0f));
+    __m256i integers = _mm256_cvttps_epi32(values);
+    __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(integers), _mm256_extracti128_si256(integers, 1));
+    _mm_storel_epi64((__m128i *)samples, _mm_packus_epi16(words, words));
+#else
+    for (int x = 0; x < 8; x++) {
+        float value = row[x] + 128.5f;
+        samples[x] = (unsigned char)(value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value));
+    }
+#endif
+}
+
+static void reconstruct_block_y_interior(PIXELYCBCR *dst, float block[8][8], int start_x, int start_y, int width) {
+    // reconstructBlock8x8_Y para um bloco inteiro dentro da imagem: linha por linha, sem padding_clamp
+    for (int y = 0; y < 8; y++) {
+        unsigned char samples[8];
+        samples_from_row(block[y], samples);
+        PIXELYCBCR *row = dst + (size_t)(start_y + y) * width + start_x;
+        for (int x = 0; x < 8; x++) {
+            row[x].Y = samples[x];
+        }
+    }
+}
+
+static void reconstruct_block_chroma420_interior(PIXELYCBCR *dst, float block[8][8], int start_x, int start_y, int width, char channel) {
+    // reconstructBlock8x8_CbCr420 para um macrobloco inteiro dentro da imagem: cada linha do bloco
+    // é convertida uma vez e repetida nos 2 x 2 pixels que cada amostra cobre
+    const size_t step = sizeof(PIXELYCBCR);
+    for (int y = 0; y < 8; y++) {
+        unsigned char samples[8];
+        samples_from_row(block[y], samples);
+        unsigned char *top = channel_samples(dst + (size_t)(start_y + y * 2) * width + start_x, channel);
+        unsigned char *bottom = top + (size_t)width * step;
+        for (int x = 0; x < 16; x++) {
+            top[x * step] = samples[x / 2];
+            bottom[x * step] = samples[x / 2];
+        }
+    }
+}
+
+static int forward_dct_block(float C[8][8], float pixels[8][8], float coefficients[8][8], const float *limits) {
+    // DCT de um bloco extraído. Um bloco constante não passa pela DCT: recebe só o DC e ACs zerados.
+    // Com limits (build_pruning_limits), a amplitude do bloco diz até qual antidiagonal algum coeficiente
+    // pode sobreviver à quantização, e só essas são calculadas. Retorna 1 se o bloco era constante
+    const float *values = &pixels[0][0];
+    float min = values[0], max = values[0];
+    for (int k = 1; k < 64; k++) {
+        if (values[k] < min) min = values[k];
+        else if (values[k] > max) max = values[k];
+    }
+    if (min == max) {
+        memset(coefficients, 0, sizeof(float) * 64);
+        coefficients[0][0] = forwardDCTFlatDC(C, values[0]);
+        return 1;
+    }
+
+    int last_diagonal = DCT_DIAGONALS - 1;
+    if (limits) {
+        while (last_diagonal > 0 && max - min < limits[last_diagonal]) last_diagonal--;
+    }
+    if (last_diagonal == DCT_DIAGONALS - 1) {
+        forwardDCTWithMatrix(C, pixels, coefficients);
+    } else {
+        forwardDCTWithMatrixPruned(C, pixels, coefficients, last_diagonal);
+    }
+    return 0;
+}
+
+void encodeMacroblockRows(PIXELYCBCR *image, int width, int height, int mb_row_start, int mb_row_end, MACROBLOCO *macroblocks, CODEC_TABLES *tables, int prune) {
     /*
-     * Dado uma imagem YCbCr linearizada, aplica DCT em blocos de 16x16 pixels.
-     * Cada macrobloco contém 4 blocos de Y (8x8) e 1 bloco de Cb e Cr (8x8 cada).
-     * O que caracteriza uma subamostragem 4:2:0.
-     * 
+     * Aplica a DCT nos macroblocos de um intervalo de linhas de macroblocos [mb_row_start, mb_row_end).
+     * Só lê as linhas de pixels cobertas pelo intervalo (mais a borda replicada no fim da imagem),
+     * então intervalos diferentes podem ser processados ao mesmo tempo. Blocos constantes pulam a DCT
+     * e ficam marcados em planos, para que a quantização e a vetorização também os pulem.
+     *
      * Parâmetros:
      * image: imagem YCbCr linearizada em um vetor
      * width, height: largura e altura da imagem
-     * out_macroblock_count: ponteiro para armazenar o número de macroblocos
+     * mb_row_start, mb_row_end: intervalo de linhas de macroblocos a processar
+     * macroblocks: vetor de saída, indexado a partir do primeiro macrobloco do intervalo
+     * tables: tabelas pré-calculadas (init_codec_tables)
+     * prune: 1 para só calcular os coeficientes que podem sobreviver à quantização de tables (os outros
+     *        ficam zerados); só serve quando os coeficientes vão direto para a quantização por
+     *        arredondamento dessas tabelas, sem --adaptive nem RDO, que olham os coeficientes AC
      */
-    int mb_cols = (width + 15) / 16;
-    int mb_rows = (height + 15) / 16;
-    int num_blocks = mb_cols * mb_rows;
-
-    *out_macroblock_count = num_blocks;
-
-    // Aloca vetor de macroblocos
-    MACROBLOCO *macroblocks = (MACROBLOCO *) calloc(num_blocks, sizeof(MACROBLOCO));
-    if (!macroblocks) {
-        return NULL;
+    float (*C)[8] = tables->dct_matrix;
+    const float *limits_y = NULL, *limits_chroma = NULL;
+    if (prune) {
+        limits_y = tables->pruning_limits_y;
+        limits_chroma = tables->pruning_limits_chroma;
     }
-
     int mb_index = 0;
 
     // Para cada macrobloco 16x16, extrai os blocos 8x8 e aplica DCT
-    for (int by = 0; by < height; by += 16) {
+    for (int by = mb_row_start * 16; by < height && by < mb_row_end * 16; by += 16) {
         for (int bx = 0; bx < width; bx += 16) {
             MACROBLOCO *mb = &macroblocks[mb_index++];
+            int planos = 0;
+            int interior = bx + 16 <= width && by + 16 <= height; // Só os macroblocos da borda precisam de padding_clamp
 
             // Extrai e aplica DCT para os 4 blocos Y
             for (int i = 0; i < 4; i++) {
@@ -147,25 +264,32 @@ MACROBLOCO* encodeImageYCbCr(PIXELYCBCR *image, int width, int height, int *out_
                 int oy = by + (i / 2) * 8;
 
                 float y_temp[8][8];
-                extract_block_y(image, y_temp, ox, oy, width, height);
-                forwardDCTMatrix(y_temp, mb->Y[i].block);
+                if (interior) {
+                    extract_block_y_interior(image, y_temp, ox, oy, width);
+                } else {
+                    extract_block_y(image, y_temp, ox, oy, width, height);
+                }
+                planos = (planos << 1) | forward_dct_block(C, y_temp, mb->Y[i].block, limits_y);
             }
 
             // Extrai e aplica DCT para os blocos Cb e Cr
             float cb_temp[8][8], cr_temp[8][8];
-            extract_block_chroma420(image, cb_temp, bx, by, width, height, 'B');
-            extract_block_chroma420(image, cr_temp, bx, by, width, height, 'R');
+            if (interior) {
+                extract_block_chroma420_interior(image, cb_temp, bx, by, width, 'B');
+                extract_block_chroma420_interior(image, cr_temp, bx, by, width, 'R');
+            } else {
+                extract_block_chroma420(image, cb_temp, bx, by, width, height, 'B');
+                extract_block_chroma420(image, cr_temp, bx, by, width, height, 'R');
+            }
             
-            forwardDCTMatrix(cb_temp, mb->Cb.block);
-            forwardDCTMatrix(cr_temp, mb->Cr.block);
+            planos = (planos << 1) | forward_dct_block(C, cb_temp, mb->Cb.block, limits_chroma);
+            mb->planos = (planos << 1) | forward_dct_block(C, cr_temp, mb->Cr.block, limits_chroma);
         }
     }
-
-    return macroblocks;
 }
 
 // Tabela de quantização base para Y
-int base_quantization_matrix_y[8][8] = {
+static const int base_quantization_matrix_y[8][8] = {
     {16, 11, 10, 16, 24, 40, 51, 61},
     {12, 12, 14, 19, 26, 58, 60, 55},
     {14, 13, 16, 24, 40, 57, 69, 56},
@@ -177,7 +301,7 @@ int base_quantization_matrix_y[8][8] = {
 };
 
 // Tabela de quantização base para Cb e Cr
-int base_quantization_matrix_chroma[8][8] = {
+static const int base_quantization_matrix_chroma[8][8] = {
     {17, 18, 24, 47, 99, 99, 99, 99},
     {18, 21, 26, 66, 99, 99, 99, 99},
     {24, 26, 56, 99, 99, 99, 99, 99},
@@ -188,194 +312,797 @@ int base_quantization_matrix_chroma[8][8] = {
     {99 ,99 ,99 ,99 ,99 ,99 ,99 ,98}
 };
 
-void quantizeBlock(float block[8][8], int quantization_matrix[8][8]) {
+static void build_reciprocals(int quantization_matrix[8][8], QUANT_RECIPROCALS *reciprocals) {
+    // Passos em float e inversos em double de uma matriz de quantização
+    for (int k = 0; k < 64; k++) {
+        int step = quantization_matrix[k / 8][k % 8];
+        reciprocals->steps[k] = (float)step;
+        reciprocals->reciprocals[k] = 1.0 / step;
+    }
+}
+
+#ifdef __AVX2__
+static __m256 round_half_away_avx2(__m256 values) {
+    /*
+     * Arredonda 8 floats para o inteiro mais próximo, com empates longe do zero (como round e roundf):
+     * trunca e soma ou subtrai 1 onde a parte fracionária descartada (exata) chega a 0.5.
+     * Os ajustes usam blend para preservar o sinal de -0.0.
+     */
+    __m256 truncated = _mm256_round_ps(values, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m256 fraction = _mm256_sub_ps(values, truncated);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 up = _mm256_cmp_ps(fraction, _mm256_set1_ps(0.5f), _CMP_GE_OQ);
+    __m256 down = _mm256_cmp_ps(fraction, _mm256_set1_ps(-0.5f), _CMP_LE_OQ);
+    truncated = _mm256_blendv_ps(truncated, _mm256_add_ps(truncated, one), up);
+    return _mm256_blendv_ps(truncated, _mm256_sub_ps(truncated, one), down);
+}
+#endif
+
+static void quantizeBlock(float block[8][8], const QUANT_RECIPROCALS *reciprocals, int flat) {
     /*
-     * Aplica a quantização em um bloco 8x8 usando uma matriz de quantização.
+     * Aplica a quantização em um bloco 8x8, multiplicando cada coeficiente pelo inverso do passo.
+     * O produto é feito em double e convertido para float: como o inverso em double tem erro muito
+     * menor que a distância entre um quociente x / passo e o ponto de arredondamento de float mais
+     * próximo, o float obtido é exatamente o da divisão x / passo, e o resultado é idêntico ao de
+     * round(x / passo). Com AVX2, o bloco é processado 8 coeficientes por vez.
      *
      * Parâmetros:
      * block: bloco 8x8 a ser quantizado
-     * quantization_matrix: matriz de quantização
-     * compression_factor: fator de compressão
+     * reciprocals: passos e inversos da matriz de quantização
+     * flat: 1 se o bloco é constante (ACs nulos), e só o DC precisa ser quantizado
      */
-    for (int y = 0; y < 8; y++) {
-        for (int x = 0; x < 8; x++) {
-            // Aplica a quantização
-            block[y][x] = round(block[y][x] / quantization_matrix[y][x]);
-        }
+    float *values = &block[0][0];
+    if (flat) {
+        float quotient = (float)(values[0] * reciprocals->reciprocals[0]);
+        values[0] = copysignf((float)(int)(fabsf(quotient) + 0.5), quotient);
+        return;
+    }
+#ifdef __AVX2__
+    for (int k = 0; k < 64; k += 8) {
+        __m256 coefficients = _mm256_loadu_ps(values + k);
+        __m256d low = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(coefficients)), _mm256_loadu_pd(reciprocals->reciprocals + k));
+        __m256d high = _mm256_mul_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(coefficients, 1)), _mm256_loadu_pd(reciprocals->reciprocals + k + 4));
+        __m256 quotients = _mm256_set_m128(_mm256_cvtpd_ps(high), _mm256_cvtpd_ps(low));
+        _mm256_storeu_ps(values + k, round_half_away_avx2(quotients));
     }
+#else
+    for (int k = 0; k < 64; k++) {
+        // Empates longe do zero, como round: somar 0.5 ao módulo em double é exato e a conversão
+        // para int trunca; copysignf devolve o sinal (inclusive o de -0.0)
+        float quotient = (float)(values[k] * reciprocals->reciprocals[k]);
+        values[k] = copysignf((float)(int)(fabsf(quotient) + 0.5), quotient);
+    }
+#endif
 }
 
-void dequantizeBlock(float block[8][8], int quantization_matrix[8][8]) {
+static void dequantizeBlock(float block[8][8], const QUANT_RECIPROCALS *reciprocals) {
     /*
-     * Aplica a dequantização em um bloco 8x8 usando uma matriz de quantização.
+     * Aplica a dequantização em um bloco 8x8 (coeficiente vezes passo, arredondado como roundf).
      *
      * Parâmetros:
      * block: bloco 8x8 a ser dequantizado
-     * quantization_matrix: matriz de quantização
-     * compression_factor: fator de compressão
+     * reciprocals: passos da matriz de quantização
      */
-    for (int y = 0; y < 8; y++) {
-        for (int x = 0; x < 8; x++) {
-            // Aplica a dequantização com arredondamento para melhor precisão
-            block[y][x] = roundf(block[y][x] * quantization_matrix[y][x]);
-        }
+    float *values = &block[0][0];
+#ifdef __AVX2__
+    for (int k = 0; k < 64; k += 8) {
+        __m256 products = _mm256_mul_ps(_mm256_loadu_ps(values + k), _mm256_loadu_ps(reciprocals->steps + k));
+        _mm256_storeu_ps(values + k, round_half_away_avx2(products));
     }
+#else
+    for (int k = 0; k < 64; k++) {
+        float product = values[k] * reciprocals->steps[k];
+        values[k] = copysignf((float)(int)(fabsf(product) + 0.5), product);
+    }
+#endif
 }
 
-void quantizeMacroblock(MACROBLOCO *mb, int quantization_matrix_y[8][8], int quantization_matrix_chroma[8][8]) {
+static void quantizeMacroblock(MACROBLOCO *mb, const QUANT_RECIPROCALS *reciprocals_y, const QUANT_RECIPROCALS *reciprocals_chroma) {
     /*
      * Aplica a quantização em um macrobloco 16x16.
      *
      * Parâmetros:
      * mb: macrobloco a ser quantizado
-     * quantization_matrix: matriz de quantização
-     * compression_factor: fator de compressão
+     * reciprocals_y, reciprocals_chroma: passos e inversos das matrizes de luminância e crominância
      */
     for (int i = 0; i < 4; i++) {
-        quantizeBlock(mb->Y[i].block, quantization_matrix_y);
+        quantizeBlock(mb->Y[i].block, reciprocals_y, mb->planos & (0x20 >> i));
     }
-    quantizeBlock(mb->Cb.block, quantization_matrix_chroma);
-    quantizeBlock(mb->Cr.block, quantization_matrix_chroma);
+    quantizeBlock(mb->Cb.block, reciprocals_chroma, mb->planos & 0x2);
+    quantizeBlock(mb->Cr.block, reciprocals_chroma, mb->planos & 0x1);
 }
 
-void dequantizeMacroblock(MACROBLOCO *mb, int quantization_matrix_y[8][8], int quantization_matrix_chroma[8][8]) {
+static void dequantizeMacroblock(MACROBLOCO *mb, const QUANT_RECIPROCALS *reciprocals_y, const QUANT_RECIPROCALS *reciprocals_chroma) {
     /*
      * Aplica a dequantização em um macrobloco 16x16.
      *
      * Parâmetros:
      * mb: macrobloco a ser dequantizado
-     * quantization_matrix: matriz de quantização
-     * compression_factor: fator de compressão
+     * reciprocals_y, reciprocals_chroma: passos das matrizes de luminância e crominância
      */
     for (int i = 0; i < 4; i++) {
-        dequantizeBlock(mb->Y[i].block, quantization_matrix_y);
+        dequantizeBlock(mb->Y[i].block, reciprocals_y);
+    }
+    dequantizeBlock(mb->Cb.block, reciprocals_chroma);
+    dequantizeBlock(mb->Cr.block, reciprocals_chroma);
+}
+
+static void build_scaled_matrices(const int base_y[8][8], const int base_chroma[8][8], int quality, int quantization_matrix_y[8][8], int quantization_matrix_chroma[8][8]) {
+    // Preenche as matrizes de quantização com os valores base multiplicados pelo fator de compressão
+    int scale_factor = quality < 50 ? (int)round(5000.0 / quality) : 200 - quality*2;
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+            quantization_matrix_y[i][j] = (base_y[i][j] * scale_factor + 50) / 100;
+            if (quantization_matrix_y[i][j] <= 0) quantization_matrix_y[i][j] = 1; // Garante que não seja zero
+            quantization_matrix_chroma[i][j] = (base_chroma[i][j] * scale_factor + 50) / 100;
+            if (quantization_matrix_chroma[i][j] <= 0) quantization_matrix_chroma[i][j] = 1; // Garante que não seja zero
+        }
     }
-    dequantizeBlock(mb->Cb.block, quantization_matrix_chroma);
-    dequantizeBlock(mb->Cr.block, quantization_matrix_chroma);
 }
 
-void quantizeMacroblocks(MACROBLOCO *mb_array, int macroblock_count, int quality) {
+// Escala (em %) das matrizes de quantização em cada nível da quantização adaptativa: áreas lisas,
+// onde o efeito de blocos aparece, ficam com passos menores, e texturas, que escondem o erro, com passos maiores
+static const int adaptive_scales[ADAPTIVE_LEVELS] = {70, 100, 150, 200};
+
+// Variância média dos blocos Y a partir da qual cada nível acima do primeiro é escolhido
+static const float adaptive_thresholds[ADAPTIVE_LEVELS - 1] = {30.0f, 400.0f, 1500.0f};
+
+// Folga, em unidades dos coeficientes da DCT, para os erros de arredondamento do float nos limites da DCT podada
+#define PRUNING_MARGIN 0.01
+
+static void build_pruning_limits(float C[8][8], int quantization_matrix[8][8], float limits[DCT_DIAGONALS]) {
     /*
-     * Aplica a quantização em um vetor de macroblocos.
+     * Calcula, para cada antidiagonal d da DCT, a menor amplitude (máximo - mínimo) de um bloco a partir
+     * da qual algum coeficiente (u, v) com u + v >= d pode não ser zerado pela quantização.
+     * Fora a linha do DC, cada linha de C soma zero, então subtrair o meio da amplitude dos pixels não
+     * muda os ACs e |F(u, v)| <= amplitude / 2 * S(u) * S(v), com S(u) a soma dos módulos da linha u de C.
+     * Se esse limite, mais PRUNING_MARGIN, fica abaixo de meio passo, o coeficiente sempre vira zero.
+     * Na amplitude máxima dos pixels (255), os limites dão as posições que nenhum bloco pode ter na qualidade.
+     *
+     * Parâmetros:
+     * C: matriz de transformação 8x8
+     * quantization_matrix: matriz de quantização
+     * limits: limites de cada antidiagonal (o da antidiagonal 0, só com o DC, é zero)
+     */
+    double sums[8];
+    for (int u = 0; u < 8; u++) {
+        sums[u] = 0.0;
+        for (int k = 0; k < 8; k++) sums[u] += fabs(C[u][k]);
+    }
+
+    double limit = HUGE_VAL;
+    for (int d = DCT_DIAGONALS - 1; d > 0; d--) {
+        for (int u = 0; u < 8; u++) {
+            int v = d - u;
+            if (v < 0 || v > 7) continue;
+            double position = (0.5 * quantization_matrix[u][v] - PRUNING_MARGIN) / (0.5 * sums[u] * sums[v]);
+            if (position < limit) limit = position;
+        }
+        limits[d] = (float)limit;
+    }
+    limits[0] = 0.0f;
+}
+
+static void build_derived_matrices(CODEC_TABLES *tables) {
+    /*
+     * Recalcula o que depende das matrizes da qualidade atual: as matrizes de cada nível da
+     * quantização adaptativa, os passos e inversos de todas elas e os limites da DCT podada.
+     */
+    build_pruning_limits(tables->dct_matrix, tables->quantization_matrix_y, tables->pruning_limits_y);
+    build_pruning_limits(tables->dct_matrix, tables->quantization_matrix_chroma, tables->pruning_limits_chroma);
+    build_reciprocals(tables->quantization_matrix_y, &tables->reciprocals_y);
+    build_reciprocals(tables->quantization_matrix_chroma, &tables->reciprocals_chroma);
+    for (int level = 0; level < ADAPTIVE_LEVELS; level++) {
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 8; j++) {
+                int y = (tables->quantization_matrix_y[i][j] * adaptive_scales[level] + 50) / 100;
+                int chroma = (tables->quantization_matrix_chroma[i][j] * adaptive_scales[level] + 50) / 100;
+                tables->adaptive_matrix_y[level][i][j] = y > 0 ? y : 1;
+                tables->adaptive_matrix_chroma[level][i][j] = chroma > 0 ? chroma : 1;
+            }
+        }
+        build_reciprocals(tables->adaptive_matrix_y[level], &tables->adaptive_reciprocals_y[level]);
+        build_reciprocals(tables->adaptive_matrix_chroma[level], &tables->adaptive_reciprocals_chroma[level]);
+    }
+}
+
+void init_codec_tables(CODEC_TABLES *tables, int quality) {
+    /*
+     * Calcula uma vez a matriz da DCT e as matrizes de quantização de uma qualidade,
+     * para que os macroblocos e as imagens seguintes não precisem recalculá-las.
+     *
+     * Parâmetros:
+     * tables: tabelas a serem preenchidas
+     * quality: qualidade da compressão (1 a 100)
+     */
+    precomputeTransformation(tables->dct_matrix);
+    precomputeReducedTransformation(tables->reduced_matrix_4, 4);
+    precomputeReducedTransformation(tables->reduced_matrix_2, 2);
+    memcpy(tables->base.y, base_quantization_matrix_y, sizeof(tables->base.y));
+    memcpy(tables->base.chroma, base_quantization_matrix_chroma, sizeof(tables->base.chroma));
+    tables->quality = 0;
+    set_codec_tables_quality(tables, quality);
+}
+
+void set_codec_tables_quality(CODEC_TABLES *tables, int quality) {
+    /*
+     * Troca a qualidade das matrizes de quantização, recalculando-as só se ela mudou.
+     *
+     * Parâmetros:
+     * tables: tabelas já inicializadas com init_codec_tables
+     * quality: qualidade da compressão (1 a 100)
+     */
+    if (tables->quality == quality) return;
+    build_scaled_matrices(tables->base.y, tables->base.chroma, quality, tables->quantization_matrix_y, tables->quantization_matrix_chroma);
+    build_derived_matrices(tables);
+    tables->quality = quality;
+}
+
+void set_codec_tables_base(CODEC_TABLES *tables, const QUANT_MATRICES *matrices) {
+    /*
+     * Troca as matrizes base que set_codec_tables_quality escala pela qualidade. As matrizes
+     * de quantização só são recalculadas na próxima troca de qualidade, e só se a base mudou.
+     *
+     * Parâmetros:
+     * tables: tabelas já inicializadas com init_codec_tables
+     * matrices: matrizes base personalizadas, ou NULL para as do Anexo K
+     */
+    QUANT_MATRICES base;
+    if (matrices) {
+        base = *matrices;
+    } else {
+        memcpy(base.y, base_quantization_matrix_y, sizeof(base.y));
+        memcpy(base.chroma, base_quantization_matrix_chroma, sizeof(base.chroma));
+    }
+    if (memcmp(&base, &tables->base, sizeof(base)) == 0) return;
+    tables->base = base;
+    tables->quality = 0;
+}
+
+void set_codec_tables_matrices(CODEC_TABLES *tables, const QUANT_MATRICES *matrices) {
+    /*
+     * Usa direto as matrizes de quantização efetivas lidas de um arquivo (FORMAT_FLAG_MATRICES),
+     * sem escalar pela qualidade. A próxima chamada de set_codec_tables_quality volta a calculá-las.
+     *
+     * Parâmetros:
+     * tables: tabelas já inicializadas com init_codec_tables
+     * matrices: matrizes efetivas de luminância e crominância
+     */
+    memcpy(tables->quantization_matrix_y, matrices->y, sizeof(matrices->y));
+    memcpy(tables->quantization_matrix_chroma, matrices->chroma, sizeof(matrices->chroma));
+    build_derived_matrices(tables);
+    tables->quality = 0;
+}
+
+void get_codec_tables_matrices(const CODEC_TABLES *tables, QUANT_MATRICES *matrices) {
+    /*
+     * Copia as matrizes de quantização efetivas (já escaladas) para serem gravadas no arquivo.
+     *
+     * Parâmetros:
+     * tables: tabelas com a qualidade desejada
+     * matrices: destino das matrizes de luminância e crominância
+     */
+    memcpy(matrices->y, tables->quantization_matrix_y, sizeof(matrices->y));
+    memcpy(matrices->chroma, tables->quantization_matrix_chroma, sizeof(matrices->chroma));
+}
+
+int load_quant_matrices(const char *filename, QUANT_MATRICES *matrices) {
+    /*
+     * Lê matrizes base de um arquivo texto: 64 valores de luminância seguidos de 64 de crominância,
+     * linha por linha (não em zigue-zague), separados por espaços, quebras de linha ou vírgulas.
+     * Linhas começando com '#' são comentários. Retorna 1 em caso de sucesso, 0 em caso de erro.
+     *
+     * Parâmetros:
+     * filename: arquivo com as matrizes
+     * matrices: matrizes a serem preenchidas
+     */
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        printf("Erro ao abrir o arquivo de matrizes %s.\n", filename);
+        return 0;
+    }
+
+    int count = 0;
+    int c;
+    while (count < 128 && (c = fgetc(file)) != EOF) {
+        if (c == '#') {
+            while (c != '\n' && c != EOF) c = fgetc(file);
+            continue;
+        }
+        if (c == ',' || c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+
+        ungetc(c, file);
+        int value;
+        if (fscanf(file, "%d", &value) != 1 || value < 1 || value > QUANT_MATRIX_MAX_VALUE) break;
+        int *matrix = count < 64 ? &matrices->y[0][0] : &matrices->chroma[0][0];
+        matrix[count % 64] = value;
+        count++;
+    }
+    fclose(file);
+
+    if (count != 128) {
+        printf("Erro: %s deve ter 128 valores de 1 a %d (64 de luminância e 64 de crominância).\n", filename, QUANT_MATRIX_MAX_VALUE);
+        return 0;
+    }
+    return 1;
+}
+
+void quantizeMacroblocksWithTables(MACROBLOCO *mb_array, int macroblock_count, CODEC_TABLES *tables) {
+    /*
+     * Quantiza um vetor de macroblocos com as matrizes já calculadas em tables.
      *
      * Parâmetros:
      * mb_array: vetor de macroblocos
      * macroblock_count: número de macroblocos
-     * compression_factor: fator de compressão
+     * tables: tabelas com a qualidade desejada (set_codec_tables_quality)
      */
-    int quantization_matrix_y[8][8], quantization_matrix_chroma[8][8];
-    int scale_factor = quality < 50 ? (int)round(5000.0 / quality) : 200 - quality*2;
+    for (int i = 0; i < macroblock_count; i++) {
+        quantizeMacroblock(&mb_array[i], &tables->reciprocals_y, &tables->reciprocals_chroma);
+    }
+}
 
-    // Preenche as matrizes de quantização com os valores base multiplicados pelo fator de compressão
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            quantization_matrix_y[i][j] = (base_quantization_matrix_y[i][j] * scale_factor + 50) / 100;
-            if (quantization_matrix_y[i][j] <= 0) quantization_matrix_y[i][j] = 1; // Garante que não seja zero
-            quantization_matrix_chroma[i][j] = (base_quantization_matrix_chroma[i][j] * scale_factor + 50) / 100;
-            if (quantization_matrix_chroma[i][j] <= 0) quantization_matrix_chroma[i][j] = 1; // Garante que não seja zero
+// Ordem zigue-zague das posições (linha * 8 + coluna), usada na vetorização e na quantização taxa-distorção
+static const int zigzag_order[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static int ac_symbol_bits(int run, int value) {
+    // Bits que write_ac_coefficient gasta com o coeficiente value depois de run zeros (ZRLs incluídos)
+    int bits = (run / 16) * JPEG_AC_LUMINANCE_MATRIX[15][0].code_length;
+    int magnitude = abs(value) > 1023 ? 1023 : abs(value);
+    int category = get_coefficient_category(magnitude);
+    return bits + JPEG_AC_LUMINANCE_MATRIX[run % 16][category].code_length + category;
+}
+
+static void quantizeBlockRDO(float block[8][8], int quantization_matrix[8][8], float lambda_scale, int flat) {
+    /*
+     * Quantização com otimização taxa-distorção (trellis) de um bloco 8x8. Cada coeficiente AC
+     * pode ficar com o valor arredondado, com a magnitude reduzida em 1 ou zerado; a escolha
+     * minimiza distorção + lambda * bits para o bloco inteiro, com os bits reais dos símbolos
+     * (zeros, categoria) da tabela AC e a distorção medida nos coeficientes da DCT (ortonormal,
+     * então igual à dos pixels). O DC é só arredondado, pois o seu custo depende do bloco anterior.
+     *
+     * Parâmetros:
+     * block: bloco 8x8 com os coeficientes da DCT, substituídos pelos valores quantizados
+     * quantization_matrix: matriz de quantização
+     * lambda_scale: peso dos bits, multiplicado pelo quadrado do passo médio de quantização
+     * flat: 1 se o bloco é constante (ACs nulos), e só o DC precisa ser arredondado
+     */
+    if (flat) {
+        block[0][0] = (float)(int)round(block[0][0] / quantization_matrix[0][0]);
+        return;
+    }
+
+    float coefficients[64];
+    int steps[64];
+    float zero_cost[64];        // Distorção acumulada de zerar as posições 1..k (zigue-zague)
+    float best_cost[64];        // Menor custo com o último coeficiente não nulo na posição k
+    int best_value[64];
+    int previous[64];           // Posição do não nulo anterior no melhor caminho
+
+    float mean_step = 0.0f;
+    for (int k = 0; k < 64; k++) {
+        int position = zigzag_order[k];
+        coefficients[k] = block[position / 8][position % 8];
+        steps[k] = quantization_matrix[position / 8][position % 8];
+        if (k > 0) mean_step += steps[k];
+    }
+    mean_step /= 63.0f;
+    float lambda = lambda_scale * mean_step * mean_step;
+
+    zero_cost[0] = 0.0f;
+    for (int k = 1; k < 64; k++) {
+        zero_cost[k] = zero_cost[k - 1] + coefficients[k] * coefficients[k];
+    }
+
+    best_cost[0] = 0.0f;
+    for (int k = 1; k < 64; k++) {
+        best_cost[k] = -1.0f; // Sem candidato não nulo
+        int rounded = (int)round(coefficients[k] / steps[k]);
+        if (rounded == 0) continue;
+
+        // Candidatos: valor arredondado e magnitude reduzida em 1 (se não zerar)
+        int candidates[2] = {rounded, rounded > 0 ? rounded - 1 : rounded + 1};
+        int candidate_count = candidates[1] != 0 ? 2 : 1;
+        for (int c = 0; c < candidate_count; c++) {
+            int value = candidates[c];
+            float error = coefficients[k] - (float)value * steps[k];
+            float distortion = error * error;
+            for (int j = 0; j < k; j++) {
+                if (best_cost[j] < 0.0f) continue;
+                // Zeros entre j e k contam como distorção, e os bits do símbolo dependem da carreira
+                float cost = best_cost[j] + (zero_cost[k - 1] - zero_cost[j]) + distortion + lambda * ac_symbol_bits(k - j - 1, value);
+                if (best_cost[k] < 0.0f || cost < best_cost[k]) {
+                    best_cost[k] = cost;
+                    best_value[k] = value;
+                    previous[k] = j;
+                }
+            }
         }
     }
 
+    // Escolhe onde o bloco termina (o EOB é sempre gravado, então não muda a escolha)
+    int last = 0;
+    float total = zero_cost[63];
+    for (int k = 1; k < 64; k++) {
+        if (best_cost[k] < 0.0f) continue;
+        float cost = best_cost[k] + (zero_cost[63] - zero_cost[k]);
+        if (cost < total) {
+            total = cost;
+            last = k;
+        }
+    }
+
+    int values[64] = {0};
+    values[0] = (int)round(coefficients[0] / steps[0]);
+    for (int k = last; k > 0; k = previous[k]) {
+        values[k] = best_value[k];
+    }
+    for (int k = 0; k < 64; k++) {
+        int position = zigzag_order[k];
+        block[position / 8][position % 8] = (float)values[k];
+    }
+}
+
+void quantizeMacroblocksRDO(MACROBLOCO *mb_array, int macroblock_count, CODEC_TABLES *tables, float lambda_scale) {
+    /*
+     * Quantização com otimização taxa-distorção (quantizeBlockRDO) de um vetor de macroblocos.
+     * Gera arquivos menores que quantizeMacroblocksWithTables para a mesma qualidade visual,
+     * ao custo de mais processamento. O decodificador não muda.
+     *
+     * Parâmetros:
+     * mb_array: vetor de macroblocos
+     * macroblock_count: número de macroblocos
+     * tables: tabelas com a qualidade desejada (set_codec_tables_quality)
+     * lambda_scale: peso dos bits em relação à distorção (RDO_LAMBDA_SCALE)
+     */
     for (int i = 0; i < macroblock_count; i++) {
-        quantizeMacroblock(&mb_array[i], quantization_matrix_y, quantization_matrix_chroma);
+        for (int b = 0; b < 4; b++) {
+            quantizeBlockRDO(mb_array[i].Y[b].block, tables->quantization_matrix_y, lambda_scale, mb_array[i].planos & (0x20 >> b));
+        }
+        quantizeBlockRDO(mb_array[i].Cb.block, tables->quantization_matrix_chroma, lambda_scale, mb_array[i].planos & 0x2);
+        quantizeBlockRDO(mb_array[i].Cr.block, tables->quantization_matrix_chroma, lambda_scale, mb_array[i].planos & 0x1);
     }
 }
-void dequantizeMacroblocks(MACROBLOCO *mb_array, int macroblock_count, int quality) {
+
+void dequantizeMacroblocksWithTables(MACROBLOCO *mb_array, int macroblock_count, CODEC_TABLES *tables) {
     /*
-     * Aplica a dequantização em um vetor de macroblocos.
+     * Dequantiza um vetor de macroblocos com as matrizes já calculadas em tables.
      *
      * Parâmetros:
      * mb_array: vetor de macroblocos
      * macroblock_count: número de macroblocos
-     * compression_factor: fator de compressão
+     * tables: tabelas com a qualidade do arquivo (set_codec_tables_quality)
      */
-    int quantization_matrix_y[8][8], quantization_matrix_chroma[8][8];
-    int scale_factor = quality < 50 ? (int)round(5000.0 / quality) : 200 - quality*2;
+    for (int i = 0; i < macroblock_count; i++) {
+        dequantizeMacroblock(&mb_array[i], &tables->reciprocals_y, &tables->reciprocals_chroma);
+    }
+}
 
-    // Preenche as matrizes de quantização com os valores base multiplicados pelo fator de compressão
-    for (int i = 0; i < 8; i++) {
-        for (int j = 0; j < 8; j++) {
-            quantization_matrix_y[i][j] = (base_quantization_matrix_y[i][j] * scale_factor + 50) / 100;
-            if (quantization_matrix_y[i][j] <= 0) quantization_matrix_y[i][j] = 1; // Garante que não seja zero
-            quantization_matrix_chroma[i][j] = (base_quantization_matrix_chroma[i][j] * scale_factor + 50) / 100;
-            if (quantization_matrix_chroma[i][j] <= 0) quantization_matrix_chroma[i][j] = 1; // Garante que não seja zero
+int macroblock_activity_level(const MACROBLOCO *mb) {
+    /*
+     * Escolhe o nível da quantização adaptativa de um macrobloco pela variância média dos seus
+     * blocos Y. Como a DCT é ortonormal, a soma dos quadrados dos coeficientes AC de um bloco
+     * é 64 vezes a variância dos seus pixels, então a atividade sai direto dos coeficientes.
+     *
+     * Parâmetros:
+     * mb: macrobloco com os coeficientes da DCT (antes da quantização)
+     */
+    float energy = 0.0f;
+    for (int b = 0; b < 4; b++) {
+        if (mb->planos & (0x20 >> b)) continue; // Bloco constante: sem energia AC
+        for (int k = 1; k < 64; k++) {
+            float coefficient = mb->Y[b].block[k / 8][k % 8];
+            energy += coefficient * coefficient;
         }
     }
+    float variance = energy / (4.0f * 64.0f);
+
+    int level = 0;
+    while (level < ADAPTIVE_LEVELS - 1 && variance >= adaptive_thresholds[level]) level++;
+    return level;
+}
 
+void quantizeMacroblocksAdaptive(MACROBLOCO *mb_array, MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int macroblock_count, CODEC_TABLES *tables, float lambda_scale) {
+    /*
+     * Quantização adaptativa de um vetor de macroblocos: cada um é quantizado com as matrizes do
+     * nível escolhido por macroblock_activity_level, que fica guardado em rle_macroblocks[i].nivel
+     * para ser gravado no arquivo (o RLE feito depois não altera esse campo).
+     *
+     * Parâmetros:
+     * mb_array: vetor de macroblocos
+     * rle_macroblocks: macroblocos RLE correspondentes, que recebem o nível
+     * macroblock_count: número de macroblocos
+     * tables: tabelas com a qualidade desejada (set_codec_tables_quality)
+     * lambda_scale: 0 para arredondar os coeficientes, ou o peso da quantização taxa-distorção (RDO_LAMBDA_SCALE)
+     */
     for (int i = 0; i < macroblock_count; i++) {
-        dequantizeMacroblock(&mb_array[i], quantization_matrix_y, quantization_matrix_chroma);
+        MACROBLOCO *mb = &mb_array[i];
+        int level = macroblock_activity_level(mb);
+        rle_macroblocks[i].nivel = level;
+
+        if (lambda_scale > 0.0f) {
+            for (int b = 0; b < 4; b++) {
+                quantizeBlockRDO(mb->Y[b].block, tables->adaptive_matrix_y[level], lambda_scale, mb->planos & (0x20 >> b));
+            }
+            quantizeBlockRDO(mb->Cb.block, tables->adaptive_matrix_chroma[level], lambda_scale, mb->planos & 0x2);
+            quantizeBlockRDO(mb->Cr.block, tables->adaptive_matrix_chroma[level], lambda_scale, mb->planos & 0x1);
+        } else {
+            quantizeMacroblock(mb, &tables->adaptive_reciprocals_y[level], &tables->adaptive_reciprocals_chroma[level]);
+        }
     }
 }
 
-void decodeImageYCbCr(MACROBLOCO *mb_array, PIXELYCBCR *dst, int width, int height) {
+void dequantizeMacroblocksAdaptive(MACROBLOCO *mb_array, const MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int macroblock_count, CODEC_TABLES *tables) {
     /*
-     * Dado um vetor de macroblocos, reconstrói a imagem YCbCr linearizada.
+     * Dequantização de macroblocos gravados com a quantização adaptativa, cada um com as matrizes
+     * do nível lido do arquivo.
      *
      * Parâmetros:
      * mb_array: vetor de macroblocos
+     * rle_macroblocks: macroblocos RLE correspondentes, com o nível de cada um
+     * macroblock_count: número de macroblocos
+     * tables: tabelas com a qualidade do arquivo (set_codec_tables_quality)
+     */
+    for (int i = 0; i < macroblock_count; i++) {
+        int level = rle_macroblocks[i].nivel;
+        if (level < 0 || level >= ADAPTIVE_LEVELS) level = ADAPTIVE_NEUTRAL_LEVEL;
+        dequantizeMacroblock(&mb_array[i], &tables->adaptive_reciprocals_y[level], &tables->adaptive_reciprocals_chroma[level]);
+    }
+}
+
+static void inverse_dct_block(float C[8][8], float coefficients[8][8], const BLOCO_RLE_DIFERENCIAL *rle, float block[8][8]) {
+    // IDCT de um bloco; sem coeficientes AC (rle->mascara == 0) o bloco é constante e vale (C[0][0] * DC) * C[0][0],
+    // o mesmo valor que inverseDCTWithMatrix calcularia, já que a primeira linha de C é constante
+    if (rle && rle->mascara == 0) {
+        float value = (C[0][0] * coefficients[0][0]) * C[0][0];
+        for (int y = 0; y < 8; y++) {
+            for (int x = 0; x < 8; x++) block[y][x] = value;
+        }
+        return;
+    }
+    inverseDCTWithMatrix(C, coefficients, block);
+}
+
+void decodeMacroblockRange(MACROBLOCO *mb_array, const MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, PIXELYCBCR *dst, int width, int height, int first_mb, int count, CODEC_TABLES *tables) {
+    /*
+     * Reconstrói na imagem YCbCr os macroblocos de first_mb até first_mb + count - 1 (ordem do arquivo).
+     * Cada macrobloco só escreve na sua própria região de 16x16 pixels (a borda replicada também cai
+     * dentro dele), então trechos diferentes podem ser reconstruídos ao mesmo tempo.
+     *
+     * Parâmetros:
+     * mb_array: vetor de macroblocos, indexado a partir de first_mb
+     * rle_macroblocks: os mesmos macroblocos em RLE, usados para preencher direto os blocos sem
+     *                  coeficientes AC (que incluem os omitidos pelo padrão de blocos codificados),
+     *                  ou NULL para aplicar a IDCT em todos
      * dst: imagem YCbCr linearizada a ser preenchida
      * width, height: largura e altura da imagem
+     * first_mb, count: primeiro macrobloco e quantidade de macroblocos a reconstruir
+     * tables: tabelas pré-calculadas (init_codec_tables)
      */
+    float (*C)[8] = tables->dct_matrix;
     int mb_width = (width + 15) / 16;
-    int mb_height = (height + 15) / 16;
-    int mb_index = 0;
 
-    for (int y = 0; y < mb_height * 16; y += 16) {
-        for (int x = 0; x < mb_width * 16; x += 16) {
-            MACROBLOCO *mb = &mb_array[mb_index++];
+    for (int k = 0; k < count; k++) {
+        int x = ((first_mb + k) % mb_width) * 16;
+        int y = ((first_mb + k) / mb_width) * 16;
+        MACROBLOCO *mb = &mb_array[k];
+        const MACROBLOCO_RLE_DIFERENCIAL *rle = rle_macroblocks ? &rle_macroblocks[k] : NULL;
+        int interior = x + 16 <= width && y + 16 <= height; // Só os macroblocos da borda precisam de padding_clamp
 
-            // Reconstrói os 4 blocos Y
-            for (int i = 0; i < 4; i++) {
-                int bx = x + (i % 2) * 8;
-                int by = y + (i / 2) * 8;
+        // Reconstrói os 4 blocos Y
+        for (int i = 0; i < 4; i++) {
+            int bx = x + (i % 2) * 8;
+            int by = y + (i / 2) * 8;
 
-                float rec[8][8] = {0};
-                inverseDCTMatrix(mb->Y[i].block, rec);
+            float rec[8][8] = {0};
+            inverse_dct_block(C, mb->Y[i].block, rle ? &rle->Y_vetor[i] : NULL, rec);
+            if (interior) {
+                reconstruct_block_y_interior(dst, rec, bx, by, width);
+            } else {
                 reconstructBlock8x8_Y(dst, rec, bx, by, width, height);
             }
+        }
 
-            // Reconstrói os blocos Cb e Cr
-            float cb_rec[8][8] = {0}, cr_rec[8][8] = {0};
-            inverseDCTMatrix(mb->Cb.block, cb_rec);
-            inverseDCTMatrix(mb->Cr.block, cr_rec);
+        // Reconstrói os blocos Cb e Cr
+        float cb_rec[8][8] = {0}, cr_rec[8][8] = {0};
+        inverse_dct_block(C, mb->Cb.block, rle ? &rle->Cb_vetor : NULL, cb_rec);
+        inverse_dct_block(C, mb->Cr.block, rle ? &rle->Cr_vetor : NULL, cr_rec);
 
+        if (interior) {
+            reconstruct_block_chroma420_interior(dst, cb_rec, x, y, width, 'B');
+            reconstruct_block_chroma420_interior(dst, cr_rec, x, y, width, 'R');
+        } else {
             reconstructBlock8x8_CbCr420(dst, cb_rec, x, y, width, height, 'B');
             reconstructBlock8x8_CbCr420(dst, cr_rec, x, y, width, height, 'R');
         }
     }
 }
 
+int valid_decode_scale(int scale) {
+    /*
+     * Retorna 1 se scale é um denominador aceito na decodificação: 1 (tamanho original),
+     * 2 e 4 (IDCTs reduzidas) ou 8 (só o DC de cada bloco), ver decodeMacroblockRangeScaled.
+     */
+    return scale == 1 || scale == 2 || scale == 4 || scale == 8;
+}
+
+void scaled_image_size(int width, int height, int scale, int *out_width, int *out_height) {
+    /*
+     * Dimensões da imagem decodificada em 1/scale do tamanho. Os blocos parciais da borda
+     * também viram pixels, então as divisões são arredondadas para cima.
+     *
+     * Parâmetros:
+     * width, height: largura e altura da imagem original
+     * scale: denominador da escala (valid_decode_scale)
+     * out_width, out_height: ponteiros para armazenar as dimensões reduzidas
+     */
+    *out_width = (width + scale - 1) / scale;
+    *out_height = (height + scale - 1) / scale;
+}
+
+static unsigned char dc_sample(float c0, int dc, const QUANT_RECIPROCALS *reciprocals) {
+    // Amostra de um bloco que só tem o DC quantizado dc: dequantização, a IDCT constante de
+    // inverse_dct_block e o mesmo arredondamento de reconstructBlock8x8_Y
+    float coefficient = (float)dc * reciprocals->steps[0];
+    return (unsigned char)(clamp((c0 * coefficient) * c0 + 128.5f, 0.0f, 255.0f));
+}
+
+static void scaled_block_samples(const BLOCO_RLE_DIFERENCIAL *rle, const QUANT_RECIPROCALS *reciprocals, CODEC_TABLES *tables, int n, unsigned char samples[4][4]) {
+    /*
+     * Reconstrói um bloco 8x8 em n x n amostras (n = 1, 2 ou 4). Com n = 1 sai só do DC; senão só os
+     * coeficientes do canto n x n de baixa frequência são dequantizados, direto da forma esparsa
+     * (sem RLE nem desvetorização), e passam pela IDCT reduzida de n pontos.
+     *
+     * Parâmetros:
+     * rle: bloco em forma esparsa, com o DC já absoluto
+     * reciprocals: passos da matriz de quantização do bloco
+     * tables: tabelas com a matriz da DCT e as matrizes das IDCTs reduzidas
+     * n: lado do bloco reduzido
+     * samples: amostras reconstruídas
+     */
+    if (n == 1) {
+        samples[0][0] = dc_sample(tables->dct_matrix[0][0], rle->coeficiente_dc, reciprocals);
+        return;
+    }
+
+    float coefficients[4][4] = {{0}};
+    float block[4][4];
+    coefficients[0][0] = (float)rle->coeficiente_dc * reciprocals->steps[0];
+
+    // O canto n x n termina na posição zigue-zague de (n - 1, n - 1), que é (n - 1) * 2n
+    int last = (n - 1) * 2 * n;
+    uint64_t mask = rle->mascara;
+    for (int k = 0; mask; k++) {
+        int index = __builtin_ctzll(mask);
+        if (index > last) break;
+        mask &= mask - 1;
+
+        int position = zigzag_order[index];
+        int row = position / 8, column = position % 8;
+        if (row < n && column < n) {
+            coefficients[row][column] = (float)rle->valores[k] * reciprocals->steps[position];
+        }
+    }
+
+    inverseDCTReduced(n == 4 ? tables->reduced_matrix_4 : tables->reduced_matrix_2, n, coefficients, block);
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            samples[y][x] = (unsigned char)(clamp(block[y][x] + 128.5f, 0.0f, 255.0f)); // Adiciona 128 para reverter a centralização
+        }
+    }
+}
+
+void decodeMacroblockRangeScaled(const MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, PIXELYCBCR *dst, int width, int height, int first_mb, int count, CODEC_TABLES *tables, int adaptive, int scale) {
+    /*
+     * Reconstrói em 1/scale do tamanho (scale = 2, 4 ou 8) os macroblocos de first_mb até
+     * first_mb + count - 1, direto dos blocos RLE: cada bloco 8x8 vira n x n pixels, com n = 8 / scale,
+     * pela IDCT reduzida do seu canto de baixa frequência (em 1/8, só pelo DC). Não há RLE,
+     * desvetorização, dequantização completa nem IDCT 8x8, e a crominância também é reconstruída
+     * em n x n amostras, cada uma cobrindo 2x2 pixels da imagem reduzida (4:2:0).
+     * A imagem reduzida tem as dimensões de scaled_image_size, e cada macrobloco escreve só a parte
+     * da sua região de 2n x 2n pixels que cai dentro dela.
+     *
+     * Parâmetros:
+     * rle_macroblocks: macroblocos RLE com os DCs já absolutos (depois do diferencial), indexados a partir de first_mb
+     * dst: imagem YCbCr reduzida a ser preenchida
+     * width, height: largura e altura da imagem original
+     * first_mb, count: primeiro macrobloco e quantidade de macroblocos a reconstruir
+     * tables: tabelas com as matrizes do arquivo
+     * adaptive: 1 para dequantizar cada macrobloco com as matrizes do seu nível (FORMAT_FLAG_ADAPTIVE)
+     * scale: denominador da escala
+     */
+    int n = 8 / scale;
+    int size = 2 * n; // Lado de um macrobloco na imagem reduzida
+    int mb_width = (width + 15) / 16;
+    int out_width, out_height;
+    scaled_image_size(width, height, scale, &out_width, &out_height);
+
+    for (int k = 0; k < count; k++) {
+        const MACROBLOCO_RLE_DIFERENCIAL *rle = &rle_macroblocks[k];
+        const QUANT_RECIPROCALS *reciprocals_y = &tables->reciprocals_y;
+        const QUANT_RECIPROCALS *reciprocals_chroma = &tables->reciprocals_chroma;
+        if (adaptive) {
+            int level = rle->nivel;
+            if (level < 0 || level >= ADAPTIVE_LEVELS) level = ADAPTIVE_NEUTRAL_LEVEL;
+            reciprocals_y = &tables->adaptive_reciprocals_y[level];
+            reciprocals_chroma = &tables->adaptive_reciprocals_chroma[level];
+        }
+
+        int x = ((first_mb + k) % mb_width) * size;
+        int y = ((first_mb + k) / mb_width) * size;
+        unsigned char samples[4][4];
+
+        // Blocos Y, cada um em n x n pixels
+        for (int i = 0; i < 4; i++) {
+            int bx = x + (i % 2) * n;
+            int by = y + (i / 2) * n;
+            if (bx >= out_width || by >= out_height) continue; // Bloco inteiro no preenchimento da borda
+
+            scaled_block_samples(&rle->Y_vetor[i], reciprocals_y, tables, n, samples);
+            for (int py = 0; py < n && by + py < out_height; py++) {
+                for (int px = 0; px < n && bx + px < out_width; px++) {
+                    dst[(by + py) * out_width + bx + px].Y = samples[py][px];
+                }
+            }
+        }
+
+        // Blocos Cb e Cr, cada amostra em 2x2 pixels
+        unsigned char cb[4][4], cr[4][4];
+        scaled_block_samples(&rle->Cb_vetor, reciprocals_chroma, tables, n, cb);
+        scaled_block_samples(&rle->Cr_vetor, reciprocals_chroma, tables, n, cr);
+        for (int py = 0; py < size && y + py < out_height; py++) {
+            for (int px = 0; px < size && x + px < out_width; px++) {
+                PIXELYCBCR *pix = &dst[(y + py) * out_width + x + px];
+                pix->Cb = cb[py / 2][px / 2];
+                pix->Cr = cr[py / 2][px / 2];
+            }
+        }
+    }
+}
+
 void vectorize_block(float block[8][8], VETORZIGZAG *return_vector) {
     /*
      * Dado um bloco 8x8, converte em um vetor de 64 posiçöes utilizando o padrão zigue-zague.
+     * Com AVX2, cada grupo de 8 posições do vetor é buscado de uma vez com gather.
      */
-    int zigzag[64][2] = {
-        {0,0},{0,1},{1,0},{2,0},{1,1},{0,2},{0,3},{1,2},
-        {2,1},{3,0},{4,0},{3,1},{2,2},{1,3},{0,4},{0,5},
-        {1,4},{2,3},{3,2},{4,1},{5,0},{6,0},{5,1},{4,2},
-        {3,3},{2,4},{1,5},{0,6},{0,7},{1,6},{2,5},{3,4},
-        {4,3},{5,2},{6,1},{7,0},{7,1},{6,2},{5,3},{4,4},
-        {3,5},{2,6},{1,7},{2,7},{3,6},{4,5},{5,4},{6,3},
-        {7,2},{7,3},{6,4},{5,5},{4,6},{3,7},{4,7},{5,6},
-        {6,5},{7,4},{7,5},{6,6},{5,7},{6,7},{7,6},{7,7}
-    };
-
+    const float *values = &block[0][0];
+#ifdef __AVX2__
+    for (int i = 0; i < 64; i += 8) {
+        __m256i positions = _mm256_loadu_si256((const __m256i *)(zigzag_order + i));
+        _mm256_storeu_ps(return_vector->vector + i, _mm256_i32gather_ps(values, positions, 4));
+    }
+#else
     for (int i = 0; i < 64; i++) {
-        int row = zigzag[i][0];
-        int col = zigzag[i][1];
-        return_vector->vector[i] = block[row][col];
+        return_vector->vector[i] = values[zigzag_order[i]];
+    }
+#endif
+}
+
+static void vectorize_block_if_needed(float block[8][8], VETORZIGZAG *return_vector, int flat) {
+    // Vetoriza um bloco; um bloco constante só tem o DC, então o vetor é zerado sem percorrer o zigue-zague
+    if (flat) {
+        memset(return_vector->vector, 0, sizeof(return_vector->vector));
+        return_vector->vector[0] = block[0][0];
+        return;
     }
+    vectorize_block(block, return_vector);
 }
 
 void vectorize_macroblock(MACROBLOCO *macroblock, MACROBLOCO_VETORIZADO *vetorizado) {
     /*
      * Dado um macrobloco com subamostragem de crominância, converte em um macrobloco vetorizado em zigue-zague.
+     * Os blocos constantes (macroblock->planos) viram vetores só com o DC, e o RLE, que percorre a máscara
+     * de coeficientes não nulos, também não tem trabalho com eles.
      */
     for (int i = 0; i < 4; i++)
-        vectorize_block(macroblock->Y[i].block, &vetorizado->Y_vetor[i]);
+        vectorize_block_if_needed(macroblock->Y[i].block, &vetorizado->Y_vetor[i], macroblock->planos & (0x20 >> i));
 
-    vectorize_block(macroblock->Cb.block, &vetorizado->Cb_vetor);
-    vectorize_block(macroblock->Cr.block, &vetorizado->Cr_vetor);
+    vectorize_block_if_needed(macroblock->Cb.block, &vetorizado->Cb_vetor, macroblock->planos & 0x2);
+    vectorize_block_if_needed(macroblock->Cr.block, &vetorizado->Cr_vetor, macroblock->planos & 0x1);
 }
 
 void vectorize_macroblocks(MACROBLOCO *macroblocks, MACROBLOCO_VETORIZADO *vectorized_macroblocks, int macroblock_count) {
@@ -391,21 +1118,9 @@ void devectorize_block(VETORZIGZAG *vector, float block[8][8]) {
     /*
      * Dado um vetor de 64 posiçöes, converte em um bloco 8x8 utilizando o padrão zigue-zague.
      */
-    int zigzag[64][2] = {
-        {0,0},{0,1},{1,0},{2,0},{1,1},{0,2},{0,3},{1,2},
-        {2,1},{3,0},{4,0},{3,1},{2,2},{1,3},{0,4},{0,5},
-        {1,4},{2,3},{3,2},{4,1},{5,0},{6,0},{5,1},{4,2},
-        {3,3},{2,4},{1,5},{0,6},{0,7},{1,6},{2,5},{3,4},
-        {4,3},{5,2},{6,1},{7,0},{7,1},{6,2},{5,3},{4,4},
-        {3,5},{2,6},{1,7},{2,7},{3,6},{4,5},{5,4},{6,3},
-        {7,2},{7,3},{6,4},{5,5},{4,6},{3,7},{4,7},{5,6},
-        {6,5},{7,4},{7,5},{6,6},{5,7},{6,7},{7,6},{7,7}
-    };
-
+    float *values = &block[0][0];
     for (int i = 0; i < 64; i++) {
-        int row = zigzag[i][0];
-        int col = zigzag[i][1];
-        block[row][col] = vector->vector[i];
+        values[zigzag_order[i]] = vector->vector[i];
     }
 }
 
@@ -418,6 +1133,7 @@ void devectorize_macroblock(MACROBLOCO_VETORIZADO *vetorizado, MACROBLOCO *macro
 
     devectorize_block(&vetorizado->Cb_vetor, macroblock->Cb.block);
     devectorize_block(&vetorizado->Cr_vetor, macroblock->Cr.block);
+    macroblock->planos = 0; // Só o compressor marca os blocos constantes
 }
 
 void devectorize_macroblocks(MACROBLOCO_VETORIZADO *vectorized_macroblocks, MACROBLOCO *macroblocks, int macroblock_count) {
@@ -429,35 +1145,45 @@ void devectorize_macroblocks(MACROBLOCO_VETORIZADO *vectorized_macroblocks, MACR
     }
 }
 
+static uint64_t nonzero_mask(const float vector[64]) {
+    /*
+     * Retorna uma máscara de 64 bits com o bit i ligado quando vector[i] arredonda para um
+     * inteiro diferente de zero (|vector[i]| >= 0.5). Com AVX2, 8 posições por comparação.
+     */
+    uint64_t mask = 0;
+#ifdef __AVX2__
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 half = _mm256_set1_ps(0.5f);
+    for (int i = 0; i < 64; i += 8) {
+        __m256 magnitudes = _mm256_andnot_ps(sign, _mm256_loadu_ps(vector + i));
+        uint64_t bits = (uint64_t)_mm256_movemask_ps(_mm256_cmp_ps(magnitudes, half, _CMP_GE_OQ));
+        mask |= bits << i;
+    }
+#else
+    for (int i = 0; i < 64; i++) {
+        if (fabsf(vector[i]) >= 0.5f) mask |= (uint64_t)1 << i;
+    }
+#endif
+    return mask;
+}
+
 void rle_encode_block(BLOCO_RLE_DIFERENCIAL* rle_block, VETORZIGZAG* zigzag_block) {
     /*
      * Converte um bloco vetorizado em zigue-zague em um bloco codificado por carreira.
+     * A máscara de nonzero_mask já é a do bloco esparso; os valores não nulos são copiados
+     * contando os zeros à direita dela, então as carreiras de zeros não são percorridas.
+     * Os coeficientes quantizados ficam bem dentro de int16_t (a DCT de pixels de 8 bits
+     * não passa de 1024 em módulo e os passos são no mínimo 1).
      */
     rle_block->quantidade = 0;
-    int quantidade_zeros = 0;
-
     rle_block->coeficiente_dc = (int)round(zigzag_block->vector[0]);
 
-    for (int i = 1; i <= 63; i++) {
-        int valor_quantizado = (int)round(zigzag_block->vector[i]);
-        if (valor_quantizado == 0) {
-            quantidade_zeros++;
-        } else {
-            if (rle_block->quantidade < 63) {
-                 rle_block->pares[rle_block->quantidade].zeros = quantidade_zeros;
-                 rle_block->pares[rle_block->quantidade].valor = valor_quantizado;
-                 rle_block->quantidade++;
-                 quantidade_zeros = 0;
-            } else {
-                 break;
-            }
-        }
-    }
-    // Colocar EOB
-    if (rle_block->quantidade < 64) {
-        rle_block->pares[rle_block->quantidade].zeros = 0;
-        rle_block->pares[rle_block->quantidade].valor = 0;
-        rle_block->quantidade++;
+    uint64_t mask = nonzero_mask(zigzag_block->vector) & ~(uint64_t)1; // Só os coeficientes AC
+    rle_block->mascara = mask;
+    while (mask) {
+        int position = __builtin_ctzll(mask);
+        rle_block->valores[rle_block->quantidade++] = (int16_t)round(zigzag_block->vector[position]);
+        mask &= mask - 1;
     }
 }
 
@@ -485,33 +1211,15 @@ void rle_decode_block(VETORZIGZAG* zigzag_block, BLOCO_RLE_DIFERENCIAL* rle_bloc
     /*
      * Converte um bloco codificado por carreira em um bloco vetorizado em zigue-zague.
      */
-    for (int i = 1; i <= 63; i++) {
-        zigzag_block->vector[i] = 0.0f;
-    }
+    memset(zigzag_block->vector, 0, sizeof(zigzag_block->vector));
 
     zigzag_block->vector[0] = (float)rle_block->coeficiente_dc; // float pois a DCT retorna float
-    int current_ac_idx = 1;
 
-    for (int k = 0; k < rle_block->quantidade; k++) {
-        const PAR_RLE* par_atual = &rle_block->pares[k];
-        if (par_atual->zeros == 0 && par_atual->valor == 0) {
-            break; // EOB encontrado
-        }
-
-        for (int z = 0; z < par_atual->zeros; z++) {
-            if (current_ac_idx <= 63) {
-                current_ac_idx++;
-            } else {
-                return;
-            }
-        }
-
-        if (current_ac_idx <= 63) {
-            zigzag_block->vector[current_ac_idx] = (float)par_atual->valor; // float pois a DCT retorna float
-            current_ac_idx++;
-        } else {
-            return;
-        }
+    // Cada bit da máscara é a posição do próximo valor não nulo (o resto do vetor já está zerado)
+    uint64_t mask = rle_block->mascara;
+    for (int k = 0; mask; k++) {
+        zigzag_block->vector[__builtin_ctzll(mask)] = (float)rle_block->valores[k]; // float pois a DCT retorna float
+        mask &= mask - 1;
     }
 }
 
@@ -535,13 +1243,15 @@ void rle_decode_macroblocks(MACROBLOCO_VETORIZADO *vectorized_macroblocks, MACRO
     }
 }
 
-void differential_encode_dc(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int macroblock_count) {
+void differential_encode_dc_range(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int macroblock_count, int predictors[3]) {
     /*
-     * Faz codificação diferencial dos coeficientes DC dos macroblocos.
+     * Faz codificação diferencial dos coeficientes DC de um trecho de macroblocos,
+     * partindo dos preditores informados (Y, Cb, Cr). Ao final, predictors contém
+     * os DCs absolutos do último macrobloco, prontos para o trecho seguinte.
      */
-    int previous_dc_Y = 0;
-    int previous_dc_Cb = 0;
-    int previous_dc_Cr = 0;
+    int previous_dc_Y = predictors[0];
+    int previous_dc_Cb = predictors[1];
+    int previous_dc_Cr = predictors[2];
 
     for (int i = 0; i < macroblock_count; i++) {
         // Processa os 4 blocos Y em sequência
@@ -561,15 +1271,42 @@ void differential_encode_dc(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int mac
         rle_macroblocks[i].Cr_vetor.coeficiente_dc = current_Cr - previous_dc_Cr;
         previous_dc_Cr = current_Cr;
     }
+
+    predictors[0] = previous_dc_Y;
+    predictors[1] = previous_dc_Cb;
+    predictors[2] = previous_dc_Cr;
 }
 
-void differential_decode_dc(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int macroblock_count) {
+void differential_encode_dc_restart(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int first_index, int macroblock_count, int restart_interval, int predictors[3]) {
     /*
-     * Faz decodificação diferencial dos coeficientes DC dos macroblocos.
+     * Faz codificação diferencial dos coeficientes DC de um trecho que começa no macrobloco
+     * first_index da imagem, zerando os preditores a cada restart_interval macroblocos
+     * (0 = sem reinícios). Assim cada intervalo pode ser decodificado sozinho.
      */
-    int previous_dc_Y = 0;
-    int previous_dc_Cb = 0;
-    int previous_dc_Cr = 0;
+    int i = 0;
+    while (i < macroblock_count) {
+        int chunk = macroblock_count - i;
+        if (restart_interval > 0) {
+            int position = (first_index + i) % restart_interval;
+            if (position == 0) {
+                predictors[0] = predictors[1] = predictors[2] = 0;
+            }
+            if (restart_interval - position < chunk) chunk = restart_interval - position;
+        }
+        differential_encode_dc_range(rle_macroblocks + i, chunk, predictors);
+        i += chunk;
+    }
+}
+
+void differential_decode_dc_range(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int macroblock_count, int predictors[3]) {
+    /*
+     * Faz decodificação diferencial dos coeficientes DC de um trecho de macroblocos,
+     * partindo dos preditores informados (Y, Cb, Cr). Ao final, predictors contém
+     * os DCs absolutos do último macrobloco do trecho.
+     */
+    int previous_dc_Y = predictors[0];
+    int previous_dc_Cb = predictors[1];
+    int previous_dc_Cr = predictors[2];
 
     for (int i = 0; i < macroblock_count; i++) {
         // Decodifica os 4 blocos Y
@@ -592,4 +1329,29 @@ void differential_decode_dc(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int mac
         rle_macroblocks[i].Cr_vetor.coeficiente_dc = real_Cr;
         previous_dc_Cr = real_Cr;
     }
+
+    predictors[0] = previous_dc_Y;
+    predictors[1] = previous_dc_Cb;
+    predictors[2] = previous_dc_Cr;
+}
+
+void differential_decode_dc_restart(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int first_index, int macroblock_count, int restart_interval, int predictors[3]) {
+    /*
+     * Faz decodificação diferencial dos coeficientes DC de um trecho que começa no macrobloco
+     * first_index da imagem, zerando os preditores a cada restart_interval macroblocos
+     * (0 = sem reinícios).
+     */
+    int i = 0;
+    while (i < macroblock_count) {
+        int chunk = macroblock_count - i;
+        if (restart_interval > 0) {
+            int position = (first_index + i) % restart_interval;
+            if (position == 0) {
+                predictors[0] = predictors[1] = predictors[2] = 0;
+            }
+            if (restart_interval - position < chunk) chunk = restart_interval - position;
+        }
+        differential_decode_dc_range(rle_macroblocks + i, chunk, predictors);
+        i += chunk;
+    }
 }
\ No newline at end of file
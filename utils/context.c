@@ -0,0 +1,248 @@
+/* Esse arquivo implementa os contextos reaproveitáveis do compressor e do descompressor (context.h).
+ * Toda a memória de trabalho de uma imagem é cortada da arena do contexto, que só é realocada quando
+ * uma imagem maior aparece; as tabelas (matriz da DCT, quantização e busca do Huffman) são calculadas uma vez.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+
+int grow_aligned_buffer(void **buffer, size_t *capacity, size_t needed, size_t element_size, long *allocations) {
+    /*
+     * Troca um vetor alinhado por um maior só quando ele comporta menos que needed elementos.
+     * Usado para os vetores que não são temporários de uma imagem (arquivo lido e arquivo gravado).
+     * O conteúdo antigo não é preservado. Retorna 1 em caso de sucesso, 0 se faltar memória
+     * (nesse caso o vetor antigo é liberado e a capacidade vai para zero).
+     *
+     * Parâmetros:
+     * buffer: vetor a ser garantido
+     * capacity: capacidade atual em elementos
+     * needed: número de elementos necessários
+     * element_size: tamanho de cada elemento em bytes
+     * allocations: contador incrementado a cada alocação
+     */
+    if (needed <= *capacity) return 1;
+    aligned_free(*buffer);
+    *buffer = aligned_malloc(needed * element_size);
+    if (!*buffer) {
+        *capacity = 0;
+        return 0;
+    }
+    *capacity = needed;
+    (*allocations)++;
+    return 1;
+}
+
+static size_t work_buffers_size(size_t pixel_count, size_t macroblock_count) {
+    // Espaço na arena para os vetores de pixels e de macroblocos de uma imagem
+    return arena_size(pixel_count * sizeof(PIXELRGB)) +
+           arena_size(pixel_count * sizeof(PIXELYCBCR)) +
+           arena_size(macroblock_count * sizeof(MACROBLOCO)) +
+           arena_size(macroblock_count * sizeof(MACROBLOCO_VETORIZADO)) +
+           arena_size(macroblock_count * sizeof(MACROBLOCO_RLE_DIFERENCIAL));
+}
+
+static void carve_work_buffers(ARENA *arena, WORK_BUFFERS *work, size_t pixel_count, size_t macroblock_count) {
+    // Corta os vetores de pixels e de macroblocos de uma arena já reservada com work_buffers_size
+    work->pixels_rgb = (PIXELRGB *)arena_alloc(arena, pixel_count * sizeof(PIXELRGB));
+    work->pixels_ycbcr = (PIXELYCBCR *)arena_alloc(arena, pixel_count * sizeof(PIXELYCBCR));
+    work->macroblocks = (MACROBLOCO *)arena_alloc(arena, macroblock_count * sizeof(MACROBLOCO));
+    work->vectorized_macroblocks = (MACROBLOCO_VETORIZADO *)arena_alloc(arena, macroblock_count * sizeof(MACROBLOCO_VETORIZADO));
+    work->rle_diff_macroblocks = (MACROBLOCO_RLE_DIFERENCIAL *)arena_alloc(arena, macroblock_count * sizeof(MACROBLOCO_RLE_DIFERENCIAL));
+    work->pixel_capacity = pixel_count;
+    work->macroblock_capacity = macroblock_count;
+}
+
+static void clear_work_buffers(WORK_BUFFERS *work) {
+    // Esquece os vetores cortados da arena (o arquivo lido e o contador são mantidos)
+    work->pixels_rgb = NULL;
+    work->pixels_ycbcr = NULL;
+    work->macroblocks = NULL;
+    work->vectorized_macroblocks = NULL;
+    work->rle_diff_macroblocks = NULL;
+    work->pixel_capacity = 0;
+    work->macroblock_capacity = 0;
+}
+
+static size_t max_size(size_t a, size_t b) {
+    return a > b ? a : b;
+}
+
+static int reserve_band_bits_array(ENCODER_CONTEXT *context, size_t num_bands) {
+    // Garante uma área de dados Huffman por faixa; as áreas existentes são mantidas e as novas começam vazias
+    if (num_bands <= context->band_bits_capacity) return 1;
+    BAND_BITS *band_bits = (BAND_BITS *)realloc(context->band_bits, num_bands * sizeof(BAND_BITS));
+    if (!band_bits) return 0;
+    memset(band_bits + context->band_bits_capacity, 0, (num_bands - context->band_bits_capacity) * sizeof(BAND_BITS));
+    context->band_bits = band_bits;
+    context->band_bits_capacity = num_bands;
+    context->work.allocations++;
+    return 1;
+}
+
+int reserve_band_bits(BAND_BITS *bits, size_t needed) {
+    /*
+     * Garante que a área de dados Huffman de uma faixa comporta needed bytes, preservando o que já
+     * foi escrito (a área pode mudar de lugar). Cresce pelo menos para o dobro, para que uma faixa
+     * maior que a reserva inicial realoque poucas vezes. Só a thread da faixa a chama, então a
+     * alocação é contada em bits->allocations. Retorna 1 em caso de sucesso, 0 se faltar memória.
+     *
+     * Parâmetros:
+     * bits: área da faixa
+     * needed: bytes necessários
+     */
+    if (needed <= bits->capacity) return 1;
+    size_t capacity = max_size(needed, bits->capacity * 2);
+    uint8_t *data = (uint8_t *)realloc(bits->data, capacity);
+    if (!data) return 0;
+    bits->data = data;
+    bits->capacity = capacity;
+    bits->allocations++;
+    return 1;
+}
+
+void init_encoder_context(ENCODER_CONTEXT *context) {
+    /*
+     * Prepara um contexto vazio do compressor e monta a tabela de emissão do Huffman. A arena é
+     * alocada sob demanda pela primeira imagem; as tabelas começam na qualidade 50 e são trocadas
+     * quando a qualidade muda.
+     *
+     * Parâmetros:
+     * context: contexto a ser inicializado
+     */
+    memset(context, 0, sizeof(*context));
+    init_codec_tables(&context->tables, 50);
+    build_huffman_encode_tables(&context->huffman);
+}
+
+int reserve_encoder_context(ENCODER_CONTEXT *context, int width, int height, int num_bands, int index_count) {
+    /*
+     * Garante que o contexto comporta uma imagem width x height comprimida em num_bands faixas
+     * e com index_count entradas de índice. Se a arena já comporta tudo, nada muda (inclusive
+     * os pixels já lidos); senão ela cresce e todos os vetores são cortados de novo. Os dados
+     * Huffman ficam nas áreas das faixas (band_bits), reservadas por quem comprime.
+     * Retorna 1 em caso de sucesso, 0 se faltar memória.
+     *
+     * Parâmetros:
+     * context: contexto do compressor
+     * width, height: dimensões da imagem
+     * num_bands: faixas de linhas de macroblocos processadas em paralelo
+     * index_count: entradas do índice de macroblocos (0 = sem índice)
+     */
+    WORK_BUFFERS *work = &context->work;
+    size_t pixel_count = (size_t)width * height;
+    size_t macroblock_count = (size_t)((width + 15) / 16) * ((height + 15) / 16);
+    if (!reserve_band_bits_array(context, num_bands)) return 0;
+    if (pixel_count <= work->pixel_capacity && macroblock_count <= work->macroblock_capacity &&
+        (size_t)num_bands <= context->predictor_capacity && (size_t)index_count <= context->index_capacity) {
+        return 1;
+    }
+
+    // Cresce para o maior entre o que já existia e o pedido, para não alternar entre dois tamanhos
+    pixel_count = max_size(pixel_count, work->pixel_capacity);
+    macroblock_count = max_size(macroblock_count, work->macroblock_capacity);
+    size_t bands = max_size(num_bands, context->predictor_capacity);
+    size_t entries = max_size(index_count, context->index_capacity);
+    size_t total = work_buffers_size(pixel_count, macroblock_count) +
+                   arena_size(macroblock_count * sizeof(BitBuffer)) +
+                   arena_size(macroblock_count * sizeof(BitBuffer *)) +
+                   arena_size(bands * sizeof(*context->predictors)) +
+                   arena_size(entries * sizeof(MACROBLOCK_INDEX_ENTRY));
+
+    arena_reset(&context->arena);
+    clear_work_buffers(work);
+    context->bit_buffer_capacity = context->predictor_capacity = context->index_capacity = 0;
+    if (!arena_reserve(&context->arena, total, &work->allocations)) return 0;
+
+    carve_work_buffers(&context->arena, work, pixel_count, macroblock_count);
+    context->bit_buffers = (BitBuffer *)arena_alloc(&context->arena, macroblock_count * sizeof(BitBuffer));
+    context->encoded = (BitBuffer **)arena_alloc(&context->arena, macroblock_count * sizeof(BitBuffer *));
+    context->predictors = arena_alloc(&context->arena, bands * sizeof(*context->predictors));
+    context->index_entries = (MACROBLOCK_INDEX_ENTRY *)arena_alloc(&context->arena, entries * sizeof(MACROBLOCK_INDEX_ENTRY));
+    context->bit_buffer_capacity = macroblock_count;
+    context->predictor_capacity = bands;
+    context->index_capacity = entries;
+    return 1;
+}
+
+void free_encoder_context(ENCODER_CONTEXT *context) {
+    /*
+     * Libera toda a memória do contexto do compressor.
+     */
+    arena_free(&context->arena);
+    for (size_t band = 0; band < context->band_bits_capacity; band++) {
+        free(context->band_bits[band].data);
+    }
+    free(context->band_bits);
+    aligned_free(context->output);
+    aligned_free(context->coefficients);
+    aligned_free(context->band_sizes);
+    aligned_free(context->work.file_data);
+    memset(context, 0, sizeof(*context));
+}
+
+void init_decoder_context(DECODER_CONTEXT *context) {
+    /*
+     * Prepara um contexto vazio do descompressor e monta as tabelas de busca do Huffman.
+     *
+     * Parâmetros:
+     * context: contexto a ser inicializado
+     */
+    memset(context, 0, sizeof(*context));
+    init_codec_tables(&context->tables, 50);
+    build_huffman_decode_tables(&context->huffman);
+}
+
+int reserve_decoder_context(DECODER_CONTEXT *context, int width, int height, int scale, int num_segments, int index_count) {
+    /*
+     * Garante que o contexto comporta uma imagem width x height decodificada em 1/scale do tamanho,
+     * dividida em até num_segments trechos e com até index_count entradas de índice. Os vetores de
+     * pixels só precisam da imagem reduzida. Retorna 1 em caso de sucesso, 0 se faltar memória.
+     * O arquivo já carregado em work.file_data não é afetado.
+     *
+     * Parâmetros:
+     * context: contexto do descompressor
+     * width, height: dimensões da imagem
+     * scale: denominador da escala da imagem decodificada (1 = tamanho original)
+     * num_segments: trechos em que o arquivo será dividido
+     * index_count: maior número de entradas de índice aceito
+     */
+    WORK_BUFFERS *work = &context->work;
+    int out_width, out_height;
+    scaled_image_size(width, height, scale, &out_width, &out_height);
+    size_t pixel_count = (size_t)out_width * out_height;
+    size_t macroblock_count = (size_t)((width + 15) / 16) * ((height + 15) / 16);
+    if (pixel_count <= work->pixel_capacity && macroblock_count <= work->macroblock_capacity &&
+        (size_t)num_segments <= context->segment_capacity && (size_t)index_count <= context->index_capacity) {
+        return 1;
+    }
+
+    pixel_count = max_size(pixel_count, work->pixel_capacity);
+    macroblock_count = max_size(macroblock_count, work->macroblock_capacity);
+    size_t segments = max_size(num_segments, context->segment_capacity);
+    size_t entries = max_size(index_count, context->index_capacity);
+    size_t total = work_buffers_size(pixel_count, macroblock_count) +
+                   arena_size(segments * sizeof(DECODE_SEGMENT)) +
+                   arena_size(entries * sizeof(MACROBLOCK_INDEX_ENTRY));
+
+    arena_reset(&context->arena);
+    clear_work_buffers(work);
+    context->segment_capacity = context->index_capacity = 0;
+    if (!arena_reserve(&context->arena, total, &work->allocations)) return 0;
+
+    carve_work_buffers(&context->arena, work, pixel_count, macroblock_count);
+    context->segments = (DECODE_SEGMENT *)arena_alloc(&context->arena, segments * sizeof(DECODE_SEGMENT));
+    context->index_entries = (MACROBLOCK_INDEX_ENTRY *)arena_alloc(&context->arena, entries * sizeof(MACROBLOCK_INDEX_ENTRY));
+    context->segment_capacity = segments;
+    context->index_capacity = entries;
+    return 1;
+}
+
+void free_decoder_context(DECODER_CONTEXT *context) {
+    /*
+     * Libera toda a memória do contexto do descompressor.
+     */
+    arena_free(&context->arena);
+    aligned_free(context->work.file_data);
+    memset(context, 0, sizeof(*context));
+}
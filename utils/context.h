@@ -0,0 +1,91 @@
+#ifndef CONTEXT_H
+    #define CONTEXT_H
+
+    /* Contextos reaproveitáveis do compressor e do descompressor. Cada contexto guarda as tabelas
+     * pré-calculadas e uma arena (arena.h) de onde saem todos os vetores de trabalho de uma imagem.
+     * A arena só cresce, então uma sequência de imagens do mesmo tamanho ou menores não aloca memória
+     * depois da primeira; o contador 'allocations' permite conferir isso.
+     */
+    #include <stddef.h>
+    #include <stdint.h>
+    #include "bitmap.h"
+    #include "codec.h"
+    #include "huffman.h"
+    #include "arena.h"
+
+    // Vetores de trabalho de uma imagem, cortados da arena do contexto
+    typedef struct {
+        PIXELRGB *pixels_rgb;
+        PIXELYCBCR *pixels_ycbcr;
+        size_t pixel_capacity;
+        MACROBLOCO *macroblocks;
+        MACROBLOCO_VETORIZADO *vectorized_macroblocks;
+        MACROBLOCO_RLE_DIFERENCIAL *rle_diff_macroblocks;
+        size_t macroblock_capacity;
+        uint8_t *file_data;          // Arquivo comprimido carregado pelo descompressor (fora da arena)
+        size_t file_capacity;
+        long allocations;            // Alocações feitas desde a criação (inclui as do contexto dono)
+    } WORK_BUFFERS;
+
+    // Trecho do arquivo que pode ser decodificado de forma independente
+    typedef struct {
+        int first;              // Primeiro macrobloco do trecho
+        int count;              // Quantidade de macroblocos do trecho
+        int64_t offset;         // Posição do primeiro macrobloco no arquivo (-1 se desconhecida)
+        int predictors[3];      // DCs absolutos (Y, Cb, Cr) que precedem o trecho
+        int dc_sums[3];         // Soma das diferenças DC (Y, Cb, Cr) decodificadas no trecho
+    } DECODE_SEGMENT;
+
+    // Dados Huffman de uma faixa: os macroblocos ficam um depois do outro e a área cresce (fora da arena)
+    // quando falta espaço para o pior caso do próximo; é reaproveitada entre imagens
+    typedef struct {
+        uint8_t *data;
+        size_t capacity;
+        long allocations;   // Alocações feitas pela thread da faixa, somadas depois ao contador do contexto
+    } BAND_BITS;
+
+    // Contexto do compressor
+    typedef struct {
+        ARENA arena;
+        WORK_BUFFERS work;
+        CODEC_TABLES tables;
+        HUFFMAN_ENCODE_TABLES huffman;
+        BitBuffer *bit_buffers;             // Um buffer Huffman por macrobloco, reaproveitado entre imagens
+        BitBuffer **encoded;                // Buffers da última imagem, na ordem do arquivo (NULL se falhou)
+        size_t bit_buffer_capacity;
+        BAND_BITS *band_bits;               // Dados dos buffers Huffman de cada faixa (fora da arena)
+        size_t band_bits_capacity;
+        int (*predictors)[3];               // Preditores DC de entrada de cada faixa
+        size_t predictor_capacity;
+        MACROBLOCK_INDEX_ENTRY *index_entries;
+        size_t index_capacity;
+        uint8_t *output;                    // Arquivo comprimido montado antes de ser gravado (fora da arena)
+        size_t output_capacity;
+        MACROBLOCO *coefficients;           // Saída da DCT guardada pela busca de --target-size (fora da arena)
+        size_t coefficient_capacity;
+        size_t *band_sizes;                 // Bytes estimados de cada faixa na busca de --target-size
+        size_t band_size_capacity;
+    } ENCODER_CONTEXT;
+
+    // Contexto do descompressor
+    typedef struct {
+        ARENA arena;
+        WORK_BUFFERS work;
+        CODEC_TABLES tables;
+        HUFFMAN_DECODE_TABLES huffman;
+        DECODE_SEGMENT *segments;
+        size_t segment_capacity;
+        MACROBLOCK_INDEX_ENTRY *index_entries;
+        size_t index_capacity;
+    } DECODER_CONTEXT;
+
+    int grow_aligned_buffer(void **buffer, size_t *capacity, size_t needed, size_t element_size, long *allocations);
+
+    void init_encoder_context(ENCODER_CONTEXT *context);
+    int reserve_encoder_context(ENCODER_CONTEXT *context, int width, int height, int num_bands, int index_count);
+    int reserve_band_bits(BAND_BITS *bits, size_t needed);
+    void free_encoder_context(ENCODER_CONTEXT *context);
+    void init_decoder_context(DECODER_CONTEXT *context);
+    int reserve_decoder_context(DECODER_CONTEXT *context, int width, int height, int scale, int num_segments, int index_count);
+    void free_decoder_context(DECODER_CONTEXT *context);
+#endif
@@ -167,9 +167,21 @@ void forwardDCTMatrix(float block[8][8], float Dctfrequencies[8][8]) {
      * block: bloco 8x8 no domínio espacial (entrada)
      * Dctfrequencies: bloco 8x8 no domínio de frequência (saída)
      */
-    memset(Dctfrequencies, 0, sizeof(float) * 64);
     float C[8][8];
     precomputeTransformation(C);
+    forwardDCTWithMatrix(C, block, Dctfrequencies);
+}
+
+void forwardDCTWithMatrix(float C[8][8], float block[8][8], float Dctfrequencies[8][8]) {
+    /*
+     * Mesma DCT de forwardDCTMatrix, mas com a matriz de transformação já calculada
+     * (precomputeTransformation), para não recalcular os cossenos a cada bloco.
+     *
+     * Parâmetros:
+     * C: matriz de transformação 8x8
+     * block: bloco 8x8 no domínio espacial (entrada)
+     * Dctfrequencies: bloco 8x8 no domínio de frequência (saída)
+     */
     float temp[8][8] = {0};
     MatrixMul(C, block, temp);
     MatrixMulSecTransp(temp, C, Dctfrequencies);
@@ -177,6 +189,65 @@ void forwardDCTMatrix(float block[8][8], float Dctfrequencies[8][8]) {
     // temp = C * B => Dct = temp * C^T 
 }
 
+void forwardDCTWithMatrixPruned(float C[8][8], float block[8][8], float Dctfrequencies[8][8], int last_diagonal) {
+    /*
+     * DCT podada: só calcula os coeficientes (u, v) com u + v <= last_diagonal, ou seja, as primeiras
+     * antidiagonais, que o zigue-zague percorre antes das outras; os demais ficam zerados.
+     * Só as linhas de temp = C * bloco usadas por esses coeficientes são calculadas, e cada coeficiente
+     * faz as mesmas somas, na mesma ordem, que forwardDCTWithMatrix, então sai idêntico ao da DCT completa.
+     *
+     * Parâmetros:
+     * C: matriz de transformação 8x8
+     * block: bloco 8x8 no domínio espacial (entrada)
+     * Dctfrequencies: bloco 8x8 no domínio de frequência (saída)
+     * last_diagonal: última antidiagonal calculada (0 = só o DC, 14 = DCT completa)
+     */
+    float temp[8][8];
+    int rows = last_diagonal < 7 ? last_diagonal + 1 : 8;
+    memset(Dctfrequencies, 0, sizeof(float) * 64);
+
+    for (int i = 0; i < rows; i++) { // temp = C * block, só nas linhas necessárias
+        for (int j = 0; j < 8; j++) {
+            float sum = 0;
+            for (int k = 0; k < 8; k++) {
+                sum += C[i][k] * block[k][j];
+            }
+            temp[i][j] = sum;
+        }
+    }
+    for (int u = 0; u < rows; u++) { // Dct = temp * C^T, só até a antidiagonal last_diagonal
+        int columns = last_diagonal - u < 7 ? last_diagonal - u + 1 : 8;
+        for (int v = 0; v < columns; v++) {
+            float sum = 0;
+            for (int k = 0; k < 8; k++) {
+                sum += temp[u][k] * C[v][k];
+            }
+            Dctfrequencies[u][v] = sum;
+        }
+    }
+}
+
+float forwardDCTFlatDC(float C[8][8], float value) {
+    /*
+     * Retorna o DC da DCT de um bloco com todos os pixels iguais a value (os ACs de um bloco
+     * constante são nulos). Matematicamente é 8 * value, mas as somas são feitas na mesma ordem
+     * que forwardDCTWithMatrix usa para o DC, então o resultado é idêntico ao da DCT completa.
+     *
+     * Parâmetros:
+     * C: matriz de transformação 8x8
+     * value: valor de todos os pixels do bloco
+     */
+    float row = 0;
+    for (int k = 0; k < 8; k++) {
+        row += C[0][k] * value; // Primeira linha de C * bloco
+    }
+    float dc = 0;
+    for (int k = 0; k < 8; k++) {
+        dc += row * C[0][k]; // Vezes a primeira coluna de C^T
+    }
+    return dc;
+}
+
 void inverseDCTMatrix(float Dctfrequencies[8][8], float block[8][8]) {
     /*
      * Aplica a Transformada Discreta de Cosseno Inversa (IDCT) em um bloco 8x8 usando multiplicação de matrizes.
@@ -185,9 +256,20 @@ void inverseDCTMatrix(float Dctfrequencies[8][8], float block[8][8]) {
      * Dctfrequencies: bloco 8x8 no domínio de frequência (entrada)
      * block: bloco 8x8 no domínio espacial (saída)
      */
-    memset(block, 0, sizeof(float) * 64);	
     float C[8][8];
     precomputeTransformation(C);
+    inverseDCTWithMatrix(C, Dctfrequencies, block);
+}
+
+void inverseDCTWithMatrix(float C[8][8], float Dctfrequencies[8][8], float block[8][8]) {
+    /*
+     * Mesma IDCT de inverseDCTMatrix, mas com a matriz de transformação já calculada.
+     *
+     * Parâmetros:
+     * C: matriz de transformação 8x8
+     * Dctfrequencies: bloco 8x8 no domínio de frequência (entrada)
+     * block: bloco 8x8 no domínio espacial (saída)
+     */
     float temp[8][8] = {0};
 
     MatrixMulFirstTransp(C, Dctfrequencies, temp);
@@ -195,4 +277,54 @@ void inverseDCTMatrix(float Dctfrequencies[8][8], float block[8][8]) {
     // IDct = C^T * Dctf * C 
     // temp = C^T * Dctf => IDct = temp * C 
 
-}
\ No newline at end of file
+}
+void precomputeReducedTransformation(float R[4][4], int n) {
+    /*
+     * Pré-calcula a matriz da DCT de n pontos (n = 2 ou 4) usada na IDCT reduzida. Cada linha é
+     * multiplicada por sqrt(n / 8), para que a IDCT de n x n pontos aplicada ao canto de baixa
+     * frequência dos coeficientes de uma DCT 8x8 devolva a média de cada região de (8 / n) x (8 / n) pixels.
+     *
+     * Parâmetros:
+     * R: matriz a ser preenchida (só as primeiras n linhas e colunas são usadas)
+     * n: número de pontos da transformada
+     */
+    memset(R, 0, sizeof(float) * 16);
+    for (int u = 0; u < n; u++) {
+        double alpha = (u == 0) ? sqrt(1.0 / n) : sqrt(2.0 / n);
+        for (int x = 0; x < n; x++) {
+            R[u][x] = (float)(alpha * sqrt(n / 8.0) * cos((2 * x + 1) * u * M_PI / (2.0 * n)));
+        }
+    }
+}
+
+void inverseDCTReduced(float R[4][4], int n, float Dctfrequencies[4][4], float block[4][4]) {
+    /*
+     * IDCT reduzida de n x n pontos: block = R^T * Dctfrequencies * R, com a matriz de
+     * precomputeReducedTransformation e só os coeficientes (u, v) com u e v menores que n.
+     *
+     * Parâmetros:
+     * R: matriz da DCT de n pontos
+     * n: número de pontos (2 ou 4)
+     * Dctfrequencies: canto n x n dos coeficientes da DCT 8x8, já dequantizados (entrada)
+     * block: bloco n x n no domínio espacial (saída)
+     */
+    float temp[4][4];
+    for (int u = 0; u < n; u++) { // temp = Dctfrequencies * R
+        for (int x = 0; x < n; x++) {
+            float sum = 0;
+            for (int v = 0; v < n; v++) {
+                sum += Dctfrequencies[u][v] * R[v][x];
+            }
+            temp[u][x] = sum;
+        }
+    }
+    for (int y = 0; y < n; y++) { // block = R^T * temp
+        for (int x = 0; x < n; x++) {
+            float sum = 0;
+            for (int u = 0; u < n; u++) {
+                sum += R[u][y] * temp[u][x];
+            }
+            block[y][x] = sum;
+        }
+    }
+}
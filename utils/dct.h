@@ -9,6 +9,12 @@
     void precomputeTransformation(float C[8][8]);
     void forwardDCTMatrix(float block[8][8], float Dctfrequencies[8][8]);
     void inverseDCTMatrix(float Dctfrequencies[8][8], float block[8][8]);
+    void forwardDCTWithMatrix(float C[8][8], float block[8][8], float Dctfrequencies[8][8]);
+    void forwardDCTWithMatrixPruned(float C[8][8], float block[8][8], float Dctfrequencies[8][8], int last_diagonal);
+    float forwardDCTFlatDC(float C[8][8], float value);
+    void inverseDCTWithMatrix(float C[8][8], float Dctfrequencies[8][8], float block[8][8]);
+    void precomputeReducedTransformation(float R[4][4], int n);
+    void inverseDCTReduced(float R[4][4], int n, float Dctfrequencies[4][4], float block[4][4]);
     void MatrixMulFirstTransp(float A[8][8], float B[8][8], float Dest[8][8]);
     void MatrixMulSecTransp(float A[8][8], float B[8][8], float Dest[8][8]);
 
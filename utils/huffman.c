@@ -43,6 +43,17 @@ void free_bit_buffer(BitBuffer* buffer) {
     }
 }
 
+void reset_bit_buffer(BitBuffer* buffer) {
+    /* Esvazia um buffer de bits para reaproveitá-lo, mantendo a memória alocada.
+     * Os bytes antigos não precisam ser zerados: write_bits sobrescreve cada byte novo.
+     *
+     * Parâmetros:
+     * buffer: ponteiro para o buffer a ser esvaziado
+    */
+    buffer->byte_position = 0;
+    buffer->bit_position = 0;
+}
+
 static int ensure_capacity(BitBuffer* buffer, size_t additional_bits) {
     /* Garante que o buffer tem espaço suficiente para escrever mais bits.
      * Se necessário, aumenta a capacidade do buffer.
@@ -89,48 +100,27 @@ int write_bits(BitBuffer* buffer, int value, int num_bits) {
     // Garante que ha espaço suficiente
     if (!ensure_capacity(buffer, num_bits)) return 0;
     
-    // Escreve os bits um a um, começando pelo MSB (bit mais significativo)
-    for (int i = num_bits - 1; i >= 0; i--) {
-        // Extrai o bit na posição i
-        int bit = (value >> i) & 1;
-        /* 
-         * Para extrair o bit na posição i:
-         * 1. (value >> i) - Desloca para direita até o bit i ficar na posição 0
-         * 2. & 1 - Mascara todos os bits exceto o menos significativo
-         * 
-         * Ex: Para value=13 (1101 binário) e i=2:
-         *     1101 >> 2 = 11 (o bit na posição 2 está agora na posição 0)
-         *     11 & 1 = 1 (extraímos o bit)
+    // Escreve os bits em pedaços que cabem no byte atual, começando pelo MSB (bit mais significativo)
+    while (num_bits > 0) {
+        int free_bits = 8 - buffer->bit_position;
+        int chunk = num_bits < free_bits ? num_bits : free_bits;
+        num_bits -= chunk;
+
+        /*
+         * Os 'chunk' bits mais significativos que faltam escrever vão para as posições livres mais
+         * à esquerda do byte atual. Um byte novo é sobrescrito (com zeros nos bits livres) e os
+         * pedaços seguintes são ligados com OR sem afetar os bits já escritos, então a memória
+         * do buffer não precisa começar zerada.
+         *
+         * Ex: escrever 101 (num_bits = 3) com bit_position = 6 (2 bits livres):
+         *     primeiro pedaço: 10 -> byte |= 00000010, o byte está completo
+         *     segundo pedaço:  1  -> próximo byte = 10000000
          */
-        
-        // Define o bit na posição atual do buffer
-        if (bit) {
-            buffer->data[buffer->byte_position] |= (1 << (7 - buffer->bit_position));
-            /*
-             * Aqui estamos fazendo o inverso da leitura:
-             * 1. Criamos uma máscara com 1 bit na posição correta: (1 << (7 - bit_position))
-             * 2. Aplicamos OR para ligar esse bit específico sem afetar os outros
-             * 
-             * Exemplo
-             * 
-             * Escrever o bit 1 na posição bit_position = 3 do byte que atualmente tem o valor 01000010
-             * 
-             * 1. Criamos a máscara:
-             *    (1 << (7 - 3)) = (1 << 4) = 00010000 
-             * 
-             * 2. Aplicamos OR entre o byte atual e a máscara:
-             *    01000010 (byte atual) | 00010000 (máscara)
-             *  = 01010010
-             * 
-             * 3. O bit específico na posição 3 foi ligado sem modificar os outros bits.
-             *    
-             *    Antes:    0 1 0  0  0 0 1 0
-             *    Depois:   0 1 0 (1) 0 0 1 0
-             */
-        }
-        
-        // Avanca para o proximo bit
-        buffer->bit_position++;
+        int bits = (value >> num_bits) & ((1 << chunk) - 1);
+        uint8_t shifted = (uint8_t)(bits << (free_bits - chunk));
+        if (buffer->bit_position == 0) buffer->data[buffer->byte_position] = shifted;
+        else buffer->data[buffer->byte_position] |= shifted;
+        buffer->bit_position += chunk;
         
         // Se completou um byte, avança para o proximo
         if (buffer->bit_position == 8) {
@@ -152,244 +142,259 @@ int write_dc_coefficient(BitBuffer* buffer, int dc_diff) {
      *
      * Retorna 1 se a escrita foi bem-sucedida, 0 em caso de erro.
     */
-    // Clamp DC value to category 12 range if it exceeds it
-    int original_dc = dc_diff;
-    if (dc_diff > 4095) {
-        dc_diff = 4095;
-        printf("AVISO: DC coeficiente %d clamped para %d (limite categoria 12)\n", original_dc, dc_diff);
-    } else if (dc_diff < -4095) {
-        dc_diff = -4095;
-        printf("AVISO: DC coeficiente %d clamped para %d (limite categoria 12)\n", original_dc, dc_diff);
-    }
+    // Limita a diferença à categoria 12, a maior da tabela DC
+    if (dc_diff > 4095) dc_diff = 4095;
+    else if (dc_diff < -4095) dc_diff = -4095;
     
     // Determina a categoria do coeficiente
     int category = get_coefficient_category(dc_diff);
     
-    // Debug: verifica se a categoria está dentro dos limites
-    if (category > 12) {
-        printf("ERRO: DC coeficiente %d ainda excede categoria 12 após clamp (categoria calculada: %d)\n", dc_diff, category);
-        return 0;  // Erro crítico
-    }
-    
     // Obtém o código Huffman para esta categoria
     const HuffmanEntry* entry = &JPEG_DC_LUMINANCE_TABLE[category];
     
-    // Escreve o prefixo Huffman para a categoria
-    if (!write_bits(buffer, entry->code_value, entry->code_length)) {
-        printf("Erro ao escrever prefixo Huffman para DC categoria %d\n", category);
-        return 0;
-    }
+    // Escreve o prefixo Huffman seguido do valor codificado na categoria (nenhum bit na categoria 0)
+    // em uma única escrita: no máximo 9 + 12 bits
+    int encoded_value = category > 0 ? get_coefficient_code(dc_diff, category) : 0;
+    if (!write_bits(buffer, (entry->code_value << category) | encoded_value, entry->code_length + category)) return 0;
     
-    // Se categoria não for zero, precisa escrever o valor
-    if (category > 0) {
-        // Codifica o valor de acordo com a categoria
-        int encoded_value = get_coefficient_code(dc_diff, category);
-        
-        // Escreve o valor codificado
-        if (!write_bits(buffer, encoded_value, category)) { // Retorna 0 se falhar
-            printf("Erro ao escrever valor codificado %d para DC categoria %d\n", encoded_value, category);
-            return 0;
+    return 1;
+}
+
+static uint32_t ac_emit_entry(int run_length, int ac_value) {
+    // Entrada da tabela de emissão para o par (run_length, ac_value): código de (run, categoria) seguido
+    // dos bits do valor, com o comprimento total nos bits de baixo; zero se o par não tem código
+    int category = get_coefficient_category(ac_value);
+    const HuffmanEntry* entry = &JPEG_AC_LUMINANCE_MATRIX[run_length][category];
+    if (entry->code_length == 0) return 0;
+    uint32_t bits = (uint32_t)entry->code_value << category;
+    if (category > 0) bits |= (uint32_t)get_coefficient_code(ac_value, category);
+    return (bits << AC_EMIT_LENGTH_BITS) | (uint32_t)(entry->code_length + category);
+}
+
+void build_huffman_encode_tables(HUFFMAN_ENCODE_TABLES* tables) {
+    /* Monta a tabela de emissão dos pares AC a partir da tabela AC do padrão. O valor zero só tem
+     * código nas carreiras 0 (EOB) e 15 (ZRL). Basta montar uma vez; depois ela só é lida,
+     * inclusive por várias threads.
+     *
+     * Parâmetros:
+     * tables: tabelas a serem preenchidas
+    */
+    for (int run = 0; run < 16; run++) {
+        for (int value = -AC_EMIT_MAX_VALUE; value <= AC_EMIT_MAX_VALUE; value++) {
+            tables->ac[run][value + AC_EMIT_MAX_VALUE] = ac_emit_entry(run, value);
         }
     }
-    
-    return 1;
 }
 
-int write_ac_coefficient(BitBuffer* buffer, int run_length, int ac_value) {
+static int write_ac_symbol(BitBuffer* buffer, int run_length, int ac_value, const HUFFMAN_ENCODE_TABLES* tables) {
+    // Um símbolo AC com uma leitura da tabela e uma escrita; write_bits rejeita o comprimento zero dos pares sem código
+    uint32_t entry = tables ? tables->ac[run_length][ac_value + AC_EMIT_MAX_VALUE] : ac_emit_entry(run_length, ac_value);
+    return write_bits(buffer, (int)(entry >> AC_EMIT_LENGTH_BITS), (int)(entry & ((1u << AC_EMIT_LENGTH_BITS) - 1)));
+}
+
+int write_ac_coefficient(BitBuffer* buffer, int run_length, int ac_value, const HUFFMAN_ENCODE_TABLES* tables) {
     /* Escreve um coeficiente AC no buffer usando codificação Huffman.
-     * O coeficiente é representado por um par (run_length, ac_value).
+     * O coeficiente é representado por um par (run_length, ac_value); (0, 0) é o EOB e (15, 0) o ZRL.
+     * Cada 16 zeros de run_length acima de 15 viram um ZRL antes do par.
      *
      * Parâmetros:
      * buffer: ponteiro para o buffer de bits
      * run_length: número de zeros antes do valor AC
-     * ac_value: valor do coeficiente AC a ser escrito
+     * ac_value: valor do coeficiente AC a ser escrito (de -AC_EMIT_MAX_VALUE a AC_EMIT_MAX_VALUE)
+     * tables: tabela de emissão (build_huffman_encode_tables), ou NULL para montar cada símbolo na hora
      *
-     * Retorna 1 se a escrita foi bem-sucedida, 0 em caso de erro.
+     * Retorna 1 se a escrita foi bem-sucedida, 0 em caso de erro ou par sem código.
     */
-    // EOB - End of Block (0,0)
-    if (run_length == 0 && ac_value == 0) {
-        const HuffmanEntry* entry = &JPEG_AC_LUMINANCE_MATRIX[0][0];
-        if (!write_bits(buffer, entry->code_value, entry->code_length)) {
-            printf("Erro ao escrever EOB\n");
-            return 0;
-        }
-        return 1;
-    }
-    
-    // ZRL - Zero Run Length (15,0)
-    if (run_length == 15 && ac_value == 0) {
-        const HuffmanEntry* zrl = &JPEG_AC_LUMINANCE_MATRIX[15][0];
-        if (!write_bits(buffer, zrl->code_value, zrl->code_length)) {
-            printf("Erro ao escrever ZRL\n");
-            return 0;
-        }
-        return 1;
-    }
-    
-    // Se o ac_value é zero, mas não é EOB ou ZRL, é um erro/n existe na tabela fornecida
-    if (ac_value == 0) {
-        printf("Erro: Combinação inválida em JPEG RLE - run_length=%d, ac_value=0\n", run_length);
-        return 0;  // Combinação inválida em JPEG RLE
-    }
-    
-    // Trata sequências longas de zeros (>15) usando ZRL
-    while (run_length > 15) {
-        // ZRL - Zero Run Length (15,0)
-        const HuffmanEntry* zrl = &JPEG_AC_LUMINANCE_MATRIX[15][0];
-        if (!write_bits(buffer, zrl->code_value, zrl->code_length)) {
-            printf("Erro ao escrever ZRL durante run_length > 15\n");
-            return 0;
-        }
-        run_length -= 16;
-    }    // Clamp AC value to prevent excessive categories
-    int original_ac = ac_value;
-    if (ac_value > 1023) {
-        ac_value = 1023;  // Max for category 10
-        printf("AVISO: AC coeficiente %d clamped para %d (limite categoria 10)\n", original_ac, ac_value);
-    } else if (ac_value < -1023) {
-        ac_value = -1023;  // Min for category 10
-        printf("AVISO: AC coeficiente %d clamped para %d (limite categoria 10)\n", original_ac, ac_value);
-    }
-    
-    // Categoria do valor AC
-    int category = get_coefficient_category(ac_value);
-    if (category > 10) {
-        printf("AVISO: AC coeficiente %d excede categoria 10 (categoria calculada: %d). Limitando.\n", ac_value, category);
-        category = 10;  // Limita a tabela disponível
-    }
-    
-    // Verifica se run_length está dentro dos limites da tabela
-    if (run_length > 15) {
-        printf("Erro: run_length %d excede limite da tabela AC (máximo 15)\n", run_length);
-        return 0;
-    }
-    
-    // Obtem o código Huffman para o par (run, category)
-    const HuffmanEntry* entry = &JPEG_AC_LUMINANCE_MATRIX[run_length][category];
-    
-    // Verifica se este par tem entrada na tabela
-    if (entry->code_length == 0) {
-        // Se categoria 11 não tem entrada para este run_length, tenta categoria 10
-        if (category == 11) {
-            printf("AVISO: Entrada AC (run=%d, cat=11) não disponível. Usando categoria 10 para AC valor %d.\n", run_length, ac_value);
-            category = 10;
-            entry = &JPEG_AC_LUMINANCE_MATRIX[run_length][category];
-            if (entry->code_length == 0) {
-                printf("Erro: Combinação inválida na tabela AC - run_length=%d, category=%d\n", run_length, category);
-                return 0;  // Combinação inválida
-            }
-        } else {
-            printf("Erro: Combinação inválida na tabela AC - run_length=%d, category=%d\n", run_length, category);
-            return 0;  // Combinação inválida
-        }
-    }
-    
-    // Escreve o prefixo Huffman para o par (run, category)
-    if (!write_bits(buffer, entry->code_value, entry->code_length)) {
-        printf("Erro ao escrever prefixo Huffman AC (run=%d, cat=%d)\n", run_length, category);
-        return 0;
-    }
-    
-    // Codifica o valor AC dentro da categoria
-    int encoded_value = get_coefficient_code(ac_value, category);
-    
-    // Escreve o valor codificado
-    if (!write_bits(buffer, encoded_value, category)) {
-        printf("Erro ao escrever valor AC codificado %d (categoria %d)\n", encoded_value, category);
-        return 0;
+    // A DCT de pixels de 8 bits não passa de AC_EMIT_MAX_VALUE nos coeficientes AC, mesmo com passo 1
+    if (run_length < 0 || ac_value < -AC_EMIT_MAX_VALUE || ac_value > AC_EMIT_MAX_VALUE) return 0;
+    if (ac_value == 0 && run_length > 15) return 0;
+
+    for (; run_length > 15; run_length -= 16) {
+        if (!write_ac_symbol(buffer, 15, 0, tables)) return 0;
     }
-    
-    return 1;
+    return write_ac_symbol(buffer, run_length, ac_value, tables);
 }
 
-int huffman_encode_block(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block) {
+int huffman_encode_block(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block, const HUFFMAN_ENCODE_TABLES* tables) {
     /* Codifica um bloco RLE diferencial usando Huffman.
-     * Codifica o coeficiente DC e os pares AC (zeros, valor).
+     * Codifica o coeficiente DC, os pares AC (zeros, valor) e o EOB. Cada carreira de zeros é a
+     * distância entre dois bits seguidos da máscara do bloco.
      *
      * Parâmetros:
      * buffer: ponteiro para o buffer de bits onde os dados serão escritos
      * block: ponteiro para o bloco a ser codificado
+     * tables: tabela de emissão dos pares AC (build_huffman_encode_tables), ou NULL
      *
      * Retorna 1 se a codificação foi bem-sucedida, 0 em caso de erro.
     */
     // Codifica o coeficiente DC
-    if (!write_dc_coefficient(buffer, block->coeficiente_dc)) {
-        printf("Erro ao codificar DC: %d\n", block->coeficiente_dc);
-        return 0;
-    }
+    if (!write_dc_coefficient(buffer, block->coeficiente_dc)) return 0;
     
     // Codifica os pares AC (zeros, valor)
-    for (int i = 0; i < block->quantidade; i++) {
-        int zeros = block->pares[i].zeros;
-        int valor = block->pares[i].valor;
-        
-        // Se temos o par (0,0), é um EOB
-        if (block->pares[i].zeros == 0 && block->pares[i].valor == 0) {
-            if (!write_ac_coefficient(buffer, 0, 0)) {
-                printf("Erro ao codificar EOB\n");
-                return 0;
-            }
-            return 1;
-        }
-        
-        // Codifica o par AC
-        if (!write_ac_coefficient(buffer, zeros, valor)) {
-            printf("Erro ao codificar AC[%d]: zeros=%d, valor=%d\n", i, zeros, valor);
-            return 0;
-        }
+    uint64_t mask = block->mascara;
+    int last_position = 0;
+    for (int i = 0; mask; i++) {
+        int position = __builtin_ctzll(mask);
+        int zeros = position - last_position - 1;
+        int valor = block->valores[i];
+        if (!write_ac_coefficient(buffer, zeros, valor, tables)) return 0;
+        last_position = position;
+        mask &= mask - 1;
     }
     
-    // Se não terminou com EOB explícito, adiciona um
-    if (block->quantidade == 0 || 
-        !(block->pares[block->quantidade-1].zeros == 0 && 
-          block->pares[block->quantidade-1].valor == 0)) {
-        if (!write_ac_coefficient(buffer, 0, 0)) {
-            printf("Erro ao adicionar EOB final\n");
-            return 0;
-        }
-    }
+    // Todo bloco termina com EOB
+    if (!write_ac_coefficient(buffer, 0, 0, tables)) return 0;
     
     return 1;
 }
 
-BitBuffer* huffman_encode_macroblock(MACROBLOCO_RLE_DIFERENCIAL* macroblock) {
-    /* Codifica um macrobloco RLE diferencial usando Huffman.
-     * Codifica os blocos Y (luminância) e os blocos Cb e Cr (crominância).
+// Códigos dos padrões de blocos codificados mais comuns nas imagens de teste (todos os blocos, nenhum,
+// só os Y, todos menos Cr, todos menos Cb); os demais padrões usam o escape 0000 seguido dos 6 bits
+static const int cbp_common_patterns[5] = {CBP_ALL_CODED, 0x00, 0x3C, 0x3E, 0x3D};
+static const int cbp_common_codes[5] = {0x1, 0x1, 0x3, 0x2, 0x1};
+static const int cbp_common_lengths[5] = {1, 2, 4, 4, 4};
+#define CBP_ESCAPE_LENGTH 4
+
+static int block_is_coded(const BLOCO_RLE_DIFERENCIAL* block) {
+    // Um bloco só precisa ser gravado se tem diferença DC ou algum coeficiente AC
+    return block->coeficiente_dc != 0 || block->mascara != 0;
+}
+
+int coded_block_pattern(const MACROBLOCO_RLE_DIFERENCIAL* macroblock) {
+    /* Calcula o padrão de blocos codificados (CBP) de um macrobloco com o DC já diferencial:
+     * bit 5 a bit 2 para Y0 a Y3, bit 1 para Cb e bit 0 para Cr.
+     *
+     * Parâmetros:
+     * macroblock: ponteiro para o macrobloco
+    */
+    int pattern = 0;
+    for (int i = 0; i < 4; i++) {
+        pattern = (pattern << 1) | block_is_coded(&macroblock->Y_vetor[i]);
+    }
+    pattern = (pattern << 1) | block_is_coded(&macroblock->Cb_vetor);
+    return (pattern << 1) | block_is_coded(&macroblock->Cr_vetor);
+}
+
+static int cbp_code_length(int pattern) {
+    // Bits que o código do padrão ocupa no arquivo
+    for (int i = 0; i < 5; i++) {
+        if (cbp_common_patterns[i] == pattern) return cbp_common_lengths[i];
+    }
+    return CBP_ESCAPE_LENGTH + 6;
+}
+
+static int write_coded_block_pattern(BitBuffer* buffer, int pattern) {
+    // Escreve o código do padrão de blocos codificados (um dos códigos comuns ou escape + 6 bits)
+    for (int i = 0; i < 5; i++) {
+        if (cbp_common_patterns[i] == pattern) return write_bits(buffer, cbp_common_codes[i], cbp_common_lengths[i]);
+    }
+    return write_bits(buffer, pattern, CBP_ESCAPE_LENGTH + 6);
+}
+
+static int read_coded_block_pattern(BitBuffer* buffer) {
+    // Lê um código de padrão de blocos codificados; retorna o padrão ou -1 se o buffer acabar
+    int code = 0;
+    for (int length = 1; length <= CBP_ESCAPE_LENGTH; length++) {
+        int bit = read_bits(buffer, 1);
+        if (bit < 0) return -1;
+        code = (code << 1) | bit;
+        for (int i = 0; i < 5; i++) {
+            if (cbp_common_lengths[i] == length && cbp_common_codes[i] == code) return cbp_common_patterns[i];
+        }
+    }
+    return read_bits(buffer, 6); // Escape: o padrão vem nos 6 bits seguintes
+}
+
+int huffman_encode_macroblock_into(BitBuffer* buffer, MACROBLOCO_RLE_DIFERENCIAL* macroblock, int adaptive, int cbp, const HUFFMAN_ENCODE_TABLES* tables) {
+    /* Codifica um macrobloco RLE diferencial usando Huffman em um buffer já existente,
+     * que é esvaziado antes. O buffer só é realocado se o macrobloco não couber nele.
      *
      * Parâmetros:
+     * buffer: ponteiro para o buffer de bits a ser reaproveitado
      * macroblock: ponteiro para o macrobloco a ser codificado
+     * adaptive: 1 para gravar antes dos blocos o nível da quantização adaptativa (FORMAT_FLAG_ADAPTIVE)
+     * cbp: 1 para gravar o padrão de blocos codificados e omitir os blocos vazios (FORMAT_FLAG_CBP)
+     * tables: tabela de emissão dos pares AC (build_huffman_encode_tables), ou NULL
      *
-     * Retorna um ponteiro para o buffer de bits contendo os dados codificados,
-     * ou NULL em caso de erro.
+     * Retorna 1 se a codificação foi bem-sucedida, 0 em caso de erro.
     */
-    // Inicializa o buffer com um tamanho razoável
-    BitBuffer* buffer = init_bit_buffer(1024);
-    if (!buffer) return NULL;
-    
+    reset_bit_buffer(buffer);
+    if (adaptive && !write_bits(buffer, macroblock->nivel, ADAPTIVE_LEVEL_BITS)) return 0;
+    int pattern = cbp ? coded_block_pattern(macroblock) : CBP_ALL_CODED;
+    if (cbp && !write_coded_block_pattern(buffer, pattern)) return 0;
+
     // Codifica os blocos Y (luminância)
     for (int i = 0; i < 4; i++) {
-        if (!huffman_encode_block(buffer, &macroblock->Y_vetor[i])) {
-            printf("Erro ao codificar bloco Y[%d]. DC: %d\n", i, macroblock->Y_vetor[i].coeficiente_dc);
-            free_bit_buffer(buffer);
-            return NULL;
-        }
+        if (!(pattern & (0x20 >> i))) continue;
+        if (!huffman_encode_block(buffer, &macroblock->Y_vetor[i], tables)) return 0;
     }
     
     // Codifica o bloco Cb (crominância azul)
-    if (!huffman_encode_block(buffer, &macroblock->Cb_vetor)) {
-        printf("Erro ao codificar bloco Cb. DC: %d\n", macroblock->Cb_vetor.coeficiente_dc);
-        free_bit_buffer(buffer);
-        return NULL;
-    }
+    if ((pattern & 0x2) && !huffman_encode_block(buffer, &macroblock->Cb_vetor, tables)) return 0;
     
     // Codifica o bloco Cr (crominância vermelha)
-    if (!huffman_encode_block(buffer, &macroblock->Cr_vetor)) {
-        printf("Erro ao codificar bloco Cr. DC: %d\n", macroblock->Cr_vetor.coeficiente_dc);
-        free_bit_buffer(buffer);
-        return NULL;
-    }
+    if ((pattern & 0x1) && !huffman_encode_block(buffer, &macroblock->Cr_vetor, tables)) return 0;
     
-    return buffer;
+    return 1;
+}
+
+static size_t count_ac_bits(int run_length, int ac_value) {
+    // Bits que write_ac_coefficient escreveria para o par (run_length, ac_value)
+    if (ac_value == 0) {
+        if (run_length == 0) return JPEG_AC_LUMINANCE_MATRIX[0][0].code_length;   // EOB
+        if (run_length == 15) return JPEG_AC_LUMINANCE_MATRIX[15][0].code_length; // ZRL
+        return 0; // Combinação inválida, que a codificação rejeita
+    }
+
+    size_t bits = 0;
+    while (run_length > 15) {
+        bits += JPEG_AC_LUMINANCE_MATRIX[15][0].code_length;
+        run_length -= 16;
+    }
+    if (ac_value > 1023) ac_value = 1023;
+    if (ac_value < -1023) ac_value = -1023;
+    int category = get_coefficient_category(ac_value);
+    return bits + JPEG_AC_LUMINANCE_MATRIX[run_length][category].code_length + category;
+}
+
+static size_t count_block_bits(const BLOCO_RLE_DIFERENCIAL* block) {
+    // Bits que huffman_encode_block escreveria para o bloco
+    int dc_diff = block->coeficiente_dc;
+    if (dc_diff > 4095) dc_diff = 4095;
+    if (dc_diff < -4095) dc_diff = -4095;
+    int category = get_coefficient_category(dc_diff);
+    size_t bits = JPEG_DC_LUMINANCE_TABLE[category].code_length + category;
+
+    uint64_t mask = block->mascara;
+    int last_position = 0;
+    for (int i = 0; mask; i++) {
+        int position = __builtin_ctzll(mask);
+        bits += count_ac_bits(position - last_position - 1, block->valores[i]);
+        last_position = position;
+        mask &= mask - 1;
+    }
+    return bits + JPEG_AC_LUMINANCE_MATRIX[0][0].code_length; // EOB
+}
+
+size_t huffman_macroblock_size(const MACROBLOCO_RLE_DIFERENCIAL* macroblock, int adaptive, int cbp) {
+    /* Calcula quantos bytes huffman_encode_macroblock_into produziria para o macrobloco,
+     * somando só os comprimentos dos códigos, sem escrever nenhum bit. Usado para estimar
+     * o tamanho do arquivo em várias qualidades antes de codificar de verdade.
+     *
+     * Parâmetros:
+     * macroblock: ponteiro para o macrobloco com o DC já diferencial
+     * adaptive: 1 se o nível da quantização adaptativa é gravado antes dos blocos
+     * cbp: 1 se o padrão de blocos codificados é gravado e os blocos vazios são omitidos
+    */
+    int pattern = cbp ? coded_block_pattern(macroblock) : CBP_ALL_CODED;
+    size_t bits = cbp ? (size_t)cbp_code_length(pattern) : 0;
+    if (pattern & 0x2) bits += count_block_bits(&macroblock->Cb_vetor);
+    if (pattern & 0x1) bits += count_block_bits(&macroblock->Cr_vetor);
+    if (adaptive) bits += ADAPTIVE_LEVEL_BITS;
+    for (int i = 0; i < 4; i++) {
+        if (pattern & (0x20 >> i)) bits += count_block_bits(&macroblock->Y_vetor[i]);
+    }
+    return (bits + 7) / 8;
 }
 
 size_t get_huffman_buffer_size(BitBuffer* buffer) {
@@ -461,12 +466,63 @@ int read_bits(BitBuffer* buffer, int num_bits) {
     return value;
 }
 
-int decode_dc_huffman(BitBuffer* buffer) {
+static void add_lookup_code(HUFFMAN_LOOKUP* lookup, int length, int code, int symbol) {
+    // Insere um código mantendo a ordem crescente; um código repetido mantém o primeiro símbolo,
+    // que é o mesmo que a busca linear nas tabelas encontraria
+    int n = lookup->count[length];
+    int pos = n;
+    while (pos > 0 && lookup->codes[length][pos - 1] >= code) {
+        if (lookup->codes[length][pos - 1] == code) return;
+        pos--;
+    }
+    memmove(&lookup->codes[length][pos + 1], &lookup->codes[length][pos], (n - pos) * sizeof(uint16_t));
+    memmove(&lookup->symbols[length][pos + 1], &lookup->symbols[length][pos], (n - pos) * sizeof(uint8_t));
+    lookup->codes[length][pos] = (uint16_t)code;
+    lookup->symbols[length][pos] = (uint8_t)symbol;
+    lookup->count[length] = n + 1;
+}
+
+static int find_lookup_code(const HUFFMAN_LOOKUP* lookup, int length, int code) {
+    // Busca binária entre os códigos de um comprimento; retorna o símbolo ou -1
+    int low = 0, high = lookup->count[length] - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        int value = lookup->codes[length][middle];
+        if (value == code) return lookup->symbols[length][middle];
+        if (value < code) low = middle + 1;
+        else high = middle - 1;
+    }
+    return -1;
+}
+
+void build_huffman_decode_tables(HUFFMAN_DECODE_TABLES* tables) {
+    /* Monta as tabelas de busca da decodificação a partir das tabelas DC e AC do padrão.
+     * Basta montar uma vez; depois elas só são lidas, inclusive por várias threads.
+     *
+     * Parâmetros:
+     * tables: tabelas a serem preenchidas
+    */
+    memset(tables, 0, sizeof(*tables));
+    for (int i = 0; i <= 12; i++) {
+        const HuffmanEntry* entry = &JPEG_DC_LUMINANCE_TABLE[i];
+        add_lookup_code(&tables->dc, entry->code_length, entry->code_value, i);
+    }
+    for (int run = 0; run < 16; run++) {
+        for (int cat = 0; cat < 11; cat++) {
+            const HuffmanEntry* entry = &JPEG_AC_LUMINANCE_MATRIX[run][cat];
+            if (entry->code_length == 0) continue; // Posição sem código na tabela
+            add_lookup_code(&tables->ac, entry->code_length, entry->code_value, run * 16 + cat);
+        }
+    }
+}
+
+int decode_dc_huffman(BitBuffer* buffer, const HUFFMAN_DECODE_TABLES* tables) {
     /* Decodifica um código Huffman para um coeficiente DC.
      * Retorna a categoria do coeficiente DC ou -1 em caso de erro.
      *
      * Parâmetros:
      * buffer: ponteiro para o buffer de bits onde os dados serão lidos
+     * tables: tabelas de busca (build_huffman_decode_tables), ou NULL para percorrer a tabela DC
     */
     int bits_read = 0;
     int current_code = 0;
@@ -490,6 +546,12 @@ int decode_dc_huffman(BitBuffer* buffer) {
          */
         bits_read++;
         
+        if (tables) {
+            int category = find_lookup_code(&tables->dc, bits_read, current_code);
+            if (category >= 0) return category;
+            continue;
+        }
+
         // Verifica se este código corresponde a uma categoria DC
         for (int i = 0; i <= 12; i++) {
             const HuffmanEntry* entry = &JPEG_DC_LUMINANCE_TABLE[i];
@@ -503,7 +565,7 @@ int decode_dc_huffman(BitBuffer* buffer) {
     return -1; // Código inválido - não encontrou nas tabelas ou excedeu comprimento máximo
 }
 
-int decode_ac_huffman(BitBuffer* buffer, int* run_length, int* category) {
+int decode_ac_huffman(BitBuffer* buffer, int* run_length, int* category, const HUFFMAN_DECODE_TABLES* tables) {
     /* Decodifica um código Huffman para um coeficiente AC.
      * Retorna 1 se encontrou um código válido, 0 se não encontrou,
      * ou -1 em caso de erro.
@@ -512,6 +574,7 @@ int decode_ac_huffman(BitBuffer* buffer, int* run_length, int* category) {
      * buffer: ponteiro para o buffer de bits onde os dados serão lidos
      * run_length: ponteiro para armazenar o comprimento do run (número de zeros)
      * category: ponteiro para armazenar a categoria do coeficiente AC
+     * tables: tabelas de busca (build_huffman_decode_tables), ou NULL para percorrer a tabela AC
     */
     int bits_read = 0;
     int current_code = 0;
@@ -534,6 +597,16 @@ int decode_ac_huffman(BitBuffer* buffer, int* run_length, int* category) {
          */
         bits_read++;
         
+        if (tables) {
+            int symbol = find_lookup_code(&tables->ac, bits_read, current_code);
+            if (symbol >= 0) {
+                *run_length = symbol / 16;
+                *category = symbol % 16;
+                return 1; // Sucesso
+            }
+            continue;
+        }
+
         // Procura na tabela AC
         for (int run = 0; run < 16; run++) {
             for (int cat = 0; cat < 11; cat++) {
@@ -551,16 +624,17 @@ int decode_ac_huffman(BitBuffer* buffer, int* run_length, int* category) {
     return 0; // Não encontrou
 }
 
-int decode_dc_coefficient(int* result_val, BitBuffer* buffer) {
+int decode_dc_coefficient(int* result_val, BitBuffer* buffer, const HUFFMAN_DECODE_TABLES* tables) {
     /* Decodifica um coeficiente DC a partir do buffer de bits.
      * Retorna 1 se a decodificação foi bem-sucedida, 0 em caso de erro.
      *
      * Parâmetros:
      * result_val: ponteiro para armazenar o valor decodificado
      * buffer: ponteiro para o buffer de bits onde os dados serão lidos
+     * tables: tabelas de busca, ou NULL para percorrer as tabelas do padrão
     */
     // Decodifica o símbolo Huffman para obter a categoria
-    int category = decode_dc_huffman(buffer);
+    int category = decode_dc_huffman(buffer, tables);
     if (category < 0) return 0; // Erro
 
     // Se for categoria 0, o valor é 0
@@ -578,7 +652,7 @@ int decode_dc_coefficient(int* result_val, BitBuffer* buffer) {
     return 1; // Sucesso
 }
 
-int decode_ac_coefficient(BitBuffer* buffer, int* run_length, int* value) {
+int decode_ac_coefficient(BitBuffer* buffer, int* run_length, int* value, const HUFFMAN_DECODE_TABLES* tables) {
     /* Decodifica um coeficiente AC a partir do buffer de bits.
      * Retorna 1 se a decodificação foi bem-sucedida, 0 em caso de erro,
      * 2 se encontrou EOB (End of Block), ou 3 se encontrou ZRL (Zero Run Length).
@@ -587,9 +661,10 @@ int decode_ac_coefficient(BitBuffer* buffer, int* run_length, int* value) {
      * buffer: ponteiro para o buffer de bits onde os dados serão lidos
      * run_length: ponteiro para armazenar o comprimento do run (número de zeros)
      * value: ponteiro para armazenar o valor do coeficiente AC decodificado
+     * tables: tabelas de busca, ou NULL para percorrer as tabelas do padrão
     */
     int category;
-    if (!decode_ac_huffman(buffer, run_length, &category)) {
+    if (!decode_ac_huffman(buffer, run_length, &category, tables)) {
         return 0; // Não encontrou código válido
     }
     
@@ -619,41 +694,38 @@ int decode_ac_coefficient(BitBuffer* buffer, int* run_length, int* value) {
     return 1; // Sucesso
 }
 
-int huffman_decode_block(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block) {
+int huffman_decode_block(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block, const HUFFMAN_DECODE_TABLES* tables) {
     /* Decodifica um bloco RLE diferencial usando Huffman.
-     * Decodifica o coeficiente DC e os pares AC (zeros, valor).
+     * Decodifica o coeficiente DC e os pares AC (zeros, valor), ligando na máscara do bloco a
+     * posição zigue-zague de cada valor não nulo. Valores depois da posição 63 (só em arquivos
+     * corrompidos) são lidos e descartados.
      *
      * Parâmetros:
      * buffer: ponteiro para o buffer de bits onde os dados serão lidos
      * block: ponteiro para o bloco a ser decodificado
+     * tables: tabelas de busca, ou NULL para percorrer as tabelas do padrão
      *
      * Retorna 1 se a decodificação foi bem-sucedida, 0 em caso de erro.
     */
     int dc;
-    if (!decode_dc_coefficient(&dc, buffer)) return 0;
+    if (!decode_dc_coefficient(&dc, buffer, tables)) return 0;
 
     block->coeficiente_dc = dc;
     block->quantidade = 0;
+    block->mascara = 0;
     
     // Decodifica coeficientes AC até encontrar EOB
     int pos = 0;
+    int position = 1; // Posição zigue-zague do próximo coeficiente AC
     while (pos < 63) { // Máximo de 63 coeficientes AC
         int run_length, value;
-        int result = decode_ac_coefficient(buffer, &run_length, &value);
+        int result = decode_ac_coefficient(buffer, &run_length, &value, tables);
           if (result == 0) return 0; // Erro
-        if (result == 2) {
-            // EOB encontrado - adiciona o marcador [0,0] ao bloco antes de sair
-            block->pares[block->quantidade].zeros = 0;
-            block->pares[block->quantidade].valor = 0;
-            block->quantidade++;
-            break;
-        }
-          // Para ZRL, adiciona o marcador [15,0] ao bloco e avança a posição
+        if (result == 2) break; // EOB encontrado
+          // Para ZRL, pula 16 zeros
         if (result == 3) {
-            block->pares[block->quantidade].zeros = 15;
-            block->pares[block->quantidade].valor = 0;
-            block->quantidade++;
             pos += 16;
+            position += 16;
             continue;
         }
         
@@ -661,147 +733,455 @@ int huffman_decode_block(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block) {
         pos += run_length;
         if (pos >= 63) break;
         
-        // Adiciona o par (run_length, value) ao bloco
-        block->pares[block->quantidade].zeros = run_length;
-        block->pares[block->quantidade].valor = value;
-        block->quantidade++;
+        position += run_length;
+        if (value != 0 && position <= 63) {
+            block->mascara |= (uint64_t)1 << position;
+            block->valores[block->quantidade++] = (int16_t)value;
+        }
+        position++;
     }
     
     return 1;
 }
 
-int huffman_decode_macroblock(BitBuffer* buffer, MACROBLOCO_RLE_DIFERENCIAL* dest_macroblock) {
+static int decode_block_dc_only(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block, const HUFFMAN_DECODE_TABLES* tables) {
+    // huffman_decode_block que só guarda o DC: os códigos AC são lidos da mesma forma, mas os seus bits
+    // adicionais são pulados sem reconstruir os valores, e o bloco fica sem coeficientes AC
+    int dc;
+    if (!decode_dc_coefficient(&dc, buffer, tables)) return 0;
+    block->coeficiente_dc = dc;
+    block->quantidade = 0;
+    block->mascara = 0;
+
+    int pos = 0;
+    while (pos < 63) {
+        int run_length, category;
+        if (decode_ac_huffman(buffer, &run_length, &category, tables) != 1) return 0;
+        if (run_length == 0 && category == 0) break; // EOB
+        if (run_length == 15 && category == 0) { // ZRL
+            pos += 16;
+            continue;
+        }
+        if (category > 0 && read_bits(buffer, category) < 0) return 0;
+        pos += run_length;
+    }
+    return 1;
+}
+
+static int decode_block_if_coded(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block, const HUFFMAN_DECODE_TABLES* tables, int coded, int dc_only) {
+    // Decodifica um bloco gravado, ou marca como vazio (diferença DC zero, sem AC) um bloco omitido pelo CBP
+    if (coded) return dc_only ? decode_block_dc_only(buffer, block, tables) : huffman_decode_block(buffer, block, tables);
+    block->coeficiente_dc = 0;
+    block->quantidade = 0;
+    block->mascara = 0;
+    return 1;
+}
+
+int huffman_decode_macroblock(BitBuffer* buffer, MACROBLOCO_RLE_DIFERENCIAL* dest_macroblock, const HUFFMAN_DECODE_TABLES* tables, int adaptive, int cbp, int dc_only) {
     /* Decodifica um macrobloco RLE diferencial usando Huffman.
      * Decodifica os blocos Y (luminância) e os blocos Cb e Cr (crominância).
      *
      * Parâmetros:
      * buffer: ponteiro para o buffer de bits onde os dados serão lidos
      * dest_macroblock: ponteiro para o macrobloco onde os dados decodificados serão armazenados
+     * tables: tabelas de busca, ou NULL para percorrer as tabelas do padrão
+     * adaptive: 1 se o macrobloco começa com o nível da quantização adaptativa (FORMAT_FLAG_ADAPTIVE)
+     * cbp: 1 se o macrobloco traz o padrão de blocos codificados (FORMAT_FLAG_CBP)
+     * dc_only: 1 para guardar só os coeficientes DC (os AC são lidos e descartados), como na
+     *          decodificação em 1/8 do tamanho
      *
      * Retorna 1 se a decodificação foi bem-sucedida, 0 em caso de erro.
     */
     if (!dest_macroblock) return 0;
+
+    dest_macroblock->nivel = ADAPTIVE_NEUTRAL_LEVEL;
+    if (adaptive) {
+        int level = read_bits(buffer, ADAPTIVE_LEVEL_BITS);
+        if (level < 0) return 0;
+        dest_macroblock->nivel = level;
+    }
+    int pattern = cbp ? read_coded_block_pattern(buffer) : CBP_ALL_CODED;
+    if (pattern < 0) return 0;
     
     // Decodifica os blocos Y (luminância)
     for (int i = 0; i < 4; i++) {
-        if (!huffman_decode_block(buffer, &dest_macroblock->Y_vetor[i])) return 0;
+        if (!decode_block_if_coded(buffer, &dest_macroblock->Y_vetor[i], tables, pattern & (0x20 >> i), dc_only)) return 0;
     }
     
     // Decodifica o bloco Cb (crominância azul)
-    if (!huffman_decode_block(buffer, &dest_macroblock->Cb_vetor)) return 0;
+    if (!decode_block_if_coded(buffer, &dest_macroblock->Cb_vetor, tables, pattern & 0x2, dc_only)) return 0;
     
     // Decodifica o bloco Cr (crominância vermelha)
-    if (!huffman_decode_block(buffer, &dest_macroblock->Cr_vetor)) return 0;
+    if (!decode_block_if_coded(buffer, &dest_macroblock->Cr_vetor, tables, pattern & 0x1, dc_only)) return 0;
     
     return 1;
 }
 
-void write_macroblocks_huffman(const char *output_filename, MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int macroblock_count, BITMAPFILEHEADER file_header, BITMAPINFOHEADER info_header, int quality) {
-    /* Escreve macroblocos RLE diferencial codificados com Huffman em um arquivo binário.
-     * O arquivo contém os headers do BMP, nossos headers e os dados comprimidos dos macroblocos.
+static size_t put_bytes(uint8_t *output, size_t position, const void *value, size_t size) {
+    // Copia um campo para a posição indicada e retorna a posição seguinte
+    memcpy(output + position, value, size);
+    return position + size;
+}
+
+static int get_bytes(const uint8_t *data, size_t size, size_t *position, void *value, size_t value_size) {
+    // Lê um campo da posição indicada, verificando se ele cabe nos dados
+    if (*position + value_size > size) return 0;
+    memcpy(value, data + *position, value_size);
+    *position += value_size;
+    return 1;
+}
+
+size_t serialize_compressed_header(const COMPRESSED_HEADER *header, uint8_t *output) {
+    /* Monta os headers do BMP e os nossos headers na memória, com o mesmo layout do arquivo.
+     * As flags de formato vão nos bits acima da qualidade, para manter o layout dos arquivos antigos.
+     * Retorna o número de bytes escritos (no máximo COMPRESSED_HEADER_MAX_SIZE).
      *
      * Parâmetros:
-     * output_filename: nome do arquivo de saída
-     * rle_macroblocks: ponteiro para o array de macroblocos a serem escritos
-     * macroblock_count: número de macroblocos a serem escritos
-     * file_header: header do arquivo BMP
-     * info_header: header de informações do BMP
-     * quality: qualidade da compressão (usada para identificar o tipo de compressão)
+     * header: header a ser escrito
+     * output: memória de destino
     */
-    // Abre o arquivo binário de saída
-    FILE *output_file = fopen(output_filename, "wb");
-    if (!output_file) {
-        printf("Erro ao abrir o arquivo %s para escrita", output_filename);
-        return;
+    const BITMAPFILEHEADER *file_header = &header->file_header;
+    const BITMAPINFOHEADER *info_header = &header->info_header;
+    size_t position = 0;
+
+    position = put_bytes(output, position, &file_header->Type, sizeof(file_header->Type));
+    position = put_bytes(output, position, &file_header->Size, sizeof(file_header->Size));
+    position = put_bytes(output, position, &file_header->Reserved1, sizeof(file_header->Reserved1));
+    position = put_bytes(output, position, &file_header->Reserved2, sizeof(file_header->Reserved2));
+    position = put_bytes(output, position, &file_header->OffBits, sizeof(file_header->OffBits));
+
+    position = put_bytes(output, position, &info_header->Size, sizeof(info_header->Size));
+    position = put_bytes(output, position, &info_header->Width, sizeof(info_header->Width));
+    position = put_bytes(output, position, &info_header->Height, sizeof(info_header->Height));
+    position = put_bytes(output, position, &info_header->Planes, sizeof(info_header->Planes));
+    position = put_bytes(output, position, &info_header->BitCount, sizeof(info_header->BitCount));
+    position = put_bytes(output, position, &info_header->Compression, sizeof(info_header->Compression));
+    position = put_bytes(output, position, &info_header->SizeImage, sizeof(info_header->SizeImage));
+    position = put_bytes(output, position, &info_header->XResolution, sizeof(info_header->XResolution));
+    position = put_bytes(output, position, &info_header->YResolution, sizeof(info_header->YResolution));
+    position = put_bytes(output, position, &info_header->NColours, sizeof(info_header->NColours));
+    position = put_bytes(output, position, &info_header->ImportantColours, sizeof(info_header->ImportantColours));
+
+    int quality_field = (header->quality & QUALITY_MASK) | header->flags;
+    position = put_bytes(output, position, &quality_field, sizeof(int));
+    position = put_bytes(output, position, &header->macroblock_count, sizeof(int));
+
+    // Campos das extensões, na ordem das flags
+    if (header->flags & FORMAT_FLAG_RESTART) {
+        position = put_bytes(output, position, &header->restart_interval, sizeof(int));
+    }
+    if (header->flags & FORMAT_FLAG_MATRICES) {
+        const int *values[2] = {&header->matrices.y[0][0], &header->matrices.chroma[0][0]};
+        for (int m = 0; m < 2; m++) {
+            for (int i = 0; i < 64; i++) {
+                uint16_t value = (uint16_t)values[m][i];
+                position = put_bytes(output, position, &value, sizeof(uint16_t));
+            }
+        }
+    }
+    return position;
+}
+
+size_t parse_compressed_header(const uint8_t *data, size_t size, COMPRESSED_HEADER *header) {
+    /* Lê os headers do início de um arquivo comprimido carregado na memória, separando a
+     * qualidade das flags de formato. Retorna o tamanho do header em bytes, ou 0 em caso de erro
+     * (incluindo qualidade fora de 1 a 100 e passos das matrizes gravadas fora de 1 a QUANT_STEP_MAX_VALUE).
+     *
+     * Parâmetros:
+     * data: início do arquivo comprimido
+     * size: número de bytes disponíveis em data
+     * header: header a ser preenchido
+    */
+    BITMAPFILEHEADER *file_header = &header->file_header;
+    BITMAPINFOHEADER *info_header = &header->info_header;
+    size_t position = 0;
+    int quality_field;
+
+    int ok = get_bytes(data, size, &position, &file_header->Type, sizeof(file_header->Type)) &&
+             get_bytes(data, size, &position, &file_header->Size, sizeof(file_header->Size)) &&
+             get_bytes(data, size, &position, &file_header->Reserved1, sizeof(file_header->Reserved1)) &&
+             get_bytes(data, size, &position, &file_header->Reserved2, sizeof(file_header->Reserved2)) &&
+             get_bytes(data, size, &position, &file_header->OffBits, sizeof(file_header->OffBits)) &&
+             get_bytes(data, size, &position, &info_header->Size, sizeof(info_header->Size)) &&
+             get_bytes(data, size, &position, &info_header->Width, sizeof(info_header->Width)) &&
+             get_bytes(data, size, &position, &info_header->Height, sizeof(info_header->Height)) &&
+             get_bytes(data, size, &position, &info_header->Planes, sizeof(info_header->Planes)) &&
+             get_bytes(data, size, &position, &info_header->BitCount, sizeof(info_header->BitCount)) &&
+             get_bytes(data, size, &position, &info_header->Compression, sizeof(info_header->Compression)) &&
+             get_bytes(data, size, &position, &info_header->SizeImage, sizeof(info_header->SizeImage)) &&
+             get_bytes(data, size, &position, &info_header->XResolution, sizeof(info_header->XResolution)) &&
+             get_bytes(data, size, &position, &info_header->YResolution, sizeof(info_header->YResolution)) &&
+             get_bytes(data, size, &position, &info_header->NColours, sizeof(info_header->NColours)) &&
+             get_bytes(data, size, &position, &info_header->ImportantColours, sizeof(info_header->ImportantColours)) &&
+             get_bytes(data, size, &position, &quality_field, sizeof(int)) &&
+             get_bytes(data, size, &position, &header->macroblock_count, sizeof(int));
+    if (!ok) return 0;
+
+    header->quality = quality_field & QUALITY_MASK;
+    header->flags = quality_field & ~QUALITY_MASK;
+    if (header->quality < 1 || header->quality > 100) return 0;
+
+    header->restart_interval = 0;
+    if (header->flags & FORMAT_FLAG_RESTART) {
+        if (!get_bytes(data, size, &position, &header->restart_interval, sizeof(int))) return 0;
+        if (header->restart_interval <= 0) return 0;
+    }
+    if (header->flags & FORMAT_FLAG_MATRICES) {
+        int *values[2] = {&header->matrices.y[0][0], &header->matrices.chroma[0][0]};
+        for (int m = 0; m < 2; m++) {
+            for (int i = 0; i < 64; i++) {
+                uint16_t value;
+                if (!get_bytes(data, size, &position, &value, sizeof(uint16_t))) return 0;
+                if (value == 0 || value > QUANT_STEP_MAX_VALUE) return 0;
+                values[m][i] = value;
+            }
+        }
     }
+    return position;
+}
 
-    // Escreve os headers do BMP
-    writeHeaders(output_file, file_header, info_header);
+void write_compressed_header(FILE *output_file, const COMPRESSED_HEADER *header) {
+    /* Escreve os headers do BMP e os nossos headers no início do arquivo comprimido.
+     *
+     * Parâmetros:
+     * output_file: arquivo de saída
+     * header: header a ser escrito
+    */
+    uint8_t data[COMPRESSED_HEADER_MAX_SIZE];
+    size_t size = serialize_compressed_header(header, data);
+    fseek(output_file, 0, SEEK_SET);
+    fwrite(data, sizeof(uint8_t), size, output_file);
+}
 
-    // Escreve nossos headers
-    fwrite(&quality, sizeof(int), 1, output_file);
-    fwrite(&macroblock_count, sizeof(int), 1, output_file);
-    
-    // Para cada macrobloco, codifica usando Huffman e escreve no arquivo
+static size_t encoded_macroblocks_size(BitBuffer **buffers, const COMPRESSED_HEADER *header, const MACROBLOCK_INDEX *index, size_t header_size) {
+    // Tamanho total do arquivo: header, macroblocos com seus tamanhos e índice
+    size_t total = header_size;
+    for (int i = 0; i < header->macroblock_count; i++) {
+        if (buffers[i]) total += sizeof(size_t) + get_huffman_buffer_size(buffers[i]);
+    }
+    if (index) total += serialize_macroblock_index(index, NULL);
+    return total;
+}
+
+int all_macroblocks_encoded(BitBuffer **buffers, int macroblock_count) {
+    /* Verifica se todos os macroblocos foram codificados (um buffer NULL indica falha na codificação).
+     * Retorna 1 se todos têm buffer, 0 caso contrário.
+     *
+     * Parâmetros:
+     * buffers: vetor com um buffer de bits por macrobloco
+     * macroblock_count: número de macroblocos
+    */
     for (int i = 0; i < macroblock_count; i++) {
-        BitBuffer *buffer = huffman_encode_macroblock(&rle_macroblocks[i]);
-        if (!buffer) {
-            printf("Erro ao codificar macrobloco %d com huffman.\n", i);
+        if (!buffers[i]) return 0;
+    }
+    return 1;
+}
+
+int serialize_encoded_macroblocks(BitBuffer **buffers, COMPRESSED_HEADER *header, MACROBLOCK_INDEX *index, uint8_t *output, size_t capacity, size_t *out_size) {
+    /* Monta na memória o arquivo comprimido completo a partir dos macroblocos já codificados com Huffman.
+     * Se index não for NULL, preenche as posições das entradas e grava o índice no fim.
+     * As flags do header são ajustadas de acordo com o índice e o intervalo de reinício.
+     * Retorna 1 em caso de sucesso e 0 em caso de erro; se a memória for pequena demais
+     * (ou output for NULL), nada é escrito e *out_size recebe o tamanho necessário.
+     *
+     * Parâmetros:
+     * buffers: vetor com um buffer de bits por macrobloco (NULL indica falha na codificação)
+     * header: headers do BMP, qualidade, número de macroblocos e intervalo de reinício
+     * index: índice com os preditores já preenchidos, ou NULL para não gravar índice
+     * output: memória de destino
+     * capacity: tamanho de output em bytes
+     * out_size: ponteiro para armazenar o tamanho do arquivo comprimido
+    */
+    set_format_flags(header, index != NULL);
+    uint8_t header_data[COMPRESSED_HEADER_MAX_SIZE];
+    size_t header_size = serialize_compressed_header(header, header_data);
+
+    *out_size = encoded_macroblocks_size(buffers, header, index, header_size);
+    if (!output || *out_size > capacity) return 0;
+
+    memcpy(output, header_data, header_size);
+    size_t position = header_size;
+    int mb_cols = (header->info_header.Width + 15) / 16;
+    int ok = 1;
+
+    for (int i = 0; i < header->macroblock_count; i++) {
+        // Guarda a posição das linhas de macroblocos que começam uma entrada do índice
+        if (index && i % (mb_cols * index->interval) == 0) {
+            index->entries[i / (mb_cols * index->interval)].offset = (int64_t)position;
+        }
+
+        if (!buffers[i]) {
+            ok = 0;
             continue;
         }
 
-        size_t buffer_size = get_huffman_buffer_size(buffer);
+        size_t buffer_size = get_huffman_buffer_size(buffers[i]);
+        position = put_bytes(output, position, &buffer_size, sizeof(size_t)); // Tamanho do buffer
+        position = put_bytes(output, position, buffers[i]->data, buffer_size); // Dados comprimidos
+    }
 
-        fwrite(&buffer_size, sizeof(size_t), 1, output_file); // Escreve o tamanho do buffer
-        fwrite(buffer->data, sizeof(uint8_t), buffer_size, output_file); // Escreve os dados comprimidos
-        
-        free_bit_buffer(buffer); // Libera o buffer após escrever
+    if (index) serialize_macroblock_index(index, output + position);
+    return ok;
+}
+
+int write_encoded_macroblocks(const char *output_filename, BitBuffer **buffers, COMPRESSED_HEADER *header, MACROBLOCK_INDEX *index) {
+    /* Escreve macroblocos já codificados com Huffman em um arquivo binário.
+     * Recebe os buffers prontos (por exemplo, codificados em paralelo). O arquivo é montado na memória com
+     * serialize_encoded_macroblocks e gravado de uma vez. Retorna 1 em caso de sucesso, 0 em caso de erro.
+     *
+     * Parâmetros:
+     * output_filename: nome do arquivo de saída
+     * buffers: vetor com um buffer de bits por macrobloco (NULL indica falha na codificação)
+     * header: headers do BMP, qualidade, número de macroblocos e intervalo de reinício
+     * index: índice com os preditores já preenchidos, ou NULL para não gravar índice
+    */
+    size_t size;
+    serialize_encoded_macroblocks(buffers, header, index, NULL, 0, &size);
+    uint8_t *data = (uint8_t *)malloc(size);
+    if (!data) {
+        printf("Erro ao alocar memória para o arquivo %s.\n", output_filename);
+        return 0;
+    }
+    int ok = serialize_encoded_macroblocks(buffers, header, index, data, size, &size);
+
+    FILE *output_file = fopen(output_filename, "wb");
+    if (!output_file) {
+        printf("Erro ao abrir o arquivo %s para escrita", output_filename);
+        free(data);
+        return 0;
     }
+    if (fwrite(data, sizeof(uint8_t), size, output_file) != size) ok = 0;
+    if (fclose(output_file) != 0) ok = 0;
+    if (!ok) printf("Erro ao gravar o arquivo %s.\n", output_filename);
 
-    fclose(output_file);
+    free(data);
+    return ok;
 }
 
-int read_macroblocks_huffman(const char *input_filename, MACROBLOCO_RLE_DIFERENCIAL **blocos_lidos, int *count_lido, BITMAPFILEHEADER *fhead, BITMAPINFOHEADER *ihead, int *quality_lida) {
-    /* Lê macroblocos RLE diferencial codificados com Huffman de um arquivo binário.
-     * O arquivo contém os headers do BMP, nossos headers e os dados comprimidos dos macroblocos.
+void set_format_flags(COMPRESSED_HEADER *header, int has_index) {
+    /* Ajusta as flags de formato do header de acordo com o índice e o intervalo de reinício.
      *
      * Parâmetros:
-     * input_filename: nome do arquivo de entrada
-     * blocos_lidos: ponteiro para armazenar o array de macroblocos lidos
-     * count_lido: ponteiro para armazenar o número de macroblocos lidos
-     * fhead: ponteiro para o header do arquivo BMP
-     * ihead: ponteiro para o header de informações do BMP
-     * quality_lida: ponteiro para armazenar a qualidade da compressão lida
+     * header: header a ser ajustado
+     * has_index: 1 se o arquivo terminará com um índice de macroblocos
+    */
+    header->flags &= ~(FORMAT_FLAG_INDEX | FORMAT_FLAG_RESTART);
+    if (has_index) header->flags |= FORMAT_FLAG_INDEX;
+    if (header->restart_interval > 0) header->flags |= FORMAT_FLAG_RESTART;
+}
+
+void set_header_matrices(COMPRESSED_HEADER *header, const CODEC_TABLES *tables) {
+    /* Copia para o header as matrizes de quantização efetivas das tabelas e liga FORMAT_FLAG_MATRICES,
+     * para que o descompressor use essas matrizes em vez de recalculá-las pela qualidade.
      *
-     * Retorna 1 se a leitura foi bem-sucedida, 0 em caso de erro.
+     * Parâmetros:
+     * header: header a ser ajustado
+     * tables: tabelas com as matrizes usadas na compressão
     */
-    // Abre o arquivo binário de entrada
-    FILE *input_file = fopen(input_filename, "rb");
-    if (!input_file) {
-        printf("Erro ao abrir o arquivo %s para leitura.\n", input_filename);
-        return 0;
+    get_codec_tables_matrices(tables, &header->matrices);
+    header->flags |= FORMAT_FLAG_MATRICES;
+}
+
+size_t write_macroblock_buffer(FILE *output_file, BitBuffer *buffer) {
+    /* Escreve um macrobloco codificado: o tamanho do buffer seguido dos dados comprimidos.
+     * Retorna o número de bytes ocupados no arquivo.
+     *
+     * Parâmetros:
+     * output_file: arquivo de saída
+     * buffer: buffer de bits do macrobloco
+    */
+    size_t buffer_size = get_huffman_buffer_size(buffer);
+
+    fwrite(&buffer_size, sizeof(size_t), 1, output_file); // Escreve o tamanho do buffer
+    fwrite(buffer->data, sizeof(uint8_t), buffer_size, output_file); // Escreve os dados comprimidos
+    return sizeof(size_t) + buffer_size;
+}
+
+size_t serialize_macroblock_index(const MACROBLOCK_INDEX *index, uint8_t *output) {
+    /* Monta o índice de macroblocos na memória: as entradas, seguidas do intervalo e do número de entradas.
+     * Retorna o tamanho do índice em bytes; com output NULL, só calcula o tamanho.
+     *
+     * Parâmetros:
+     * index: índice com posições e preditores preenchidos
+     * output: memória de destino, ou NULL
+    */
+    size_t size = index->count * (sizeof(int64_t) + 3 * sizeof(int)) + 2 * sizeof(int);
+    if (!output) return size;
+
+    size_t position = 0;
+    for (int i = 0; i < index->count; i++) {
+        position = put_bytes(output, position, &index->entries[i].offset, sizeof(int64_t));
+        position = put_bytes(output, position, index->entries[i].predictors, 3 * sizeof(int));
     }
+    position = put_bytes(output, position, &index->interval, sizeof(int));
+    put_bytes(output, position, &index->count, sizeof(int));
+    return size;
+}
 
-    // Lê o nosso header do arquivo binário
-    readHeader(input_file, fhead);
-    readInfoHeader(input_file, ihead);
-    fread(quality_lida, sizeof(int), 1, input_file);
-    fread(count_lido, sizeof(int), 1, input_file);
+void write_macroblock_index(FILE *output_file, const MACROBLOCK_INDEX *index) {
+    /* Escreve o índice de macroblocos no fim do arquivo, seguido do intervalo e do número de entradas.
+     *
+     * Parâmetros:
+     * output_file: arquivo de saída, posicionado depois do último macrobloco
+     * index: índice com posições e preditores preenchidos
+    */
+    for (int i = 0; i < index->count; i++) {
+        fwrite(&index->entries[i].offset, sizeof(int64_t), 1, output_file);
+        fwrite(index->entries[i].predictors, sizeof(int), 3, output_file);
+    }
+    fwrite(&index->interval, sizeof(int), 1, output_file);
+    fwrite(&index->count, sizeof(int), 1, output_file);
+}
 
-    // Aloca memória para os macroblocos que serão lidos
-    *blocos_lidos = (MACROBLOCO_RLE_DIFERENCIAL *)calloc((*count_lido), sizeof(MACROBLOCO_RLE_DIFERENCIAL));
-    if (!*blocos_lidos) {
-        printf("Erro ao alocar memória para os macroblocos.\n");
-        fclose(input_file);
-        return 0;
+int parse_macroblock_index(const uint8_t *data, size_t size, size_t data_start, MACROBLOCK_INDEX *index, int capacity) {
+    /* Lê o índice de macroblocos do fim de um arquivo com FORMAT_FLAG_INDEX carregado na memória.
+     * Retorna 1 se o índice foi lido, 0 em caso de erro. Um índice corrompido, com alguma entrada
+     * fora da área dos macroblocos ou com preditores fora da faixa dos DCs, também é recusado,
+     * e o decodificador volta a percorrer os tamanhos dos macroblocos como nos arquivos sem índice.
+     *
+     * Parâmetros:
+     * data: arquivo comprimido inteiro
+     * size: tamanho do arquivo em bytes
+     * data_start: posição do primeiro macrobloco (fim do header)
+     * index: índice a ser preenchido
+     * capacity: se maior que zero, index->entries já aponta para um vetor com capacity entradas
+     *           (índices maiores são recusados); se zero, entries é alocado aqui e deve ser liberado com free
+    */
+    const size_t entry_size = sizeof(int64_t) + 3 * sizeof(int);
+    if (capacity <= 0) index->entries = NULL;
+
+    if (size < 2 * sizeof(int)) return 0;
+    size_t position = size - 2 * sizeof(int);
+    get_bytes(data, size, &position, &index->interval, sizeof(int));
+    get_bytes(data, size, &position, &index->count, sizeof(int));
+    if (index->interval <= 0 || index->count <= 0) return 0;
+    if ((size - 2 * sizeof(int)) / entry_size < (size_t)index->count) return 0;
+
+    if (capacity > 0) {
+        if (index->count > capacity) return 0;
+    } else {
+        index->entries = (MACROBLOCK_INDEX_ENTRY *)calloc(index->count, sizeof(MACROBLOCK_INDEX_ENTRY));
+        if (!index->entries) return 0;
     }
 
-    // Lê e decodifica (huffman) todos os macroblocos
-    for (int i = 0; i < (*count_lido); i++) { // para cada macrobloco
-        size_t buffer_size;
-        if (fread(&buffer_size, sizeof(size_t), 1, input_file) != 1) {
-            printf("Erro fatal: Não foi possível ler o tamanho do macrobloco %d.\n", i);
-            free(*blocos_lidos);
-            fclose(input_file);
-            return 0;
+    size_t data_end = size - 2 * sizeof(int) - index->count * entry_size;
+    position = data_end;
+    for (int i = 0; i < index->count; i++) {
+        MACROBLOCK_INDEX_ENTRY *entry = &index->entries[i];
+        get_bytes(data, size, &position, &entry->offset, sizeof(int64_t));
+        get_bytes(data, size, &position, entry->predictors, 3 * sizeof(int));
+        int valid = entry->offset >= (int64_t)data_start && entry->offset < (int64_t)data_end;
+        for (int j = 0; j < 3; j++) {
+            if (entry->predictors[j] < -MAX_DC_COEFFICIENT || entry->predictors[j] > MAX_DC_COEFFICIENT) valid = 0;
         }
-
-        BitBuffer *buffer = init_bit_buffer(buffer_size);
-        if (fread(buffer->data, 1, buffer_size, input_file) != buffer_size) {
-            printf("Erro fatal: Não foi possível ler %d bytes de dados do macrobloco %llu.\n", i, (unsigned long long)buffer_size);
-            free_bit_buffer(buffer);
-            free(*blocos_lidos);
-            fclose(input_file);
+        if (!valid) {
+            if (capacity <= 0) {
+                free(index->entries);
+                index->entries = NULL;
+            }
             return 0;
         }
-
-        if (!huffman_decode_macroblock(buffer, &((*blocos_lidos)[i]))) {
-            printf("Erro: Falha ao decodificar o Huffman do macrobloco %d.\n", i);
-        }
-        free_bit_buffer(buffer);
     }
-
-    fclose(input_file);
     return 1;
 }
 
@@ -826,18 +1206,10 @@ int get_coefficient_category(int value) {
      * Retorna:
      * Categoria do coeficiente (0 a 11)
      */
-    if (value == 0) return 0;
-    
-    int abs_value = abs(value);
-    int category = 0;
-    int threshold = 1;
-    
-    while (abs_value >= threshold) { // Verifica se o valor absoluto é maior ou igual ao limite da categoria
-        category++;
-        threshold *= 2;
-    }
-    
-    return category;
+    // A categoria é o número de bits do valor absoluto, ou seja, a posição do bit mais alto mais um.
+    // O bit extra à direita faz o zero dar categoria 0 sem desvio (clz de 0 não é definido)
+    unsigned int abs_value = (unsigned int)abs(value);
+    return 31 - __builtin_clz((abs_value << 1) | 1);
 }
 
 int get_coefficient_code(int value, int category) {
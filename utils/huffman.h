@@ -9,14 +9,59 @@
     // Tamanho máximo do código Huffman no padrão JPEG (16 bits)
     #define MAX_HUFFMAN_CODE_LENGTH 16
     
+    // Flags de formato guardadas acima dos 8 bits da qualidade no arquivo comprimido.
+    // Arquivos antigos têm esses bits zerados, então continuam sendo lidos normalmente.
+    #define QUALITY_MASK 0xFF
+    #define FORMAT_FLAG_INDEX (1 << 8)   // Arquivo termina com um índice de macroblocos
+    #define FORMAT_FLAG_RESTART (1 << 9) // Preditores DC reiniciam a cada restart_interval macroblocos
+    #define FORMAT_FLAG_ADAPTIVE (1 << 10) // Cada macrobloco começa com o seu nível de quantização adaptativa
+    #define FORMAT_FLAG_MATRICES (1 << 11) // Header traz as matrizes de quantização efetivas (128 valores de 16 bits)
+    #define FORMAT_FLAG_CBP (1 << 12)      // Cada macrobloco traz o padrão de blocos codificados e omite os blocos vazios
+
+    // Padrão de blocos codificados (CBP): um bit por bloco do macrobloco, do mais significativo ao menos
+    // significativo Y0, Y1, Y2, Y3, Cb e Cr. Um bloco vazio (diferença DC zero e nenhum AC) fica com o bit
+    // desligado e não é gravado; o decodificador o reconstrói com o DC previsto
+    #define CBP_ALL_CODED 0x3F
+
+    // Maior módulo de um coeficiente DC absoluto (categoria 11): os pixels centralizados em -128..127
+    // dão DCs de -1024 a 1016 antes da quantização, e os passos de quantização são pelo menos 1
+    #define MAX_DC_COEFFICIENT 2047
+
+    // Pior caso de um macrobloco codificado: 64 coeficientes com código de 16 bits e mantissa de até 16 bits em cada um dos 6 blocos,
+    // mais um byte para o nível da quantização adaptativa e dois para o padrão de blocos codificados
+    #define MAX_MACROBLOCK_BYTES (6 * 64 * 32 / 8 + 3)
+
+    // Tamanho realista de um macrobloco codificado, usado para reservar os dados Huffman de cada faixa:
+    // nem ruído puro na qualidade 100 passa disso em média (as áreas crescem se uma imagem passar)
+    #define TYPICAL_MACROBLOCK_BYTES 512
+
+    // Maior header possível: headers do BMP (54 bytes), qualidade, número de macroblocos e extensões
+    #define COMPRESSED_HEADER_MAX_SIZE (54 + 3 * sizeof(int) + 128 * sizeof(uint16_t))
+
     // Estrutura para cabeçalho de arquivo BMP
     typedef struct {
         BITMAPFILEHEADER file_header;
         BITMAPINFOHEADER info_header;
         int quality;
         int macroblock_count;
+        int flags;                  // Extensões opcionais presentes no arquivo (FORMAT_FLAG_*)
+        int restart_interval;       // Macroblocos entre reinícios do preditor DC (0 = sem reinícios)
+        QUANT_MATRICES matrices;    // Matrizes de quantização efetivas (só com FORMAT_FLAG_MATRICES)
     } COMPRESSED_HEADER;
 
+    // Entrada do índice de macroblocos: permite começar a decodificar em uma linha de macroblocos
+    typedef struct {
+        int64_t offset;             // Posição no arquivo do primeiro macrobloco da linha
+        int predictors[3];          // DCs absolutos (Y, Cb, Cr) que precedem a linha
+    } MACROBLOCK_INDEX_ENTRY;
+
+    // Índice guardado no fim do arquivo, com uma entrada a cada 'interval' linhas de macroblocos
+    typedef struct {
+        int interval;
+        int count;
+        MACROBLOCK_INDEX_ENTRY *entries;
+    } MACROBLOCK_INDEX;
+
     // Estrutura para entrada da tabela Huffman
     typedef struct {
         char code[MAX_HUFFMAN_CODE_LENGTH + 1]; // Código binário como string
@@ -38,9 +83,34 @@
         int bit_position;            // Posição atual em bits (0-7)
     } BitBuffer;
 
+    // Códigos Huffman de uma tabela separados por comprimento e ordenados, para que a decodificação
+    // encontre o símbolo com uma busca binária em vez de percorrer a tabela inteira a cada bit lido
+    #define HUFFMAN_LOOKUP_SIZE (16 * 11)
+    typedef struct {
+        int count[MAX_HUFFMAN_CODE_LENGTH + 1];                             // Códigos de cada comprimento
+        uint16_t codes[MAX_HUFFMAN_CODE_LENGTH + 1][HUFFMAN_LOOKUP_SIZE];   // Códigos em ordem crescente
+        uint8_t symbols[MAX_HUFFMAN_CODE_LENGTH + 1][HUFFMAN_LOOKUP_SIZE];  // Categoria (DC) ou zeros * 16 + categoria (AC)
+    } HUFFMAN_LOOKUP;
+
+    // Tabelas de decodificação pré-calculadas (build_huffman_decode_tables), só lidas durante a decodificação
+    typedef struct {
+        HUFFMAN_LOOKUP dc;
+        HUFFMAN_LOOKUP ac;
+    } HUFFMAN_DECODE_TABLES;
+
+    // Tabela de emissão dos pares AC (build_huffman_encode_tables), só lida durante a codificação: para cada
+    // carreira de zeros e valor, o código Huffman seguido dos bits do valor, com o comprimento total nos
+    // AC_EMIT_LENGTH_BITS bits de baixo (comprimento zero indica um par sem código)
+    #define AC_EMIT_MAX_VALUE 1023  // Maior valor absoluto de um coeficiente AC (categoria 10)
+    #define AC_EMIT_LENGTH_BITS 5   // O maior símbolo tem 16 + 10 bits
+    typedef struct {
+        uint32_t ac[16][2 * AC_EMIT_MAX_VALUE + 1];
+    } HUFFMAN_ENCODE_TABLES;
+
     // Funções de manipulação de buffer
     BitBuffer* init_bit_buffer(size_t initial_capacity);
     void free_bit_buffer(BitBuffer* buffer);
+    void reset_bit_buffer(BitBuffer* buffer);
     int write_bits(BitBuffer* buffer, int value, int num_bits);
     int read_bits(BitBuffer* buffer, int num_bits);
     size_t get_huffman_buffer_size(BitBuffer* buffer);
@@ -52,21 +122,37 @@
 
     // Funções de codificação Huffman
     int write_dc_coefficient(BitBuffer* buffer, int dc_diff);
-    int write_ac_coefficient(BitBuffer* buffer, int run_length, int ac_value);
-    int huffman_encode_block(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block);
-    BitBuffer* huffman_encode_macroblock(MACROBLOCO_RLE_DIFERENCIAL* macroblock);
+    void build_huffman_encode_tables(HUFFMAN_ENCODE_TABLES* tables);
+    int write_ac_coefficient(BitBuffer* buffer, int run_length, int ac_value, const HUFFMAN_ENCODE_TABLES* tables);
+    int huffman_encode_block(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block, const HUFFMAN_ENCODE_TABLES* tables);
+    int coded_block_pattern(const MACROBLOCO_RLE_DIFERENCIAL* macroblock);
+    int huffman_encode_macroblock_into(BitBuffer* buffer, MACROBLOCO_RLE_DIFERENCIAL* macroblock, int adaptive, int cbp, const HUFFMAN_ENCODE_TABLES* tables);
+    size_t huffman_macroblock_size(const MACROBLOCO_RLE_DIFERENCIAL* macroblock, int adaptive, int cbp);
 
     // Funções de decodificação Huffman
-    int decode_dc_huffman(BitBuffer* buffer);
-    int decode_dc_coefficient(int* result_val, BitBuffer* buffer);
-    int decode_ac_huffman(BitBuffer* buffer, int* run_length, int* category);
-    int decode_ac_coefficient(BitBuffer* buffer, int* run_length, int* value);
-    int huffman_decode_block(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block);
-    int huffman_decode_macroblock(BitBuffer* buffer, MACROBLOCO_RLE_DIFERENCIAL* dest_macroblock);
+    void build_huffman_decode_tables(HUFFMAN_DECODE_TABLES* tables);
+    int decode_dc_huffman(BitBuffer* buffer, const HUFFMAN_DECODE_TABLES* tables);
+    int decode_dc_coefficient(int* result_val, BitBuffer* buffer, const HUFFMAN_DECODE_TABLES* tables);
+    int decode_ac_huffman(BitBuffer* buffer, int* run_length, int* category, const HUFFMAN_DECODE_TABLES* tables);
+    int decode_ac_coefficient(BitBuffer* buffer, int* run_length, int* value, const HUFFMAN_DECODE_TABLES* tables);
+    int huffman_decode_block(BitBuffer* buffer, BLOCO_RLE_DIFERENCIAL* block, const HUFFMAN_DECODE_TABLES* tables);
+    int huffman_decode_macroblock(BitBuffer* buffer, MACROBLOCO_RLE_DIFERENCIAL* dest_macroblock, const HUFFMAN_DECODE_TABLES* tables, int adaptive, int cbp, int dc_only);
 
     // Funções de leitura e escrita de macroblocos
-    void write_macroblocks_huffman(const char *output_filename, MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int macroblock_count, BITMAPFILEHEADER file_header, BITMAPINFOHEADER info_header, int quality);
-    int read_macroblocks_huffman(const char *input_filename, MACROBLOCO_RLE_DIFERENCIAL **blocos_lidos, int *count_lido, BITMAPFILEHEADER *fhead, BITMAPINFOHEADER *ihead, int *quality_lida);    // Tabela DC - Fornecida (expandida com categorias 11 e 12)
+    size_t serialize_compressed_header(const COMPRESSED_HEADER *header, uint8_t *output);
+    size_t parse_compressed_header(const uint8_t *data, size_t size, COMPRESSED_HEADER *header);
+    void write_compressed_header(FILE *output_file, const COMPRESSED_HEADER *header);
+    int all_macroblocks_encoded(BitBuffer **buffers, int macroblock_count);
+    int serialize_encoded_macroblocks(BitBuffer **buffers, COMPRESSED_HEADER *header, MACROBLOCK_INDEX *index, uint8_t *output, size_t capacity, size_t *out_size);
+    int write_encoded_macroblocks(const char *output_filename, BitBuffer **buffers, COMPRESSED_HEADER *header, MACROBLOCK_INDEX *index);
+    void set_format_flags(COMPRESSED_HEADER *header, int has_index);
+    void set_header_matrices(COMPRESSED_HEADER *header, const CODEC_TABLES *tables);
+    size_t write_macroblock_buffer(FILE *output_file, BitBuffer *buffer);
+    size_t serialize_macroblock_index(const MACROBLOCK_INDEX *index, uint8_t *output);
+    void write_macroblock_index(FILE *output_file, const MACROBLOCK_INDEX *index);
+    int parse_macroblock_index(const uint8_t *data, size_t size, size_t data_start, MACROBLOCK_INDEX *index, int capacity);
+
+    // Tabela DC - Fornecida (expandida com categorias 11 e 12)
     static const HuffmanEntry JPEG_DC_LUMINANCE_TABLE[13] = {
         // binario  | comprimento | valor(binario em hexadecimal)
         // Qtd. bits da mantissa é o mesmo da categoria
@@ -0,0 +1,179 @@
+/* Esse arquivo implementa a API em memória da libcodec (libcodec.h).
+ * As funções reaproveitam o mesmo pipeline do compressor e do descompressor
+ * (compress_image_parallel e decompress_image_memory), mas recebem e devolvem
+ * buffers fornecidos por quem chama, sem passar por arquivos.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "libcodec.h"
+#include "codec.h"
+#include "huffman.h"
+#include "parallel.h"
+
+static void read_options(const CODEC_OPTIONS *options, CODEC_OPTIONS *result) {
+    // Copia as opções, trocando campos zerados (ou options NULL) pelos valores padrão
+    memset(result, 0, sizeof(*result));
+    if (options) *result = *options;
+    if (result->quality == 0) result->quality = 50;
+    if (result->num_threads < 1) result->num_threads = 1;
+}
+
+size_t codec_max_encoded_size(int width, int height, const CODEC_OPTIONS *options) {
+    /*
+     * Retorna um limite superior para o tamanho do arquivo comprimido de uma imagem
+     * width x height, para dimensionar o buffer de codec_encode.
+     *
+     * Parâmetros:
+     * width, height: largura e altura da imagem
+     * options: opções de compressão (ou NULL para as padrão)
+     */
+    CODEC_OPTIONS opts;
+    read_options(options, &opts);
+
+    int mb_rows = (height + 15) / 16;
+    size_t macroblock_count = (size_t)((width + 15) / 16) * mb_rows;
+    size_t size = COMPRESSED_HEADER_MAX_SIZE + macroblock_count * (sizeof(size_t) + MAX_MACROBLOCK_BYTES);
+    if (opts.index_interval > 0) {
+        MACROBLOCK_INDEX index = {opts.index_interval, (mb_rows + opts.index_interval - 1) / opts.index_interval, NULL};
+        size += serialize_macroblock_index(&index, NULL);
+    }
+    return size;
+}
+
+int codec_encode(const PIXELRGB *pixels, int width, int height, const CODEC_OPTIONS *options, uint8_t *output, size_t capacity, size_t *out_size, ENCODER_CONTEXT *context) {
+    /*
+     * Comprime uma imagem RGB para a memória, no mesmo formato dos arquivos do compressor.
+     * Retorna CODEC_OK em caso de sucesso; CODEC_ERROR_INVALID_ARGUMENT para dimensões ou opções
+     * inválidas, CODEC_ERROR_OUT_OF_MEMORY, CODEC_ERROR_ENCODING ou, se output for pequeno demais,
+     * CODEC_ERROR_BUFFER_TOO_SMALL, sem escrever nada e com o tamanho necessário em *out_size.
+     *
+     * Parâmetros:
+     * pixels: width * height pixels RGB, linha por linha
+     * width, height: dimensões da imagem (quaisquer; as bordas dos macroblocos são preenchidas replicando a última linha e coluna)
+     * options: opções de compressão (ou NULL para as padrão)
+     * output: memória de destino
+     * capacity: tamanho de output em bytes (codec_max_encoded_size sempre basta)
+     * out_size: ponteiro para armazenar o tamanho do arquivo comprimido
+     * context: contexto do compressor reaproveitável, ou NULL para usar um temporário
+     */
+    CODEC_OPTIONS opts;
+    read_options(options, &opts);
+    *out_size = 0;
+
+    if (width <= 0 || height <= 0) return CODEC_ERROR_INVALID_ARGUMENT;
+    if (opts.quality < 1 || opts.quality > 100 || opts.effort < 0 || opts.effort > 1 || opts.adaptive < 0 || opts.adaptive > 1 || opts.cbp < 0 || opts.cbp > 1 || opts.restart_interval < 0 || opts.index_interval < 0) {
+        return CODEC_ERROR_INVALID_ARGUMENT;
+    }
+
+    ENCODER_CONTEXT local_context;
+    ENCODER_CONTEXT *ctx = context;
+    if (!ctx) {
+        init_encoder_context(&local_context);
+        ctx = &local_context;
+    }
+
+    int status = CODEC_ERROR_OUT_OF_MEMORY;
+    int macroblock_count = 0;
+    MACROBLOCK_INDEX index = {opts.index_interval, 0, NULL};
+    MACROBLOCK_INDEX *index_ptr = opts.index_interval > 0 ? &index : NULL;
+    BitBuffer **encoded_macroblocks = compress_image_parallel(pixels, width, height, &opts, index_ptr, &macroblock_count, ctx);
+    if (encoded_macroblocks) {
+        COMPRESSED_HEADER header;
+        memset(&header, 0, sizeof(header));
+        createBMPHeaders(width, height, &header.file_header, &header.info_header);
+        header.quality = opts.quality;
+        header.macroblock_count = macroblock_count;
+        header.restart_interval = opts.restart_interval;
+        header.flags = (opts.adaptive ? FORMAT_FLAG_ADAPTIVE : 0) | (opts.cbp ? FORMAT_FLAG_CBP : 0);
+        if (opts.matrices) set_header_matrices(&header, &ctx->tables);
+        if (!all_macroblocks_encoded(encoded_macroblocks, macroblock_count)) {
+            status = CODEC_ERROR_ENCODING;
+        } else if (serialize_encoded_macroblocks(encoded_macroblocks, &header, index_ptr, output, capacity, out_size)) {
+            status = CODEC_OK;
+        } else {
+            status = CODEC_ERROR_BUFFER_TOO_SMALL;
+        }
+    }
+
+    if (!context) free_encoder_context(&local_context);
+    return status;
+}
+
+int codec_read_info(const uint8_t *data, size_t size, int *width, int *height, int *quality) {
+    /*
+     * Lê as dimensões e a qualidade de um arquivo comprimido na memória, para dimensionar
+     * o buffer de codec_decode. Retorna 1 em caso de sucesso, 0 se o header for inválido.
+     *
+     * Parâmetros:
+     * data, size: arquivo comprimido e seu tamanho em bytes
+     * width, height, quality: ponteiros para armazenar os valores lidos (podem ser NULL)
+     */
+    COMPRESSED_HEADER header;
+    if (parse_compressed_header(data, size, &header) == 0) return 0;
+    if (header.info_header.Width <= 0 || header.info_header.Height <= 0) return 0;
+
+    if (width) *width = header.info_header.Width;
+    if (height) *height = header.info_header.Height;
+    if (quality) *quality = header.quality;
+    return 1;
+}
+
+int codec_scaled_size(int width, int height, int scale, int *scaled_width, int *scaled_height) {
+    /*
+     * Calcula as dimensões da imagem que codec_decode_scaled gera em 1/scale do tamanho
+     * (divisões arredondadas para cima). Retorna 1 em caso de sucesso, 0 se a escala não for aceita.
+     *
+     * Parâmetros:
+     * width, height: dimensões da imagem original (codec_read_info)
+     * scale: denominador da escala (1, 2, 4 ou 8)
+     * scaled_width, scaled_height: ponteiros para armazenar as dimensões reduzidas
+     */
+    if (!valid_decode_scale(scale)) return 0;
+    scaled_image_size(width, height, scale, scaled_width, scaled_height);
+    return 1;
+}
+
+int codec_decode(const uint8_t *data, size_t size, PIXELRGB *pixels, size_t pixel_capacity, int num_threads, DECODER_CONTEXT *context) {
+    /*
+     * Descomprime um arquivo comprimido na memória direto para o buffer de pixels de quem chama.
+     * Retorna os mesmos códigos de codec_decode_scaled.
+     *
+     * Parâmetros:
+     * data, size: arquivo comprimido e seu tamanho em bytes
+     * pixels: destino dos pixels RGB, linha por linha
+     * pixel_capacity: número de pixels que cabem em pixels (largura * altura basta)
+     * num_threads: threads usadas na chamada
+     * context: contexto do descompressor reaproveitável, ou NULL para usar um temporário
+     */
+    return codec_decode_scaled(data, size, 1, pixels, pixel_capacity, num_threads, context);
+}
+
+int codec_decode_scaled(const uint8_t *data, size_t size, int scale, PIXELRGB *pixels, size_t pixel_capacity, int num_threads, DECODER_CONTEXT *context) {
+    /*
+     * Como codec_decode, mas gera a imagem em 1/scale da largura e da altura (prévias e miniaturas).
+     * Com scale 2 e 4 cada bloco 8x8 passa por uma IDCT reduzida de 4x4 ou 2x2 pontos, e com scale 8
+     * vira um pixel calculado só do seu DC.
+     * Retorna CODEC_OK em caso de sucesso; CODEC_ERROR_INVALID_HEADER se o header não puder ser lido,
+     * CODEC_ERROR_INVALID_ARGUMENT para uma escala inválida, CODEC_ERROR_BUFFER_TOO_SMALL se pixels
+     * for pequeno demais, CODEC_ERROR_OUT_OF_MEMORY, ou CODEC_ERROR_DAMAGED_DATA se o arquivo estiver
+     * truncado ou corrompido (nesse caso pixels recebe a imagem, com os trechos afetados incompletos).
+     *
+     * Parâmetros:
+     * data, size: arquivo comprimido e seu tamanho em bytes
+     * scale: denominador da escala (1, 2, 4 ou 8)
+     * pixels: destino dos pixels RGB, linha por linha
+     * pixel_capacity: número de pixels que cabem em pixels (o produto das dimensões de codec_scaled_size basta)
+     * num_threads: threads usadas na chamada
+     * context: contexto do descompressor reaproveitável, ou NULL para usar um temporário
+     */
+    int width, height;
+    if (!codec_read_info(data, size, &width, &height, NULL)) return CODEC_ERROR_INVALID_HEADER;
+    if (!codec_scaled_size(width, height, scale, &width, &height)) return CODEC_ERROR_INVALID_ARGUMENT;
+    if ((size_t)width * height > pixel_capacity) return CODEC_ERROR_BUFFER_TOO_SMALL;
+
+    COMPRESSED_HEADER header;
+    int status;
+    decompress_image_memory(data, size, &header, num_threads < 1 ? 1 : num_threads, scale, context, pixels, &status);
+    return status;
+}
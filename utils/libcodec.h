@@ -0,0 +1,27 @@
+#ifndef LIBCODEC_H
+    #define LIBCODEC_H
+
+    /* API em memória do compressor, compilada como libcodec.a e libcodec.so (make lib).
+     * Nenhuma função lê ou escreve arquivos nem usa estado global modificável, então
+     * várias threads podem chamá-las ao mesmo tempo (cada uma com o seu contexto).
+     * Nada é impresso: os erros voltam como códigos de retorno.
+     * Os contextos (context.h) guardam a memória de trabalho entre chamadas: com eles, imagens do
+     * mesmo tamanho ou menores não alocam nada depois da primeira. Com NULL, cada chamada usa um
+     * contexto temporário.
+     */
+    #include <stddef.h>
+    #include <stdint.h>
+    #include "bitmap.h"
+    #include "codec.h"
+    #include "context.h"
+
+    // As opções de compressão (CODEC_OPTIONS) e os códigos de retorno (CODEC_OK e CODEC_ERROR_*)
+    // ficam em codec.h, compartilhados com o compressor
+
+    size_t codec_max_encoded_size(int width, int height, const CODEC_OPTIONS *options);
+    int codec_encode(const PIXELRGB *pixels, int width, int height, const CODEC_OPTIONS *options, uint8_t *output, size_t capacity, size_t *out_size, ENCODER_CONTEXT *context);
+    int codec_read_info(const uint8_t *data, size_t size, int *width, int *height, int *quality);
+    int codec_scaled_size(int width, int height, int scale, int *scaled_width, int *scaled_height);
+    int codec_decode(const uint8_t *data, size_t size, PIXELRGB *pixels, size_t pixel_capacity, int num_threads, DECODER_CONTEXT *context);
+    int codec_decode_scaled(const uint8_t *data, size_t size, int scale, PIXELRGB *pixels, size_t pixel_capacity, int num_threads, DECODER_CONTEXT *context);
+#endif
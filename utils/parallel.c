@@ -0,0 +1,1247 @@
+/* Esse arquivo é responsável por distribuir o trabalho do compressor e do descompressor entre várias threads.
+ * Na compressão, a imagem é dividida em faixas de linhas de macroblocos: cada faixa passa pela conversão
+ * de cores, DCT, quantização, vetorização, RLE e Huffman de forma independente, e os
+ * preditores DC são costurados entre as faixas para que o resultado seja idêntico ao serial.
+ * Na descompressão, o arquivo é dividido em trechos (entradas do índice, intervalos de reinício ou,
+ * em arquivos antigos, pedaços de tamanho fixo) cujo Huffman é decodificado em paralelo.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "parallel.h"
+
+typedef struct {
+    PARALLEL_TASK task;
+    void *arg;
+    int num_tasks;
+    int next_task;           // Próxima tarefa a ser pega por uma thread
+    pthread_mutex_t lock;    // Protege next_task
+} PARALLEL_POOL;
+
+static void *parallel_worker(void *data) {
+    /*
+     * Laço de cada thread: pega a próxima tarefa livre até acabarem as tarefas.
+     */
+    PARALLEL_POOL *pool = (PARALLEL_POOL *)data;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int index = pool->next_task++;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (index >= pool->num_tasks) break;
+        pool->task(pool->arg, index);
+    }
+    return NULL;
+}
+
+int run_parallel(PARALLEL_TASK task, void *arg, int num_tasks, int num_threads) {
+    /*
+     * Executa task(arg, i) para i de 0 a num_tasks - 1 usando até num_threads threads.
+     * A thread chamadora também trabalha, então num_threads = 1 roda tudo sem criar threads.
+     * Retorna 1 quando todas as tarefas foram executadas, 0 em caso de erro.
+     *
+     * Parâmetros:
+     * task: função a ser executada para cada tarefa
+     * arg: argumento repassado para task
+     * num_tasks: número de tarefas
+     * num_threads: número máximo de threads (incluindo a chamadora)
+     */
+    if (num_tasks <= 0) return 1;
+    if (num_threads > num_tasks) num_threads = num_tasks;
+    if (num_threads < 1) num_threads = 1;
+
+    PARALLEL_POOL pool;
+    pool.task = task;
+    pool.arg = arg;
+    pool.num_tasks = num_tasks;
+    pool.next_task = 0;
+    if (pthread_mutex_init(&pool.lock, NULL) != 0) return 0;
+
+    pthread_t *threads = NULL;
+    int created = 0;
+    if (num_threads > 1) {
+        threads = (pthread_t *)calloc(num_threads - 1, sizeof(pthread_t));
+        if (threads) {
+            for (; created < num_threads - 1; created++) {
+                // Se não conseguir criar mais threads, segue com as que já existem
+                if (pthread_create(&threads[created], NULL, parallel_worker, &pool) != 0) break;
+            }
+        }
+    }
+
+    parallel_worker(&pool);
+
+    for (int i = 0; i < created; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&pool.lock);
+    return 1;
+}
+
+// Fila dupla de tarefas de uma thread: a dona retira do fim, as outras roubam do começo
+typedef struct {
+    int *tasks;
+    int top, bottom;         // Tarefas pendentes ficam em tasks[top..bottom-1]
+    pthread_mutex_t lock;
+} TASK_DEQUE;
+
+typedef struct {
+    STEALING_TASK task;
+    void *arg;
+    int num_threads;
+    TASK_DEQUE *deques;
+} STEALING_POOL;
+
+typedef struct {
+    STEALING_POOL *pool;
+    int thread_id;
+} STEALING_WORKER;
+
+static int pop_own_task(TASK_DEQUE *deque) {
+    // Retira a tarefa mais recente da própria fila (-1 se vazia)
+    int index = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top) index = deque->tasks[--deque->bottom];
+    pthread_mutex_unlock(&deque->lock);
+    return index;
+}
+
+static int steal_task(TASK_DEQUE *deque) {
+    // Rouba a tarefa mais antiga da fila de outra thread (-1 se vazia)
+    int index = -1;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom > deque->top) index = deque->tasks[deque->top++];
+    pthread_mutex_unlock(&deque->lock);
+    return index;
+}
+
+static void *stealing_worker(void *data) {
+    /*
+     * Laço de cada thread: esvazia a própria fila e depois rouba das outras.
+     * Como nenhuma tarefa nova é criada, a thread termina quando todas as filas estão vazias.
+     */
+    STEALING_WORKER *worker = (STEALING_WORKER *)data;
+    STEALING_POOL *pool = worker->pool;
+    int id = worker->thread_id;
+
+    for (;;) {
+        int index = pop_own_task(&pool->deques[id]);
+        for (int i = 1; index < 0 && i < pool->num_threads; i++) {
+            index = steal_task(&pool->deques[(id + i) % pool->num_threads]);
+        }
+        if (index < 0) break;
+        pool->task(pool->arg, index, id);
+    }
+    return NULL;
+}
+
+int run_work_stealing(STEALING_TASK task, void *arg, int num_tasks, int num_threads) {
+    /*
+     * Executa task(arg, i, thread) para i de 0 a num_tasks - 1 usando até num_threads threads.
+     * As tarefas são distribuídas entre filas por thread, e uma thread sem trabalho rouba
+     * tarefas das filas das outras, o que equilibra tarefas de custos muito diferentes.
+     * O identificador da thread (0 a num_threads - 1) permite reaproveitar memória por thread.
+     * Retorna 1 quando todas as tarefas foram executadas, 0 em caso de erro.
+     *
+     * Parâmetros:
+     * task: função a ser executada para cada tarefa
+     * arg: argumento repassado para task
+     * num_tasks: número de tarefas
+     * num_threads: número máximo de threads (incluindo a chamadora)
+     */
+    if (num_tasks <= 0) return 1;
+    if (num_threads > num_tasks) num_threads = num_tasks;
+    if (num_threads < 1) num_threads = 1;
+
+    STEALING_POOL pool;
+    pool.task = task;
+    pool.arg = arg;
+    pool.num_threads = num_threads;
+    pool.deques = (TASK_DEQUE *)calloc(num_threads, sizeof(TASK_DEQUE));
+    int *tasks = (int *)calloc(num_tasks, sizeof(int));
+    STEALING_WORKER *workers = (STEALING_WORKER *)calloc(num_threads, sizeof(STEALING_WORKER));
+    pthread_t *threads = (pthread_t *)calloc(num_threads, sizeof(pthread_t));
+    if (!pool.deques || !tasks || !workers || !threads) {
+        free(pool.deques);
+        free(tasks);
+        free(workers);
+        free(threads);
+        return 0;
+    }
+
+    // Cada fila recebe um bloco contínuo de tarefas
+    for (int t = 0; t < num_threads; t++) {
+        TASK_DEQUE *deque = &pool.deques[t];
+        int first = (int)((long long)t * num_tasks / num_threads);
+        int last = (int)((long long)(t + 1) * num_tasks / num_threads);
+        deque->tasks = tasks + first;
+        deque->top = 0;
+        deque->bottom = last - first;
+        // A dona retira do fim, então as tarefas são guardadas em ordem inversa para ela começar pela primeira
+        for (int i = 0; i < deque->bottom; i++) {
+            deque->tasks[i] = last - 1 - i;
+        }
+        pthread_mutex_init(&deque->lock, NULL);
+        workers[t].pool = &pool;
+        workers[t].thread_id = t;
+    }
+
+    int created = 1;
+    for (; created < num_threads; created++) {
+        // Se não conseguir criar mais threads, as filas restantes são roubadas pelas que existem
+        if (pthread_create(&threads[created], NULL, stealing_worker, &workers[created]) != 0) break;
+    }
+
+    stealing_worker(&workers[0]);
+
+    for (int i = 1; i < created; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (int t = 0; t < num_threads; t++) {
+        pthread_mutex_destroy(&pool.deques[t].lock);
+    }
+    free(pool.deques);
+    free(tasks);
+    free(workers);
+    free(threads);
+    return 1;
+}
+
+// Estado compartilhado pelas faixas durante a compressão paralela
+typedef struct {
+    const PIXELRGB *pixels_rgb;
+    PIXELYCBCR *pixels_ycbcr;
+    int width, height, quality;
+    int restart_interval;   // Macroblocos entre reinícios do preditor DC (0 = sem reinícios)
+    int mb_cols, mb_rows;
+    int num_bands;
+    MACROBLOCO *macroblocks;
+    MACROBLOCO_VETORIZADO *vectorized_macroblocks;
+    MACROBLOCO_RLE_DIFERENCIAL *rle_diff_macroblocks;
+    int (*predictors)[3];   // Preditores DC de entrada de cada faixa
+    BitBuffer *bit_buffers; // Buffers Huffman do contexto, um por macrobloco
+    BitBuffer **buffers;
+    BAND_BITS *band_bits;   // Dados dos buffers Huffman de cada faixa, no contexto
+    long *allocations;      // Contador de alocações do contexto
+    CODEC_TABLES *tables;
+    const HUFFMAN_ENCODE_TABLES *huffman; // Tabela de emissão dos pares AC do contexto
+    int effort;             // 0 = quantização por arredondamento, 1 = quantização taxa-distorção (RDO)
+    int adaptive;           // 1 = quantização adaptativa, com o nível de cada macrobloco gravado no arquivo
+    const QUANT_MATRICES *matrices; // Matrizes base personalizadas (NULL = Anexo K), gravadas no arquivo
+    int cbp;                // 1 = padrão de blocos codificados em cada macrobloco, sem os blocos vazios
+    MACROBLOCO *coefficients; // Saída da DCT guardada para requantizar (NULL = quantiza direto)
+    size_t *band_sizes;     // Bytes estimados dos macroblocos de cada faixa
+} COMPRESSION_JOB;
+
+// Estado compartilhado pelos trechos durante a descompressão paralela
+typedef struct {
+    const uint8_t *file_data; // Arquivo comprimido inteiro em memória
+    size_t file_size;
+    int width, height, quality;
+    int restart_interval;
+    int mb_cols, mb_rows;
+    int num_segments;
+    DECODE_SEGMENT *segments;
+    int chained;            // Preditores dos trechos dependem dos trechos anteriores (arquivo sem índice nem reinícios)
+    MACROBLOCO_RLE_DIFERENCIAL *rle_diff_macroblocks;
+    MACROBLOCO_VETORIZADO *vectorized_macroblocks;
+    MACROBLOCO *macroblocks;
+    PIXELYCBCR *pixels_ycbcr;
+    PIXELRGB *pixels_rgb;
+    int num_bands;          // Faixas de linhas usadas na conversão para RGB
+    int damaged;            // Algum trecho truncado ou macrobloco inválido (as threads marcam com __atomic_store_n)
+    int adaptive;           // Macroblocos começam com o nível da quantização adaptativa (FORMAT_FLAG_ADAPTIVE)
+    int cbp;                // Macroblocos trazem o padrão de blocos codificados (FORMAT_FLAG_CBP)
+    int scale;              // Denominador da escala da imagem decodificada (1 = tamanho original)
+    int out_width, out_height; // Dimensões da imagem decodificada
+    CODEC_TABLES *tables;
+    const HUFFMAN_DECODE_TABLES *huffman;
+} DECOMPRESSION_JOB;
+
+static int count_bands(int mb_rows, int num_threads) {
+    // Algumas faixas a mais que threads equilibram regiões com custos diferentes
+    int bands = num_threads > 1 ? num_threads * 4 : 1;
+    return bands > mb_rows ? mb_rows : bands;
+}
+
+static int count_pieces(int macroblock_count, int num_threads) {
+    // Divisões de arquivos sem índice nem reinícios; algumas a mais que threads equilibram os custos
+    int pieces = num_threads > 1 ? num_threads * 4 : 1;
+    return pieces > macroblock_count ? macroblock_count : pieces;
+}
+
+static void band_rows(COMPRESSION_JOB *job, int band, int *row_start, int *row_end) {
+    // Divide as linhas de macroblocos em faixas de tamanho quase igual
+    *row_start = (int)((long long)band * job->mb_rows / job->num_bands);
+    *row_end = (int)((long long)(band + 1) * job->mb_rows / job->num_bands);
+}
+
+static void quantize_range(COMPRESSION_JOB *job, int first, int count) {
+    // Quantização, vetorização e RLE de macroblocos já transformados pela DCT
+    if (job->adaptive) {
+        quantizeMacroblocksAdaptive(job->macroblocks + first, job->rle_diff_macroblocks + first, count, job->tables, job->effort > 0 ? RDO_LAMBDA_SCALE : 0.0f);
+    } else if (job->effort > 0) {
+        quantizeMacroblocksRDO(job->macroblocks + first, count, job->tables, RDO_LAMBDA_SCALE);
+    } else {
+        quantizeMacroblocksWithTables(job->macroblocks + first, count, job->tables);
+    }
+    vectorize_macroblocks(job->macroblocks + first, job->vectorized_macroblocks + first, count);
+    rle_encode_macroblocks(job->rle_diff_macroblocks + first, job->vectorized_macroblocks + first, count);
+}
+
+static void transform_band(void *arg, int band) {
+    /*
+     * Primeira etapa de uma faixa: conversão de cores, DCT, quantização, vetorização e RLE.
+     * Os coeficientes DC ficam absolutos, pois o preditor depende das faixas anteriores.
+     * Se job->coefficients existir, a faixa para depois da DCT, guardando os coeficientes nele.
+     */
+    COMPRESSION_JOB *job = (COMPRESSION_JOB *)arg;
+    int row_start, row_end;
+    band_rows(job, band, &row_start, &row_end);
+
+    // Converte só as linhas de pixels cobertas pela faixa
+    int pixel_start = row_start * 16;
+    int pixel_end = row_end * 16 < job->height ? row_end * 16 : job->height;
+    int offset = pixel_start * job->width;
+    convertToYCBCR(job->pixels_rgb + offset, job->pixels_ycbcr + offset, (pixel_end - pixel_start) * job->width);
+
+    int first = row_start * job->mb_cols;
+    int count = (row_end - row_start) * job->mb_cols;
+    if (job->coefficients) {
+        encodeMacroblockRows(job->pixels_ycbcr, job->width, job->height, row_start, row_end, job->coefficients + first, job->tables, 0);
+        return;
+    }
+    encodeMacroblockRows(job->pixels_ycbcr, job->width, job->height, row_start, row_end, job->macroblocks + first, job->tables, !job->adaptive && job->effort == 0);
+    quantize_range(job, first, count);
+}
+
+static void requantize_band(void *arg, int band) {
+    /*
+     * Refaz a quantização, a vetorização e o RLE de uma faixa a partir dos coeficientes
+     * guardados da DCT, na qualidade atual de job->tables.
+     */
+    COMPRESSION_JOB *job = (COMPRESSION_JOB *)arg;
+    int row_start, row_end;
+    band_rows(job, band, &row_start, &row_end);
+
+    int first = row_start * job->mb_cols;
+    int count = (row_end - row_start) * job->mb_cols;
+    memcpy(job->macroblocks + first, job->coefficients + first, (size_t)count * sizeof(MACROBLOCO));
+    quantize_range(job, first, count);
+}
+
+static void size_band(void *arg, int band) {
+    /*
+     * Como entropy_band, mas só soma quantos bytes os macroblocos da faixa ocupariam no arquivo
+     * (tamanho gravado na frente de cada um mais o Huffman), sem escrever nenhum bit.
+     */
+    COMPRESSION_JOB *job = (COMPRESSION_JOB *)arg;
+    int row_start, row_end;
+    band_rows(job, band, &row_start, &row_end);
+
+    int first = row_start * job->mb_cols;
+    int count = (row_end - row_start) * job->mb_cols;
+    differential_encode_dc_restart(job->rle_diff_macroblocks + first, first, count, job->restart_interval, job->predictors[band]);
+
+    size_t size = 0;
+    for (int i = first; i < first + count; i++) {
+        size += sizeof(size_t) + huffman_macroblock_size(&job->rle_diff_macroblocks[i], job->adaptive, job->cbp);
+    }
+    job->band_sizes[band] = size;
+}
+
+static void entropy_band(void *arg, int band) {
+    /*
+     * Segunda etapa de uma faixa: codificação diferencial do DC a partir do preditor
+     * herdado da faixa anterior e codificação Huffman de cada macrobloco.
+     */
+    COMPRESSION_JOB *job = (COMPRESSION_JOB *)arg;
+    int row_start, row_end;
+    band_rows(job, band, &row_start, &row_end);
+
+    int first = row_start * job->mb_cols;
+    int count = (row_end - row_start) * job->mb_cols;
+    differential_encode_dc_restart(job->rle_diff_macroblocks + first, first, count, job->restart_interval, job->predictors[band]);
+
+    // Os macroblocos da faixa ficam um depois do outro na área da faixa, reservada com um tamanho
+    // realista; antes de cada um é garantido o espaço do pior caso, então write_bits nunca realoca
+    BAND_BITS *bits = &job->band_bits[band];
+    size_t used = 0;
+    reserve_band_bits(bits, (size_t)count * TYPICAL_MACROBLOCK_BYTES + MAX_MACROBLOCK_BYTES);
+    for (int i = first; i < first + count; i++) {
+        BitBuffer *buffer = &job->bit_buffers[i];
+        job->buffers[i] = NULL;
+        if (!reserve_band_bits(bits, used + MAX_MACROBLOCK_BYTES)) continue;
+        buffer->data = bits->data + used;
+        buffer->capacity = MAX_MACROBLOCK_BYTES;
+        if (!huffman_encode_macroblock_into(buffer, &job->rle_diff_macroblocks[i], job->adaptive, job->cbp, job->huffman)) continue;
+        job->buffers[i] = buffer;
+        used += get_huffman_buffer_size(buffer);
+    }
+
+    // A área pode ter mudado de lugar ao crescer: cada buffer passa a apontar para a sua posição final
+    used = 0;
+    for (int i = first; i < first + count; i++) {
+        BitBuffer *buffer = job->buffers[i];
+        if (!buffer) continue;
+        buffer->data = bits->data + used;
+        buffer->capacity = get_huffman_buffer_size(buffer);
+        used += buffer->capacity;
+    }
+}
+
+static void encode_bands(COMPRESSION_JOB *job, int num_threads) {
+    // Codificação diferencial e Huffman de todas as faixas; as alocações feitas pelas threads nas
+    // áreas das faixas entram depois no contador do contexto
+    run_parallel(entropy_band, job, job->num_bands, num_threads);
+    for (int band = 0; band < job->num_bands; band++) {
+        *job->allocations += job->band_bits[band].allocations;
+        job->band_bits[band].allocations = 0;
+    }
+}
+
+static void predictors_before(COMPRESSION_JOB *job, int mb_index, int predictors[3]) {
+    /*
+     * Preditores DC em vigor no início do macrobloco mb_index: zero no começo da imagem e nos
+     * reinícios, ou os DCs absolutos do macrobloco anterior.
+     */
+    if (mb_index == 0 || (job->restart_interval > 0 && mb_index % job->restart_interval == 0)) {
+        predictors[0] = predictors[1] = predictors[2] = 0;
+        return;
+    }
+    MACROBLOCO_RLE_DIFERENCIAL *last = &job->rle_diff_macroblocks[mb_index - 1];
+    predictors[0] = last->Y_vetor[3].coeficiente_dc;
+    predictors[1] = last->Cb_vetor.coeficiente_dc;
+    predictors[2] = last->Cr_vetor.coeficiente_dc;
+}
+
+static void stitch_predictors(COMPRESSION_JOB *job, MACROBLOCK_INDEX *index) {
+    /*
+     * O preditor de entrada de cada faixa é o DC absoluto do último macrobloco da faixa anterior
+     * (ou zero, se a faixa começa em um reinício). O índice guarda os mesmos preditores para as
+     * linhas em que cada entrada começa.
+     */
+    for (int band = 0; band < job->num_bands; band++) {
+        int row_start, row_end;
+        band_rows(job, band, &row_start, &row_end);
+        predictors_before(job, row_start * job->mb_cols, job->predictors[band]);
+    }
+    for (int entry = 0; index && entry < index->count; entry++) {
+        predictors_before(job, entry * index->interval * job->mb_cols, index->entries[entry].predictors);
+    }
+}
+
+static int prepare_compression(COMPRESSION_JOB *job, const PIXELRGB *pixels_rgb, int width, int height, const CODEC_OPTIONS *options, MACROBLOCK_INDEX *index, ENCODER_CONTEXT *context) {
+    /*
+     * Preenche o estado da compressão paralela com as opções e os vetores do contexto,
+     * reservando-os se preciso. A qualidade fica para quem chama, que pode trocá-la a cada
+     * passada. Retorna 1 em caso de sucesso, 0 se faltar memória (sem imprimir nada).
+     */
+    memset(job, 0, sizeof(*job));
+    job->pixels_rgb = pixels_rgb;
+    job->width = width;
+    job->height = height;
+    job->effort = options->effort;
+    job->adaptive = options->adaptive;
+    job->matrices = options->matrices;
+    job->cbp = options->cbp;
+    job->restart_interval = options->restart_interval;
+    job->mb_cols = (width + 15) / 16;
+    job->mb_rows = (height + 15) / 16;
+    job->num_bands = count_bands(job->mb_rows, options->num_threads);
+
+    int index_count = index ? (job->mb_rows + index->interval - 1) / index->interval : 0;
+    if (!reserve_encoder_context(context, width, height, job->num_bands, index_count)) return 0;
+    job->tables = &context->tables;
+    job->huffman = &context->huffman;
+    set_codec_tables_base(job->tables, options->matrices);
+    job->pixels_ycbcr = context->work.pixels_ycbcr;
+    job->macroblocks = context->work.macroblocks;
+    job->vectorized_macroblocks = context->work.vectorized_macroblocks;
+    job->rle_diff_macroblocks = context->work.rle_diff_macroblocks;
+    job->predictors = context->predictors;
+    job->bit_buffers = context->bit_buffers;
+    job->buffers = context->encoded;
+    job->band_bits = context->band_bits;
+    job->allocations = &context->work.allocations;
+    if (index) {
+        index->count = index_count;
+        index->entries = context->index_entries;
+    }
+    return 1;
+}
+
+BitBuffer** compress_image_parallel(const PIXELRGB *pixels_rgb, int width, int height, const CODEC_OPTIONS *options, MACROBLOCK_INDEX *index, int *out_macroblock_count, ENCODER_CONTEXT *context) {
+    /*
+     * Comprime uma imagem RGB dividindo-a em faixas de linhas de macroblocos processadas em paralelo.
+     * Retorna um buffer Huffman por macrobloco, na ordem do arquivo, ou NULL se faltar memória.
+     * Os buffers pertencem ao contexto e valem até a próxima imagem comprimida com ele.
+     * O resultado é idêntico para qualquer número de threads.
+     *
+     * Parâmetros:
+     * pixels_rgb: pixels RGB da imagem
+     * width, height: largura e altura da imagem
+     * options: qualidade (1 a 100), threads e opções de quantização e de formato; com adaptive,
+     *          matrices e cbp o arquivo leva FORMAT_FLAG_ADAPTIVE, FORMAT_FLAG_MATRICES (com as
+     *          matrizes efetivas no header) e FORMAT_FLAG_CBP. index_interval não é usado aqui
+     * index: se não for NULL, recebe os preditores DC a cada index->interval linhas de macroblocos
+     *        (entries aponta para o contexto; as posições são preenchidas por serialize_encoded_macroblocks)
+     * out_macroblock_count: ponteiro para armazenar o número de macroblocos
+     * context: contexto do compressor (init_encoder_context)
+     *          (pixels_rgb pode ser context->work.pixels_rgb se ele já tiver sido reservado para esta imagem)
+     */
+    COMPRESSION_JOB job;
+    *out_macroblock_count = ((width + 15) / 16) * ((height + 15) / 16);
+    if (!prepare_compression(&job, pixels_rgb, width, height, options, index, context)) return NULL;
+    job.quality = options->quality;
+    set_codec_tables_quality(&context->tables, options->quality);
+
+    // 1. Transformações independentes por faixa
+    run_parallel(transform_band, &job, job.num_bands, options->num_threads);
+
+    // 2. Preditores de entrada de cada faixa e do índice
+    stitch_predictors(&job, index);
+
+    // 3. Codificação diferencial e Huffman por faixa
+    encode_bands(&job, options->num_threads);
+    return job.buffers;
+}
+
+static size_t estimate_compressed_size(COMPRESSION_JOB *job, int quality, size_t fixed_size, int num_threads) {
+    /*
+     * Tamanho exato do arquivo comprimido na qualidade dada, refazendo só a quantização, o RLE
+     * e a contagem de bits a partir dos coeficientes guardados da DCT.
+     */
+    job->quality = quality;
+    set_codec_tables_quality(job->tables, quality);
+    run_parallel(requantize_band, job, job->num_bands, num_threads);
+    stitch_predictors(job, NULL);
+    run_parallel(size_band, job, job->num_bands, num_threads);
+
+    size_t size = fixed_size;
+    for (int band = 0; band < job->num_bands; band++) {
+        size += job->band_sizes[band];
+    }
+    return size;
+}
+
+BitBuffer** compress_image_target_size(const PIXELRGB *pixels_rgb, int width, int height, size_t target_size, const CODEC_OPTIONS *options, MACROBLOCK_INDEX *index, int *out_macroblock_count, int *out_quality, int *out_fits, ENCODER_CONTEXT *context) {
+    /*
+     * Comprime uma imagem RGB com a maior qualidade cujo arquivo cabe em target_size bytes.
+     * A conversão de cores e a DCT são feitas uma única vez; a busca binária pela qualidade
+     * refaz só a quantização, o RLE e a contagem dos bits do Huffman a partir dos coeficientes
+     * guardados, e o Huffman de verdade roda só na qualidade escolhida. Se nem a qualidade 1
+     * couber, a imagem é comprimida com ela mesmo assim e *out_fits recebe 0. Os buffers seguem as regras de
+     * compress_image_parallel, e o resultado é idêntico a comprimir direto na qualidade escolhida.
+     *
+     * Parâmetros:
+     * pixels_rgb: pixels RGB da imagem
+     * width, height: largura e altura da imagem
+     * target_size: tamanho máximo do arquivo comprimido em bytes (header e índice incluídos)
+     * options: como em compress_image_parallel (a qualidade é ignorada)
+     * index: como em compress_image_parallel
+     * out_macroblock_count: ponteiro para armazenar o número de macroblocos
+     * out_quality: ponteiro para armazenar a qualidade escolhida
+     * out_fits: ponteiro para armazenar 1 se o arquivo cabe em target_size, 0 se nem a qualidade 1 coube
+     * context: contexto do compressor (init_encoder_context)
+     */
+    COMPRESSION_JOB job;
+    int macroblock_count = ((width + 15) / 16) * ((height + 15) / 16);
+    *out_macroblock_count = macroblock_count;
+    if (!prepare_compression(&job, pixels_rgb, width, height, options, index, context)) return NULL;
+    int num_threads = options->num_threads;
+
+    // Os coeficientes e os tamanhos das faixas só existem neste modo, então ficam fora da arena
+    WORK_BUFFERS *work = &context->work;
+    if (!grow_aligned_buffer((void **)&context->coefficients, &context->coefficient_capacity, macroblock_count, sizeof(MACROBLOCO), &work->allocations) ||
+        !grow_aligned_buffer((void **)&context->band_sizes, &context->band_size_capacity, job.num_bands, sizeof(size_t), &work->allocations)) {
+        return NULL;
+    }
+    job.coefficients = context->coefficients;
+    job.band_sizes = context->band_sizes;
+
+    // Header e índice não dependem da qualidade
+    COMPRESSED_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.macroblock_count = macroblock_count;
+    header.restart_interval = options->restart_interval;
+    header.flags = (options->adaptive ? FORMAT_FLAG_ADAPTIVE : 0) | (options->cbp ? FORMAT_FLAG_CBP : 0);
+    if (options->matrices) header.flags |= FORMAT_FLAG_MATRICES;
+    set_format_flags(&header, index != NULL);
+    uint8_t header_data[COMPRESSED_HEADER_MAX_SIZE];
+    size_t fixed_size = serialize_compressed_header(&header, header_data);
+    if (index) fixed_size += serialize_macroblock_index(index, NULL);
+
+    // 1. Conversão de cores e DCT uma única vez
+    run_parallel(transform_band, &job, job.num_bands, num_threads);
+
+    // 2. Busca binária pela maior qualidade que cabe (o tamanho cresce com a qualidade)
+    int low = 1, high = 100, best = 0;
+    while (low <= high) {
+        int quality = (low + high) / 2;
+        if (estimate_compressed_size(&job, quality, fixed_size, num_threads) <= target_size) {
+            best = quality;
+            low = quality + 1;
+        } else {
+            high = quality - 1;
+        }
+    }
+    *out_fits = best > 0;
+    if (best == 0) best = 1;
+    *out_quality = best;
+
+    // 3. Compressão de verdade na qualidade escolhida
+    job.quality = best;
+    set_codec_tables_quality(job.tables, best);
+    run_parallel(requantize_band, &job, job.num_bands, num_threads);
+    stitch_predictors(&job, index);
+    encode_bands(&job, num_threads);
+    return job.buffers;
+}
+
+static void decode_segment_huffman(void *arg, int segment_index) {
+    /*
+     * Primeira etapa de um trecho: lê e decodifica (huffman) os macroblocos direto da memória
+     * e soma as diferenças DC, usadas para costurar os preditores de trechos encadeados.
+     * Se o trecho estiver truncado, os macroblocos que faltam ficam zerados e apenas o trecho é afetado.
+     * Trechos truncados e macroblocos inválidos marcam job->damaged, que o decodificador avisa no fim.
+     */
+    DECOMPRESSION_JOB *job = (DECOMPRESSION_JOB *)arg;
+    DECODE_SEGMENT *segment = &job->segments[segment_index];
+    int first = segment->first;
+    int count = segment->count;
+
+    size_t position = (size_t)segment->offset;
+    int i = first;
+    for (; i < first + count; i++) {
+        size_t buffer_size;
+        if (segment->offset < 0 || position + sizeof(size_t) > job->file_size) {
+            __atomic_store_n(&job->damaged, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        memcpy(&buffer_size, job->file_data + position, sizeof(size_t));
+        position += sizeof(size_t);
+        if (buffer_size > job->file_size - position) {
+            __atomic_store_n(&job->damaged, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        // O buffer só é lido, então pode apontar direto para os dados constantes
+        BitBuffer buffer = {(uint8_t *)job->file_data + position, buffer_size, 0, 0};
+        if (!huffman_decode_macroblock(&buffer, &job->rle_diff_macroblocks[i], job->huffman, job->adaptive, job->cbp, job->scale == 8)) {
+            __atomic_store_n(&job->damaged, 1, __ATOMIC_RELAXED);
+        }
+        position += buffer_size;
+    }
+    // Os vetores podem ser reaproveitados de outra imagem, então o que não foi lido é zerado
+    memset(job->rle_diff_macroblocks + i, 0, (size_t)(first + count - i) * sizeof(MACROBLOCO_RLE_DIFERENCIAL));
+
+    segment->dc_sums[0] = segment->dc_sums[1] = segment->dc_sums[2] = 0;
+    for (int i = first; i < first + count; i++) {
+        for (int j = 0; j < 4; j++) {
+            segment->dc_sums[0] += job->rle_diff_macroblocks[i].Y_vetor[j].coeficiente_dc;
+        }
+        segment->dc_sums[1] += job->rle_diff_macroblocks[i].Cb_vetor.coeficiente_dc;
+        segment->dc_sums[2] += job->rle_diff_macroblocks[i].Cr_vetor.coeficiente_dc;
+    }
+}
+
+static void decode_segment_pixels(void *arg, int segment_index) {
+    /*
+     * Segunda etapa de um trecho: diferencial a partir dos preditores do trecho, RLE,
+     * desvetorização, dequantização, IDCT e reconstrução da imagem YCbCr.
+     * Em tamanho reduzido, a imagem sai direto dos blocos RLE depois do diferencial.
+     */
+    DECOMPRESSION_JOB *job = (DECOMPRESSION_JOB *)arg;
+    DECODE_SEGMENT *segment = &job->segments[segment_index];
+    int first = segment->first;
+    int count = segment->count;
+
+    int predictors[3];
+    memcpy(predictors, segment->predictors, sizeof(predictors));
+    differential_decode_dc_restart(job->rle_diff_macroblocks + first, first, count, job->restart_interval, predictors);
+    if (job->scale > 1) {
+        decodeMacroblockRangeScaled(job->rle_diff_macroblocks + first, job->pixels_ycbcr, job->width, job->height, first, count, job->tables, job->adaptive, job->scale);
+        return;
+    }
+    rle_decode_macroblocks(job->vectorized_macroblocks + first, job->rle_diff_macroblocks + first, count);
+    devectorize_macroblocks(job->vectorized_macroblocks + first, job->macroblocks + first, count);
+    if (job->adaptive) {
+        dequantizeMacroblocksAdaptive(job->macroblocks + first, job->rle_diff_macroblocks + first, count, job->tables);
+    } else {
+        dequantizeMacroblocksWithTables(job->macroblocks + first, count, job->tables);
+    }
+
+    decodeMacroblockRange(job->macroblocks + first, job->rle_diff_macroblocks + first, job->pixels_ycbcr, job->width, job->height, first, count, job->tables);
+}
+
+static void convert_band(void *arg, int band) {
+    /*
+     * Converte para RGB uma faixa de linhas de pixels da imagem reconstruída.
+     */
+    DECOMPRESSION_JOB *job = (DECOMPRESSION_JOB *)arg;
+    int pixel_start = (int)((long long)band * job->out_height / job->num_bands);
+    int pixel_end = (int)((long long)(band + 1) * job->out_height / job->num_bands);
+    int offset = pixel_start * job->out_width;
+    convertToRGB(job->pixels_ycbcr + offset, job->pixels_rgb + offset, (pixel_end - pixel_start) * job->out_width);
+}
+
+static int max_segments(DECOMPRESSION_JOB *job, int macroblock_count, int num_threads) {
+    /*
+     * Maior número de trechos que build_segments pode criar: um índice válido tem no máximo uma
+     * entrada por linha de macroblocos, e sem índice os trechos são os intervalos de reinício ou as divisões.
+     */
+    int segments = job->mb_rows > count_pieces(macroblock_count, num_threads) ? job->mb_rows : count_pieces(macroblock_count, num_threads);
+    if (job->restart_interval > 0) {
+        int restarts = (macroblock_count + job->restart_interval - 1) / job->restart_interval;
+        if (restarts > segments) segments = restarts;
+    }
+    return segments;
+}
+
+static void build_segments(DECOMPRESSION_JOB *job, COMPRESSED_HEADER *header, size_t data_start, int num_threads, DECODER_CONTEXT *context) {
+    /*
+     * Divide o arquivo em trechos. Com índice, cada entrada vira um trecho; com reinícios, cada
+     * intervalo vira um trecho. Sem nenhum dos dois (arquivos antigos), o arquivo é cortado em
+     * pedaços de tamanho fixo cujos preditores só são conhecidos depois de decodificar os anteriores.
+     * Como cada macrobloco é gravado com o seu tamanho na frente, os cortes são encontrados
+     * percorrendo só esses tamanhos, sem decodificar Huffman. Os trechos e o índice ficam no contexto,
+     * já reservado com max_segments trechos e uma entrada de índice por linha de macroblocos.
+     */
+    int macroblock_count = header->macroblock_count;
+    job->segments = context->segments;
+
+    MACROBLOCK_INDEX index = {0, 0, context->index_entries};
+    if ((header->flags & FORMAT_FLAG_INDEX) && parse_macroblock_index(job->file_data, job->file_size, data_start, &index, job->mb_rows) &&
+        index.count == (job->mb_rows + index.interval - 1) / index.interval) {
+        job->num_segments = index.count;
+        for (int i = 0; i < index.count; i++) {
+            DECODE_SEGMENT *segment = &job->segments[i];
+            segment->first = i * index.interval * job->mb_cols;
+            segment->count = index.interval * job->mb_cols;
+            if (segment->first + segment->count > macroblock_count) segment->count = macroblock_count - segment->first;
+            segment->offset = index.entries[i].offset;
+            memcpy(segment->predictors, index.entries[i].predictors, sizeof(segment->predictors));
+        }
+        return;
+    }
+
+    int interval = job->restart_interval;
+    if (interval <= 0) {
+        int pieces = count_pieces(macroblock_count, num_threads);
+        interval = (macroblock_count + pieces - 1) / pieces;
+        job->chained = pieces > 1;
+    }
+    job->num_segments = (macroblock_count + interval - 1) / interval;
+    memset(job->segments, 0, job->num_segments * sizeof(DECODE_SEGMENT));
+
+    // Percorre só os tamanhos dos macroblocos para achar o início de cada intervalo
+    size_t position = data_start;
+    for (int i = 0; i < job->num_segments; i++) {
+        DECODE_SEGMENT *segment = &job->segments[i];
+        segment->first = i * interval;
+        segment->count = segment->first + interval > macroblock_count ? macroblock_count - segment->first : interval;
+        segment->offset = position <= job->file_size ? (int64_t)position : -1;
+
+        for (int j = 0; j < segment->count && position <= job->file_size; j++) {
+            size_t buffer_size;
+            if (position + sizeof(size_t) > job->file_size) {
+                position = job->file_size + 1; // Arquivo truncado: os próximos trechos ficam sem posição
+                break;
+            }
+            memcpy(&buffer_size, job->file_data + position, sizeof(size_t));
+            position += sizeof(size_t);
+            position = buffer_size > job->file_size - position ? job->file_size + 1 : position + buffer_size;
+        }
+    }
+}
+
+static uint8_t* load_file(FILE *input_file, WORK_BUFFERS *work, size_t *out_size) {
+    /*
+     * Lê o arquivo inteiro para a memória de trabalho. Retorna NULL em caso de erro.
+     */
+    if (fseek(input_file, 0, SEEK_END) != 0) return NULL;
+    long size = ftell(input_file);
+    if (size <= 0 || fseek(input_file, 0, SEEK_SET) != 0) return NULL;
+
+    if (!grow_aligned_buffer((void **)&work->file_data, &work->file_capacity, (size_t)size, sizeof(uint8_t), &work->allocations)) return NULL;
+    if (fread(work->file_data, 1, size, input_file) != (size_t)size) return NULL;
+    *out_size = (size_t)size;
+    return work->file_data;
+}
+
+PIXELRGB* decompress_image_memory(const uint8_t *data, size_t size, COMPRESSED_HEADER *header, int num_threads, int scale, DECODER_CONTEXT *context, PIXELRGB *output, int *status) {
+    /*
+     * Descomprime um arquivo gerado pelo compressor que já está na memória e retorna os pixels RGB,
+     * ou NULL em caso de erro. O arquivo é dividido em trechos (entradas do índice, intervalos de
+     * reinício ou pedaços de tamanho fixo em arquivos antigos) decodificados em paralelo.
+     * Nada é impresso: o resultado vai em *status.
+     *
+     * Parâmetros:
+     * data: arquivo comprimido inteiro
+     * size: tamanho do arquivo em bytes
+     * header: ponteiro para armazenar o header lido
+     * num_threads: número de threads a serem usadas
+     * scale: denominador da escala da imagem (1 = tamanho original; 2, 4 e 8 = IDCTs reduzidas de 4x4,
+     *        2x2 e só o DC), com as dimensões de scaled_image_size
+     * context: contexto do descompressor (init_decoder_context), ou NULL para usar um temporário
+     * output: onde gravar os pixels (largura * altura da imagem decodificada), ou NULL para usar
+     *         context->work.pixels_rgb (obrigatório com context NULL)
+     * status: recebe CODEC_OK, CODEC_ERROR_DAMAGED_DATA (os pixels são retornados, com os trechos
+     *         truncados ou corrompidos incompletos) ou o código do erro (codec.h)
+     */
+    DECOMPRESSION_JOB job;
+    memset(&job, 0, sizeof(job));
+
+    size_t data_start = parse_compressed_header(data, size, header);
+    if (data_start == 0) {
+        *status = CODEC_ERROR_INVALID_HEADER;
+        return NULL;
+    }
+
+    job.file_data = data;
+    job.file_size = size;
+    job.width = header->info_header.Width;
+    job.height = header->info_header.Height;
+    job.quality = header->quality;
+    job.restart_interval = header->restart_interval;
+    job.adaptive = (header->flags & FORMAT_FLAG_ADAPTIVE) != 0;
+    job.cbp = (header->flags & FORMAT_FLAG_CBP) != 0;
+    job.mb_cols = (job.width + 15) / 16;
+    job.mb_rows = (job.height + 15) / 16;
+    if (job.width <= 0 || job.height <= 0 || header->macroblock_count != job.mb_cols * job.mb_rows) {
+        *status = CODEC_ERROR_INVALID_HEADER;
+        return NULL;
+    }
+    if (!valid_decode_scale(scale) || (!context && !output)) {
+        *status = CODEC_ERROR_INVALID_ARGUMENT;
+        return NULL;
+    }
+    job.scale = scale;
+    scaled_image_size(job.width, job.height, scale, &job.out_width, &job.out_height);
+
+    DECODER_CONTEXT local_context;
+    DECODER_CONTEXT *ctx = context;
+    if (!ctx) {
+        init_decoder_context(&local_context);
+        ctx = &local_context;
+    }
+    int work_ok = reserve_decoder_context(ctx, job.width, job.height, scale, max_segments(&job, header->macroblock_count, num_threads), job.mb_rows);
+    if (work_ok) build_segments(&job, header, data_start, num_threads, ctx);
+    if (header->flags & FORMAT_FLAG_MATRICES) {
+        set_codec_tables_matrices(&ctx->tables, &header->matrices);
+    } else {
+        set_codec_tables_quality(&ctx->tables, job.quality);
+    }
+    job.tables = &ctx->tables;
+    job.huffman = &ctx->huffman;
+    job.rle_diff_macroblocks = ctx->work.rle_diff_macroblocks;
+    job.vectorized_macroblocks = ctx->work.vectorized_macroblocks;
+    job.macroblocks = ctx->work.macroblocks;
+    job.pixels_ycbcr = ctx->work.pixels_ycbcr;
+    job.pixels_rgb = output ? output : ctx->work.pixels_rgb;
+
+    PIXELRGB *result = NULL;
+    if (!work_ok) {
+        *status = CODEC_ERROR_OUT_OF_MEMORY;
+    } else {
+        // 1. Huffman de cada trecho em paralelo
+        run_parallel(decode_segment_huffman, &job, job.num_segments, num_threads);
+
+        // 2. Em trechos encadeados, o preditor de entrada é o de saída do trecho anterior,
+        //    que é o preditor de entrada dele mais a soma das suas diferenças DC
+        for (int i = 1; job.chained && i < job.num_segments; i++) {
+            for (int c = 0; c < 3; c++) {
+                job.segments[i].predictors[c] = job.segments[i - 1].predictors[c] + job.segments[i - 1].dc_sums[c];
+            }
+        }
+
+        // 3. Diferencial, RLE, dequantização e IDCT de cada trecho em paralelo (em tamanho reduzido,
+        //    o diferencial e as IDCTs reduzidas)
+        run_parallel(decode_segment_pixels, &job, job.num_segments, num_threads);
+
+        // 4. Conversão para RGB por faixas de linhas
+        job.num_bands = num_threads < job.out_height ? num_threads : job.out_height;
+        run_parallel(convert_band, &job, job.num_bands, num_threads);
+
+        *status = job.damaged ? CODEC_ERROR_DAMAGED_DATA : CODEC_OK;
+        result = job.pixels_rgb;
+    }
+
+    if (!context) free_decoder_context(&local_context);
+    return result;
+}
+
+PIXELRGB* decompress_image_parallel(const char *input_filename, COMPRESSED_HEADER *header, int num_threads, int scale, DECODER_CONTEXT *context, int *status) {
+    /*
+     * Lê um arquivo gerado pelo compressor para a memória e o descomprime com decompress_image_memory.
+     * Retorna os pixels RGB (context->work.pixels_rgb, que não deve ser liberado), ou NULL em caso de erro.
+     * Os erros de leitura do arquivo são impressos aqui; os da descompressão vão em *status.
+     *
+     * Parâmetros:
+     * input_filename: nome do arquivo comprimido
+     * header: ponteiro para armazenar o header lido
+     * num_threads: número de threads a serem usadas
+     * scale: denominador da escala da imagem decodificada (1 = tamanho original)
+     * context: contexto do descompressor (init_decoder_context)
+     * status: recebe o resultado de decompress_image_memory (CODEC_OK se o arquivo nem chegar a ser lido)
+     */
+    *status = CODEC_OK;
+    FILE *input_file = fopen(input_filename, "rb");
+    if (!input_file) {
+        printf("Erro ao abrir o arquivo %s para leitura.\n", input_filename);
+        return NULL;
+    }
+
+    size_t size = 0;
+    const uint8_t *data = load_file(input_file, &context->work, &size);
+    fclose(input_file);
+
+    if (!data) {
+        printf("Erro ao ler o arquivo %s.\n", input_filename);
+        return NULL;
+    }
+    return decompress_image_memory(data, size, header, num_threads, scale, context, NULL, status);
+}
+
+static int read_bmp_into_context(const char *input_filename, ENCODER_CONTEXT *context, int num_threads, int index_interval, BITMAPFILEHEADER *file_header, BITMAPINFOHEADER *info_header) {
+    /*
+     * Lê os headers e os pixels de um arquivo BMP para context->work.pixels_rgb, reservando
+     * o contexto inteiro de uma vez para que compress_image_parallel não precise cortar a arena de novo.
+     * Retorna 1 em caso de sucesso, 0 em caso de erro.
+     */
+    FILE *input_file = fopen(input_filename, "rb");
+    if (!input_file) {
+        printf("Erro ao abrir o arquivo BMP %s\n", input_filename);
+        return 0;
+    }
+
+    loadBMPHeaders(input_file, file_header, info_header);
+    if (info_header->Compression != 0) return 0; // loadBMPHeaders já fechou o arquivo
+
+    int width = info_header->Width;
+    int height = info_header->Height;
+    if (width <= 0 || height <= 0) {
+        printf("Erro: Dimensões inválidas na imagem %s.\n", input_filename);
+        fclose(input_file);
+        return 0;
+    }
+
+    int mb_rows = (height + 15) / 16;
+    int index_count = index_interval > 0 ? (mb_rows + index_interval - 1) / index_interval : 0;
+    if (!reserve_encoder_context(context, width, height, count_bands(mb_rows, num_threads), index_count)) {
+        printf("Erro ao alocar memória para os pixels RGB.\n");
+        fclose(input_file);
+        return 0;
+    }
+    readPixels(input_file, *info_header, *file_header, context->work.pixels_rgb);
+    fclose(input_file); // Fecha o arquivo BMP após leituras finalizadas
+    return 1;
+}
+
+static int write_encoded_file(const char *output_filename, ENCODER_CONTEXT *context, BitBuffer **encoded_macroblocks, COMPRESSED_HEADER *header, MACROBLOCK_INDEX *index) {
+    /*
+     * Monta o arquivo comprimido no buffer de saída do contexto e o grava de uma vez.
+     * Retorna 1 em caso de sucesso, 0 em caso de erro.
+     */
+    if (!all_macroblocks_encoded(encoded_macroblocks, header->macroblock_count)) {
+        printf("Erro ao codificar os macroblocos com huffman.\n");
+        return 0;
+    }
+
+    size_t size;
+    serialize_encoded_macroblocks(encoded_macroblocks, header, index, NULL, 0, &size);
+    if (!grow_aligned_buffer((void **)&context->output, &context->output_capacity, size, sizeof(uint8_t), &context->work.allocations)) {
+        printf("Erro ao alocar memória para o arquivo %s.\n", output_filename);
+        return 0;
+    }
+
+    int ok = serialize_encoded_macroblocks(encoded_macroblocks, header, index, context->output, context->output_capacity, &size);
+    FILE *output_file = fopen(output_filename, "wb");
+    if (!output_file) {
+        printf("Erro ao abrir o arquivo %s para escrita", output_filename);
+        return 0;
+    }
+    if (fwrite(context->output, sizeof(uint8_t), size, output_file) != size) ok = 0;
+    if (fclose(output_file) != 0) ok = 0;
+    if (!ok) printf("Erro ao gravar o arquivo %s.\n", output_filename);
+    return ok;
+}
+
+static int compress_bmp_file(const char *input_filename, const char *output_filename, const CODEC_OPTIONS *options, size_t target_size, int *out_quality, int *out_fits, ENCODER_CONTEXT *context) {
+    /*
+     * Lê os pixels de um arquivo BMP, comprime com compress_image_parallel (ou, se target_size
+     * não for zero, com compress_image_target_size, que escreve a qualidade escolhida em *out_quality
+     * e se o arquivo coube em *out_fits)
+     * e grava o arquivo binário. Retorna 1 em caso de sucesso, 0 em caso de erro.
+     */
+    ENCODER_CONTEXT local_context;
+    ENCODER_CONTEXT *ctx = context;
+    if (!ctx) {
+        init_encoder_context(&local_context);
+        ctx = &local_context;
+    }
+
+    int ok = 0;
+    BITMAPFILEHEADER file_header;
+    BITMAPINFOHEADER info_header;
+    if (read_bmp_into_context(input_filename, ctx, options->num_threads, options->index_interval, &file_header, &info_header)) {
+        int width = info_header.Width;
+        int height = info_header.Height;
+        int macroblock_count;
+        int quality = options->quality;
+        int fits = 1;
+        MACROBLOCK_INDEX index = {options->index_interval, 0, NULL};
+        MACROBLOCK_INDEX *index_ptr = options->index_interval > 0 ? &index : NULL;
+        BitBuffer **encoded_macroblocks = target_size > 0
+            ? compress_image_target_size(ctx->work.pixels_rgb, width, height, target_size, options, index_ptr, &macroblock_count, &quality, &fits, ctx)
+            : compress_image_parallel(ctx->work.pixels_rgb, width, height, options, index_ptr, &macroblock_count, ctx);
+        if (out_quality) *out_quality = quality;
+        if (out_fits) *out_fits = fits;
+
+        if (!encoded_macroblocks) {
+            printf("Erro ao alocar memória para comprimir a imagem %s.\n", input_filename);
+        } else {
+            COMPRESSED_HEADER header;
+            memset(&header, 0, sizeof(header));
+            header.file_header = file_header;
+            header.info_header = info_header;
+            header.quality = quality;
+            header.macroblock_count = macroblock_count;
+            header.restart_interval = options->restart_interval;
+            header.flags = (options->adaptive ? FORMAT_FLAG_ADAPTIVE : 0) | (options->cbp ? FORMAT_FLAG_CBP : 0);
+            if (options->matrices) set_header_matrices(&header, &ctx->tables);
+            ok = write_encoded_file(output_filename, ctx, encoded_macroblocks, &header, index_ptr);
+        }
+    }
+
+    if (!context) free_encoder_context(&local_context);
+    return ok;
+}
+
+int compress_file(const char *input_filename, const char *output_filename, const CODEC_OPTIONS *options, ENCODER_CONTEXT *context) {
+    /*
+     * Comprime um arquivo BMP inteiro: lê os pixels, comprime com compress_image_parallel
+     * e grava o arquivo binário. Retorna 1 em caso de sucesso, 0 em caso de erro.
+     *
+     * Parâmetros:
+     * input_filename: arquivo BMP de entrada
+     * output_filename: arquivo comprimido de saída
+     * options: opções de compressão (qualidade de 1 a 100 e threads a partir de 1)
+     * context: contexto do compressor reaproveitável, ou NULL para usar um temporário
+     */
+    return compress_bmp_file(input_filename, output_filename, options, 0, NULL, NULL, context);
+}
+
+int compress_file_target_size(const char *input_filename, const char *output_filename, size_t target_size, const CODEC_OPTIONS *options, int *out_quality, int *out_fits, ENCODER_CONTEXT *context) {
+    /*
+     * Comprime um arquivo BMP com a maior qualidade cujo arquivo comprimido cabe em target_size
+     * bytes (compress_image_target_size) e grava o resultado uma única vez.
+     * Retorna 1 em caso de sucesso, 0 em caso de erro.
+     *
+     * Parâmetros:
+     * input_filename: arquivo BMP de entrada
+     * output_filename: arquivo comprimido de saída
+     * target_size: tamanho máximo do arquivo comprimido em bytes (maior que zero)
+     * options: opções de compressão, como em compress_file (a qualidade é ignorada)
+     * out_quality: ponteiro para armazenar a qualidade escolhida
+     * out_fits: ponteiro para armazenar 1 se o arquivo cabe em target_size, 0 se nem a qualidade 1 coube
+     *           (o arquivo é gravado com qualidade 1 mesmo assim)
+     * context: contexto do compressor reaproveitável, ou NULL para usar um temporário
+     */
+    *out_quality = 0;
+    *out_fits = 0;
+    return compress_bmp_file(input_filename, output_filename, options, target_size, out_quality, out_fits, context);
+}
+
+// Estado compartilhado pelas versões de compress_file_qualities
+typedef struct {
+    COMPRESSION_JOB *analysis;          // Imagem já transformada pela DCT (coeficientes compartilhados)
+    const int *qualities;
+    const char *const *output_filenames;
+    ENCODER_CONTEXT *first_context;     // Contexto da primeira thread (o de quem chama, se houver)
+    ENCODER_CONTEXT *contexts;          // Contextos das outras threads
+    BITMAPFILEHEADER file_header;
+    BITMAPINFOHEADER info_header;
+    CODEC_OPTIONS options;              // Opções de cada versão, com as threads que sobram quando há poucas versões
+    int *results;
+} RENDITION_JOB;
+
+static void encode_rendition(void *arg, int rendition, int thread_id) {
+    /*
+     * Comprime e grava uma versão: quantização, RLE e Huffman a partir dos coeficientes
+     * compartilhados, com os vetores do contexto da thread.
+     */
+    RENDITION_JOB *renditions = (RENDITION_JOB *)arg;
+    COMPRESSION_JOB *analysis = renditions->analysis;
+    ENCODER_CONTEXT *context = thread_id == 0 ? renditions->first_context : &renditions->contexts[thread_id];
+    int quality = renditions->qualities[rendition];
+
+    const CODEC_OPTIONS *options = &renditions->options;
+
+    COMPRESSION_JOB job;
+    MACROBLOCK_INDEX index = {options->index_interval, 0, NULL};
+    MACROBLOCK_INDEX *index_ptr = options->index_interval > 0 ? &index : NULL;
+    if (!prepare_compression(&job, NULL, analysis->width, analysis->height, options, index_ptr, context)) {
+        renditions->results[rendition] = 0;
+        return;
+    }
+    job.coefficients = analysis->coefficients;
+    job.quality = quality;
+    set_codec_tables_quality(job.tables, quality);
+
+    run_parallel(requantize_band, &job, job.num_bands, options->num_threads);
+    stitch_predictors(&job, index_ptr);
+    encode_bands(&job, options->num_threads);
+
+    COMPRESSED_HEADER header;
+    memset(&header, 0, sizeof(header));
+    header.file_header = renditions->file_header;
+    header.info_header = renditions->info_header;
+    header.quality = quality;
+    header.macroblock_count = job.mb_cols * job.mb_rows;
+    header.restart_interval = job.restart_interval;
+    header.flags = (job.adaptive ? FORMAT_FLAG_ADAPTIVE : 0) | (job.cbp ? FORMAT_FLAG_CBP : 0);
+    if (job.matrices) set_header_matrices(&header, job.tables);
+    renditions->results[rendition] = write_encoded_file(renditions->output_filenames[rendition], context, job.buffers, &header, index_ptr);
+}
+
+int compress_file_qualities(const char *input_filename, const char *const *output_filenames, const int *qualities, int count, const CODEC_OPTIONS *options, ENCODER_CONTEXT *context) {
+    /*
+     * Comprime um arquivo BMP em várias qualidades de uma vez. A leitura, a conversão de cores,
+     * a subamostragem e a DCT são feitas uma única vez; a partir dos coeficientes guardados, cada
+     * versão faz só a quantização, o RLE e o Huffman, e as versões rodam em paralelo (cada thread
+     * com o seu contexto). Cada arquivo é idêntico ao de compress_file na mesma qualidade.
+     * Retorna 1 se todas as versões foram gravadas, 0 em caso de erro.
+     *
+     * Parâmetros:
+     * input_filename: arquivo BMP de entrada
+     * output_filenames: arquivo comprimido de saída de cada versão
+     * qualities: qualidade de cada versão (1 a 100)
+     * count: número de versões
+     * options: opções de compressão, como em compress_file (a qualidade é ignorada)
+     * context: contexto do compressor reaproveitável (usado pela análise e pela primeira thread),
+     *          ou NULL para usar um temporário
+     */
+    if (count <= 0) return 1;
+    int num_threads = options->num_threads;
+    int rendition_threads = num_threads < count ? num_threads : count;
+    if (rendition_threads < 1) rendition_threads = 1;
+
+    ENCODER_CONTEXT *contexts = (ENCODER_CONTEXT *)calloc(rendition_threads, sizeof(ENCODER_CONTEXT));
+    int *results = (int *)calloc(count, sizeof(int));
+    if (!contexts || !results) {
+        printf("Erro ao alocar memória para as versões.\n");
+        free(contexts);
+        free(results);
+        return 0;
+    }
+    // O contexto de quem chama é o da primeira thread; os outros são temporários
+    for (int t = 0; t < rendition_threads; t++) {
+        init_encoder_context(&contexts[t]);
+    }
+    ENCODER_CONTEXT *ctx = context ? context : &contexts[0];
+
+    int ok = 0;
+    RENDITION_JOB renditions;
+    memset(&renditions, 0, sizeof(renditions));
+    if (read_bmp_into_context(input_filename, ctx, num_threads, options->index_interval, &renditions.file_header, &renditions.info_header)) {
+        int width = renditions.info_header.Width;
+        int height = renditions.info_header.Height;
+        int macroblock_count = ((width + 15) / 16) * ((height + 15) / 16);
+
+        // 1. Conversão de cores e DCT uma única vez, com todas as threads
+        COMPRESSION_JOB analysis;
+        if (prepare_compression(&analysis, ctx->work.pixels_rgb, width, height, options, NULL, ctx) &&
+            grow_aligned_buffer((void **)&ctx->coefficients, &ctx->coefficient_capacity, macroblock_count, sizeof(MACROBLOCO), &ctx->work.allocations)) {
+            analysis.coefficients = ctx->coefficients;
+            run_parallel(transform_band, &analysis, analysis.num_bands, num_threads);
+
+            // 2. Uma tarefa por versão; as threads que sobram ajudam dentro de cada versão
+            renditions.analysis = &analysis;
+            renditions.qualities = qualities;
+            renditions.output_filenames = output_filenames;
+            renditions.first_context = ctx;
+            renditions.contexts = contexts;
+            renditions.options = *options;
+            renditions.options.num_threads = (num_threads + rendition_threads - 1) / rendition_threads;
+            renditions.results = results;
+            ok = run_work_stealing(encode_rendition, &renditions, count, rendition_threads);
+
+            for (int r = 0; r < count; r++) {
+                if (!results[r]) ok = 0;
+            }
+        } else {
+            printf("Erro ao alocar memória para a análise da imagem %s.\n", input_filename);
+        }
+    }
+
+    for (int t = 0; t < rendition_threads; t++) {
+        free_encoder_context(&contexts[t]);
+    }
+    free(contexts);
+    free(results);
+    return ok;
+}
+
+static void print_decode_status(int status) {
+    // Mensagem do descompressor para o resultado de decompress_image_memory
+    if (status == CODEC_ERROR_INVALID_HEADER) {
+        printf("Erro: Header do arquivo comprimido é inválido.\n");
+    } else if (status == CODEC_ERROR_INVALID_ARGUMENT) {
+        printf("Erro: Escala de decodificação inválida.\n");
+    } else if (status == CODEC_ERROR_OUT_OF_MEMORY) {
+        printf("Erro ao alocar memória para a descompressão.\n");
+    } else if (status == CODEC_ERROR_DAMAGED_DATA) {
+        printf("AVISO: Arquivo comprimido está truncado ou corrompido; os trechos afetados ficaram incompletos.\n");
+    }
+}
+
+int decompress_file(const char *input_filename, const char *output_filename, int num_threads, int scale, DECODER_CONTEXT *context) {
+    /*
+     * Descomprime um arquivo gerado pelo compressor e grava o BMP reconstruído.
+     * Retorna 1 em caso de sucesso, 0 em caso de erro.
+     *
+     * Parâmetros:
+     * input_filename: arquivo comprimido de entrada
+     * output_filename: arquivo BMP de saída
+     * num_threads: número de threads a serem usadas
+     * scale: denominador da escala do BMP gravado (1 = tamanho original, ou 2, 4 e 8)
+     * context: contexto do descompressor reaproveitável, ou NULL para usar um temporário
+     */
+    DECODER_CONTEXT local_context;
+    DECODER_CONTEXT *ctx = context;
+    if (!ctx) {
+        init_decoder_context(&local_context);
+        ctx = &local_context;
+    }
+
+    int ok = 0;
+    int status;
+    COMPRESSED_HEADER header;
+    PIXELRGB *pixels_rgb = decompress_image_parallel(input_filename, &header, num_threads, scale, ctx, &status);
+    print_decode_status(status);
+    if (!pixels_rgb) {
+        printf("Falha ao ler ou decodificar o arquivo %s.\n", input_filename);
+    } else {
+        FILE *output_file = fopen(output_filename, "wb");
+        if (!output_file) {
+            printf("Erro ao abrir o arquivo de saída %s\n", output_filename);
+        } else {
+            // Em tamanho reduzido, os headers do BMP original dão lugar aos das novas dimensões
+            if (scale != 1) {
+                int width, height;
+                scaled_image_size(header.info_header.Width, header.info_header.Height, scale, &width, &height);
+                createBMPHeaders(width, height, &header.file_header, &header.info_header);
+            }
+            writeBMP(output_file, header.file_header, header.info_header, pixels_rgb);
+            ok = fclose(output_file) == 0;
+        }
+    }
+
+    if (!context) free_decoder_context(&local_context);
+    return ok;
+}
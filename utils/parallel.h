@@ -0,0 +1,25 @@
+#ifndef PARALLEL_H
+    #define PARALLEL_H
+
+    #include "bitmap.h"
+    #include "codec.h"
+    #include "huffman.h"
+    #include "context.h"
+
+    // Função executada por cada tarefa de run_parallel (index vai de 0 a num_tasks - 1)
+    typedef void (*PARALLEL_TASK)(void *arg, int index);
+
+    // Função executada por cada tarefa de run_work_stealing (thread_id vai de 0 a num_threads - 1)
+    typedef void (*STEALING_TASK)(void *arg, int index, int thread_id);
+
+    int run_parallel(PARALLEL_TASK task, void *arg, int num_tasks, int num_threads);
+    int run_work_stealing(STEALING_TASK task, void *arg, int num_tasks, int num_threads);
+    BitBuffer** compress_image_parallel(const PIXELRGB *pixels_rgb, int width, int height, const CODEC_OPTIONS *options, MACROBLOCK_INDEX *index, int *out_macroblock_count, ENCODER_CONTEXT *context);
+    BitBuffer** compress_image_target_size(const PIXELRGB *pixels_rgb, int width, int height, size_t target_size, const CODEC_OPTIONS *options, MACROBLOCK_INDEX *index, int *out_macroblock_count, int *out_quality, int *out_fits, ENCODER_CONTEXT *context);
+    PIXELRGB* decompress_image_memory(const uint8_t *data, size_t size, COMPRESSED_HEADER *header, int num_threads, int scale, DECODER_CONTEXT *context, PIXELRGB *output, int *status);
+    PIXELRGB* decompress_image_parallel(const char *input_filename, COMPRESSED_HEADER *header, int num_threads, int scale, DECODER_CONTEXT *context, int *status);
+    int compress_file(const char *input_filename, const char *output_filename, const CODEC_OPTIONS *options, ENCODER_CONTEXT *context);
+    int compress_file_target_size(const char *input_filename, const char *output_filename, size_t target_size, const CODEC_OPTIONS *options, int *out_quality, int *out_fits, ENCODER_CONTEXT *context);
+    int compress_file_qualities(const char *input_filename, const char *const *output_filenames, const int *qualities, int count, const CODEC_OPTIONS *options, ENCODER_CONTEXT *context);
+    int decompress_file(const char *input_filename, const char *output_filename, int num_threads, int scale, DECODER_CONTEXT *context);
+#endif
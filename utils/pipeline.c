@@ -0,0 +1,359 @@
+/* Esse arquivo implementa o compressor em pipeline, pensado para imagens grandes.
+ * Uma thread lê o BMP e converte as cores faixa por faixa, N threads fazem DCT, quantização,
+ * vetorização e RLE de linhas de macroblocos, e a thread chamadora faz a codificação diferencial,
+ * o Huffman e a escrita, que são seriais por causa do preditor DC.
+ * Os estágios trocam números de linhas de macroblocos por filas circulares sem travas com um único
+ * produtor e um único consumidor, então a leitura do disco fica sobreposta ao cálculo.
+ * O arquivo gerado é idêntico ao de compress_file.
+ */
+#define _POSIX_C_SOURCE 200809L // sched_yield
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "pipeline.h"
+#include "bitmap.h"
+#include "codec.h"
+#include "huffman.h"
+#include "arena.h"
+
+#define RING_CAPACITY 4 // Linhas de macroblocos em trânsito por fila
+#define CACHE_LINE 64
+
+// Fila circular sem travas: só um produtor escreve tail e só um consumidor escreve head.
+// Os espaçadores deixam head e tail em linhas de cache diferentes.
+typedef struct {
+    int slots[RING_CAPACITY];
+    char pad_slots[CACHE_LINE];
+    size_t head;                // Próxima posição a ser lida
+    long pop_stalls;            // Esperas do consumidor com a fila vazia
+    char pad_head[CACHE_LINE];
+    size_t tail;                // Próxima posição a ser escrita
+    long push_stalls;           // Esperas do produtor com a fila cheia
+    int max_depth;              // Maior ocupação vista pelo produtor
+} SPSC_RING;
+
+// Estado compartilhado pelos estágios
+typedef struct {
+    FILE *input_file;
+    int width, height, quality;
+    int effort;                 // 0 = quantização por arredondamento, 1 = quantização taxa-distorção
+    int adaptive;               // 1 = quantização adaptativa, com o nível de cada macrobloco gravado no arquivo
+    int cbp;                    // 1 = padrão de blocos codificados em cada macrobloco, sem os blocos vazios
+    int restart_interval;
+    int mb_cols, mb_rows;
+    int num_workers;
+    PIXELRGB *stripe_rgb;       // Uma faixa de 16 linhas de pixels lida do BMP
+    PIXELYCBCR *pixels_ycbcr;
+    MACROBLOCO *macroblocks;
+    MACROBLOCO_VETORIZADO *vectorized_macroblocks;
+    MACROBLOCO_RLE_DIFERENCIAL *rle_diff_macroblocks;
+    SPSC_RING *input_rings;     // Leitura -> DCT (uma fila por thread de DCT)
+    SPSC_RING *output_rings;    // DCT -> Huffman (uma fila por thread de DCT)
+    CODEC_TABLES tables;        // Matriz da DCT e quantização, calculadas uma vez para todas as linhas
+    HUFFMAN_ENCODE_TABLES huffman; // Tabela de emissão dos pares AC
+} PIPELINE_JOB;
+
+typedef struct {
+    PIPELINE_JOB *job;
+    int id;
+} PIPELINE_WORKER;
+
+static void ring_push(SPSC_RING *ring, int value) {
+    // Coloca um valor na fila, esperando enquanto ela estiver cheia
+    size_t tail = ring->tail;
+    if (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == RING_CAPACITY) {
+        ring->push_stalls++;
+        while (tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == RING_CAPACITY) sched_yield();
+    }
+    ring->slots[tail % RING_CAPACITY] = value;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+
+    int depth = (int)(tail + 1 - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE));
+    if (depth > ring->max_depth) ring->max_depth = depth;
+}
+
+static int ring_pop(SPSC_RING *ring) {
+    // Retira um valor da fila, esperando enquanto ela estiver vazia
+    size_t head = ring->head;
+    if (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+        ring->pop_stalls++;
+        while (__atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) sched_yield();
+    }
+    int value = ring->slots[head % RING_CAPACITY];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return value;
+}
+
+static void *read_stage(void *data) {
+    /*
+     * Primeiro estágio: lê uma linha de macroblocos (16 linhas de pixels) por vez, converte para
+     * YCbCr e entrega a linha às threads de DCT em rodízio. No fim, manda -1 para cada uma.
+     */
+    PIPELINE_JOB *job = (PIPELINE_JOB *)data;
+    for (int row = 0; row < job->mb_rows; row++) {
+        int pixel_start = row * 16;
+        int pixel_end = pixel_start + 16 < job->height ? pixel_start + 16 : job->height;
+        int count = (pixel_end - pixel_start) * job->width;
+
+        readPixelRows(job->input_file, job->width, pixel_end - pixel_start, job->stripe_rgb);
+        convertToYCBCR(job->stripe_rgb, job->pixels_ycbcr + pixel_start * job->width, count);
+        ring_push(&job->input_rings[row % job->num_workers], row);
+    }
+    for (int w = 0; w < job->num_workers; w++) {
+        ring_push(&job->input_rings[w], -1);
+    }
+    return NULL;
+}
+
+static void *dct_stage(void *data) {
+    /*
+     * Segundo estágio: DCT, quantização, vetorização e RLE (com DC absoluto) de cada linha
+     * recebida. As linhas saem na mesma ordem em que entraram, e o -1 final é repassado.
+     */
+    PIPELINE_WORKER *worker = (PIPELINE_WORKER *)data;
+    PIPELINE_JOB *job = worker->job;
+    SPSC_RING *input = &job->input_rings[worker->id];
+    SPSC_RING *output = &job->output_rings[worker->id];
+
+    for (;;) {
+        int row = ring_pop(input);
+        if (row >= 0) {
+            int first = row * job->mb_cols;
+            encodeMacroblockRows(job->pixels_ycbcr, job->width, job->height, row, row + 1, job->macroblocks + first, &job->tables, !job->adaptive && job->effort == 0);
+            if (job->adaptive) {
+                quantizeMacroblocksAdaptive(job->macroblocks + first, job->rle_diff_macroblocks + first, job->mb_cols, &job->tables, job->effort > 0 ? RDO_LAMBDA_SCALE : 0.0f);
+            } else if (job->effort > 0) {
+                quantizeMacroblocksRDO(job->macroblocks + first, job->mb_cols, &job->tables, RDO_LAMBDA_SCALE);
+            } else {
+                quantizeMacroblocksWithTables(job->macroblocks + first, job->mb_cols, &job->tables);
+            }
+            vectorize_macroblocks(job->macroblocks + first, job->vectorized_macroblocks + first, job->mb_cols);
+            rle_encode_macroblocks(job->rle_diff_macroblocks + first, job->vectorized_macroblocks + first, job->mb_cols);
+        }
+        ring_push(output, row);
+        if (row < 0) break;
+    }
+    return NULL;
+}
+
+static int entropy_stage(PIPELINE_JOB *job, FILE *output_file, MACROBLOCK_INDEX *index) {
+    /*
+     * Último estágio: recebe as linhas em ordem, faz a codificação diferencial do DC com o
+     * preditor corrente, codifica cada macrobloco com Huffman e grava no arquivo.
+     * Preenche as entradas do índice, se houver. Retorna 1 em caso de sucesso, 0 em caso de erro.
+     */
+    int predictors[3] = {0, 0, 0};
+    int64_t offset = ftell(output_file);
+    BitBuffer *buffer = init_bit_buffer(MAX_MACROBLOCK_BYTES);
+    int ok = buffer != NULL;
+
+    for (int row = 0; row < job->mb_rows; row++) {
+        if (ring_pop(&job->output_rings[row % job->num_workers]) != row) {
+            printf("Erro: Linha de macroblocos %d chegou fora de ordem no pipeline.\n", row);
+            ok = 0;
+        }
+
+        int first = row * job->mb_cols;
+        if (index && row % index->interval == 0) {
+            // Preditores em vigor no início da linha: zero em um reinício, senão os DCs do macrobloco anterior
+            MACROBLOCK_INDEX_ENTRY *entry = &index->entries[row / index->interval];
+            entry->offset = offset;
+            if (job->restart_interval > 0 && first % job->restart_interval == 0) {
+                entry->predictors[0] = entry->predictors[1] = entry->predictors[2] = 0;
+            } else {
+                memcpy(entry->predictors, predictors, sizeof(predictors));
+            }
+        }
+
+        differential_encode_dc_restart(job->rle_diff_macroblocks + first, first, job->mb_cols, job->restart_interval, predictors);
+        for (int i = first; i < first + job->mb_cols; i++) {
+            // Um único buffer, já com o pior caso de um macrobloco, é reaproveitado por todos
+            if (!buffer || !huffman_encode_macroblock_into(buffer, &job->rle_diff_macroblocks[i], job->adaptive, job->cbp, &job->huffman)) {
+                printf("Erro ao codificar macrobloco %d com huffman.\n", i);
+                ok = 0;
+                continue;
+            }
+            offset += write_macroblock_buffer(output_file, buffer);
+        }
+    }
+
+    // Recebe o -1 de cada thread de DCT, que pode estar esperando espaço na fila para entregá-lo
+    for (int w = 0; w < job->num_workers; w++) {
+        ring_pop(&job->output_rings[w]);
+    }
+    free_bit_buffer(buffer);
+    return ok;
+}
+
+static void collect_stats(PIPELINE_JOB *job, PIPELINE_STATS *stats) {
+    // Soma os contadores das filas depois que todas as threads terminaram
+    memset(stats, 0, sizeof(*stats));
+    stats->dct_threads = job->num_workers;
+    stats->queue_capacity = RING_CAPACITY;
+    for (int w = 0; w < job->num_workers; w++) {
+        SPSC_RING *input = &job->input_rings[w];
+        SPSC_RING *output = &job->output_rings[w];
+        stats->read_stalls += input->push_stalls;
+        stats->dct_input_stalls += input->pop_stalls;
+        stats->dct_output_stalls += output->push_stalls;
+        stats->entropy_stalls += output->pop_stalls;
+        if (input->max_depth > stats->max_input_depth) stats->max_input_depth = input->max_depth;
+        if (output->max_depth > stats->max_output_depth) stats->max_output_depth = output->max_depth;
+    }
+}
+
+int compress_file_pipelined(const char *input_filename, const char *output_filename, const CODEC_OPTIONS *options, PIPELINE_STATS *stats) {
+    /*
+     * Comprime um arquivo BMP com o pipeline leitura -> DCT -> Huffman, usando uma thread de leitura,
+     * options->num_threads threads de DCT e a thread chamadora para o Huffman e a escrita.
+     * O arquivo gerado é idêntico ao de compress_file. Retorna 1 em caso de sucesso, 0 em caso de erro.
+     *
+     * Parâmetros:
+     * input_filename: arquivo BMP de entrada
+     * output_filename: arquivo comprimido de saída
+     * options: opções de compressão, como em compress_file (num_threads é o número de threads de DCT e quantização)
+     * stats: se não for NULL, recebe os contadores de espera e a ocupação das filas
+     */
+    FILE *input_file = fopen(input_filename, "rb");
+    if (!input_file) {
+        printf("Erro ao abrir o arquivo BMP %s\n", input_filename);
+        return 0;
+    }
+
+    BITMAPFILEHEADER file_header;
+    BITMAPINFOHEADER info_header;
+    loadBMPHeaders(input_file, &file_header, &info_header);
+    if (info_header.Compression != 0) return 0; // loadBMPHeaders já fechou o arquivo
+
+    PIPELINE_JOB job;
+    memset(&job, 0, sizeof(job));
+    job.input_file = input_file;
+    job.width = info_header.Width;
+    job.height = info_header.Height;
+    job.quality = options->quality;
+    job.effort = options->effort;
+    job.adaptive = options->adaptive;
+    job.cbp = options->cbp;
+    job.restart_interval = options->restart_interval;
+    job.mb_cols = (job.width + 15) / 16;
+    job.mb_rows = (job.height + 15) / 16;
+    job.num_workers = options->num_threads > 0 ? options->num_threads : 1;
+    if (job.num_workers > job.mb_rows) job.num_workers = job.mb_rows;
+
+    if (job.width <= 0 || job.height <= 0) {
+        printf("Erro: Dimensões inválidas na imagem %s.\n", input_filename);
+        fclose(input_file);
+        return 0;
+    }
+
+    int macroblock_count = job.mb_cols * job.mb_rows;
+    init_codec_tables(&job.tables, job.quality);
+    set_codec_tables_base(&job.tables, options->matrices);
+    set_codec_tables_quality(&job.tables, job.quality);
+    build_huffman_encode_tables(&job.huffman);
+
+    MACROBLOCK_INDEX index = {options->index_interval, 0, NULL};
+    MACROBLOCK_INDEX *index_ptr = options->index_interval > 0 ? &index : NULL;
+    if (index_ptr) index.count = (job.mb_rows + index.interval - 1) / index.interval;
+
+    // Toda a memória da imagem sai de uma arena: uma alocação e uma liberação, e as filas
+    // ficam alinhadas em linhas de cache
+    size_t pixel_count = (size_t)job.width * job.height;
+    size_t stripe_size = (size_t)job.width * 16 * sizeof(PIXELRGB);
+    size_t ring_size = job.num_workers * sizeof(SPSC_RING);
+    size_t worker_size = job.num_workers * sizeof(PIPELINE_WORKER);
+    ARENA arena = {NULL, 0, 0};
+    int arena_ok = arena_reserve(&arena, arena_size(stripe_size) + arena_size(pixel_count * sizeof(PIXELYCBCR)) +
+                                         arena_size(macroblock_count * sizeof(MACROBLOCO)) +
+                                         arena_size(macroblock_count * sizeof(MACROBLOCO_VETORIZADO)) +
+                                         arena_size(macroblock_count * sizeof(MACROBLOCO_RLE_DIFERENCIAL)) +
+                                         2 * arena_size(ring_size) + arena_size(worker_size) +
+                                         arena_size(job.num_workers * sizeof(pthread_t)) +
+                                         arena_size(index.count * sizeof(MACROBLOCK_INDEX_ENTRY)), NULL);
+    job.stripe_rgb = (PIXELRGB *)arena_alloc(&arena, stripe_size);
+    job.pixels_ycbcr = (PIXELYCBCR *)arena_alloc(&arena, pixel_count * sizeof(PIXELYCBCR));
+    job.macroblocks = (MACROBLOCO *)arena_alloc(&arena, macroblock_count * sizeof(MACROBLOCO));
+    job.vectorized_macroblocks = (MACROBLOCO_VETORIZADO *)arena_alloc(&arena, macroblock_count * sizeof(MACROBLOCO_VETORIZADO));
+    job.rle_diff_macroblocks = (MACROBLOCO_RLE_DIFERENCIAL *)arena_alloc(&arena, macroblock_count * sizeof(MACROBLOCO_RLE_DIFERENCIAL));
+    job.input_rings = (SPSC_RING *)arena_alloc(&arena, ring_size);
+    job.output_rings = (SPSC_RING *)arena_alloc(&arena, ring_size);
+    PIPELINE_WORKER *workers = (PIPELINE_WORKER *)arena_alloc(&arena, worker_size);
+    pthread_t *threads = (pthread_t *)arena_alloc(&arena, job.num_workers * sizeof(pthread_t));
+    index.entries = (MACROBLOCK_INDEX_ENTRY *)arena_alloc(&arena, index.count * sizeof(MACROBLOCK_INDEX_ENTRY));
+
+    FILE *output_file = NULL;
+    int ok = 0;
+    if (!arena_ok) {
+        printf("Erro ao alocar memória para o pipeline.\n");
+    } else if (!(output_file = fopen(output_filename, "wb"))) {
+        printf("Erro ao abrir o arquivo %s para escrita", output_filename);
+    } else {
+        // As filas começam vazias (a arena não é zerada)
+        memset(job.input_rings, 0, ring_size);
+        memset(job.output_rings, 0, ring_size);
+        memset(workers, 0, worker_size);
+        COMPRESSED_HEADER header;
+        memset(&header, 0, sizeof(header));
+        header.file_header = file_header;
+        header.info_header = info_header;
+        header.quality = job.quality;
+        header.macroblock_count = macroblock_count;
+        header.restart_interval = job.restart_interval;
+        header.flags = (job.adaptive ? FORMAT_FLAG_ADAPTIVE : 0) | (job.cbp ? FORMAT_FLAG_CBP : 0);
+        if (options->matrices) set_header_matrices(&header, &job.tables);
+        set_format_flags(&header, index_ptr != NULL);
+        write_compressed_header(output_file, &header);
+        fseek(input_file, file_header.OffBits, SEEK_SET); // pular o header do BMP
+
+        // Threads de DCT; se alguma não puder ser criada, o pipeline segue com as que existem
+        int created = 0;
+        for (; created < job.num_workers; created++) {
+            workers[created].job = &job;
+            workers[created].id = created;
+            if (pthread_create(&threads[created], NULL, dct_stage, &workers[created]) != 0) break;
+        }
+        job.num_workers = created;
+
+        pthread_t reader;
+        if (created == 0 || pthread_create(&reader, NULL, read_stage, &job) != 0) {
+            printf("Erro ao criar as threads do pipeline.\n");
+            for (int w = 0; w < created; w++) {
+                ring_push(&job.input_rings[w], -1);
+                ring_pop(&job.output_rings[w]);
+            }
+        } else {
+            ok = entropy_stage(&job, output_file, index_ptr);
+            pthread_join(reader, NULL);
+            if (index_ptr) write_macroblock_index(output_file, index_ptr);
+        }
+
+        for (int w = 0; w < created; w++) {
+            pthread_join(threads[w], NULL);
+        }
+        if (stats) collect_stats(&job, stats);
+
+        if (fclose(output_file) != 0) {
+            printf("Erro ao gravar o arquivo %s.\n", output_filename);
+            ok = 0;
+        }
+    }
+
+    fclose(input_file);
+    arena_free(&arena);
+    return ok;
+}
+
+void print_pipeline_stats(const PIPELINE_STATS *stats) {
+    /*
+     * Imprime a ocupação das filas e quantas vezes cada estágio ficou esperando.
+     * Muitas esperas da leitura indicam que a DCT é o gargalo; muitas esperas do Huffman indicam o contrário.
+     */
+    printf("Pipeline: 1 thread de leitura, %d de DCT e 1 de Huffman; filas de %d linhas de macroblocos\n", stats->dct_threads, stats->queue_capacity);
+    printf("    Leitura/cores:   %ld esperas com a fila de entrada cheia\n", stats->read_stalls);
+    printf("    DCT/quantização: %ld esperas por entrada, %ld esperas com a fila de saída cheia\n", stats->dct_input_stalls, stats->dct_output_stalls);
+    printf("    Huffman/escrita: %ld esperas por entrada\n", stats->entropy_stalls);
+    printf("    Ocupação máxima das filas: entrada %d/%d, saída %d/%d\n", stats->max_input_depth, stats->queue_capacity, stats->max_output_depth, stats->queue_capacity);
+}
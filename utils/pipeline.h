@@ -0,0 +1,20 @@
+#ifndef PIPELINE_H
+    #define PIPELINE_H
+
+    #include "codec.h"
+
+    // Contadores de uma execução do compressor em pipeline
+    typedef struct {
+        int dct_threads;            // Threads do estágio de DCT e quantização
+        int queue_capacity;         // Linhas de macroblocos que cabem em cada fila
+        long read_stalls;           // Vezes em que a leitura esperou uma fila de entrada cheia
+        long dct_input_stalls;      // Vezes em que a DCT esperou uma fila de entrada vazia
+        long dct_output_stalls;     // Vezes em que a DCT esperou uma fila de saída cheia
+        long entropy_stalls;        // Vezes em que o Huffman esperou uma fila de saída vazia
+        int max_input_depth;        // Maior ocupação observada nas filas de entrada
+        int max_output_depth;       // Maior ocupação observada nas filas de saída
+    } PIPELINE_STATS;
+
+    int compress_file_pipelined(const char *input_filename, const char *output_filename, const CODEC_OPTIONS *options, PIPELINE_STATS *stats);
+    void print_pipeline_stats(const PIPELINE_STATS *stats);
+#endif
@@ -575,22 +575,21 @@ void testACCategoryEncoding(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int mac
         BLOCO_RLE_DIFERENCIAL *block_y = &rle_macroblocks[i].Y_vetor[0];
         printf("  Componente Y[0] (%d coeficientes AC):\n", block_y->quantidade);
         
+        uint64_t mask_y = block_y->mascara;
+        int last_y = 0;
         for (int k = 0; k < block_y->quantidade && k < 5; k++) { // Mostra apenas os primeiros 5
-            PAR_RLE *par = &block_y->pares[k];
-            int ac_value = (int)round(par->valor);
-            
-            // Verifica se e EOB
-            if (par->zeros == 0 && par->valor == 0) {
-                printf("    AC[%d]: EOB (End of Block)\n", k);
-                break;
-            }
+            int position = __builtin_ctzll(mask_y);
+            int zeros = position - last_y - 1;
+            int ac_value = block_y->valores[k];
+            last_y = position;
+            mask_y &= mask_y - 1;
             
             int category = get_coefficient_category(ac_value);
             int code = get_coefficient_code(ac_value, category);
             int decoded = decode_coefficient_from_category(category, code);
             
             printf("    AC[%d]: zeros=%d, valor=%d, categoria=%d, codigo=%d, decodificado=%d %s\n", 
-                   k, par->zeros, par->valor, category, code, decoded,
+                   k, zeros, ac_value, category, code, decoded,
                    (ac_value == decoded) ? "Y" : "X");
             
             // Estatisticas
@@ -599,8 +598,8 @@ void testACCategoryEncoding(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int mac
                 total_ac_coeffs++;
             }
             
-            if (par->zeros <= 16) {
-                zero_runs[par->zeros]++;
+            if (zeros <= 16) {
+                zero_runs[zeros]++;
             }
         }
         
@@ -608,22 +607,21 @@ void testACCategoryEncoding(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int mac
         BLOCO_RLE_DIFERENCIAL *block_cb = &rle_macroblocks[i].Cb_vetor;
         printf("  Componente Cb (%d coeficientes AC):\n", block_cb->quantidade);
         
+        uint64_t mask_cb = block_cb->mascara;
+        int last_cb = 0;
         for (int k = 0; k < block_cb->quantidade && k < 5; k++) { // Mostra apenas os primeiros 5
-            PAR_RLE *par = &block_cb->pares[k];
-            int ac_value = (int)round(par->valor);
-            
-            // Verifica se e EOB
-            if (par->zeros == 0 && par->valor == 0) {
-                printf("    AC[%d]: EOB (End of Block)\n", k);
-                break;
-            }
+            int position = __builtin_ctzll(mask_cb);
+            int zeros = position - last_cb - 1;
+            int ac_value = block_cb->valores[k];
+            last_cb = position;
+            mask_cb &= mask_cb - 1;
             
             int category = get_coefficient_category(ac_value);
             int code = get_coefficient_code(ac_value, category);
             int decoded = decode_coefficient_from_category(category, code);
             
             printf("    AC[%d]: zeros=%d, valor=%d, categoria=%d, codigo=%d, decodificado=%d %s\n", 
-                   k, par->zeros, par->valor, category, code, decoded,
+                   k, zeros, ac_value, category, code, decoded,
                    (ac_value == decoded) ? "Y" : "X");
             
             // Estatisticas
@@ -632,8 +630,8 @@ void testACCategoryEncoding(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int mac
                 total_ac_coeffs++;
             }
             
-            if (par->zeros <= 16) {
-                zero_runs[par->zeros]++;
+            if (zeros <= 16) {
+                zero_runs[zeros]++;
             }
         }
         
@@ -641,22 +639,21 @@ void testACCategoryEncoding(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int mac
         BLOCO_RLE_DIFERENCIAL *block_cr = &rle_macroblocks[i].Cr_vetor;
         printf("  Componente Cr (%d coeficientes AC):\n", block_cr->quantidade);
         
+        uint64_t mask_cr = block_cr->mascara;
+        int last_cr = 0;
         for (int k = 0; k < block_cr->quantidade && k < 5; k++) { // Mostra apenas os primeiros 5
-            PAR_RLE *par = &block_cr->pares[k];
-            int ac_value = (int)round(par->valor);
-            
-            // Verifica se e EOB
-            if (par->zeros == 0 && par->valor == 0) {
-                printf("    AC[%d]: EOB (End of Block)\n", k);
-                break;
-            }
+            int position = __builtin_ctzll(mask_cr);
+            int zeros = position - last_cr - 1;
+            int ac_value = block_cr->valores[k];
+            last_cr = position;
+            mask_cr &= mask_cr - 1;
             
             int category = get_coefficient_category(ac_value);
             int code = get_coefficient_code(ac_value, category);
             int decoded = decode_coefficient_from_category(category, code);
             
             printf("    AC[%d]: zeros=%d, valor=%d, categoria=%d, codigo=%d, decodificado=%d %s\n", 
-                   k, par->zeros, par->valor, category, code, decoded,
+                   k, zeros, ac_value, category, code, decoded,
                    (ac_value == decoded) ? "Y" : "X");
             
             // Estatisticas
@@ -665,8 +662,8 @@ void testACCategoryEncoding(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks, int mac
                 total_ac_coeffs++;
             }
             
-            if (par->zeros <= 16) {
-                zero_runs[par->zeros]++;
+            if (zeros <= 16) {
+                zero_runs[zeros]++;
             }
         }
         
@@ -738,8 +735,7 @@ void testCategoryEncodingRoundtrip(MACROBLOCO_RLE_DIFERENCIAL *rle_macroblocks,
         for (int j = 0; j < 4; j++) {
             BLOCO_RLE_DIFERENCIAL *block = &rle_macroblocks[i].Y_vetor[j];
             for (int k = 0; k < block->quantidade && k < 5; k++) {
-                int original_ac = (int)round(block->pares[k].valor);
-                if (original_ac == 0) continue; // Pula zeros (EOB)
+                int original_ac = block->valores[k];
                 
                 int cat_ac = get_coefficient_category(original_ac);
                 int code_ac = get_coefficient_code(original_ac, cat_ac);
@@ -1032,7 +1028,7 @@ void testHuffmanRoundtrip() {
         
         // Decodifica a diferença DC usando a nova assinatura
         int decoded_dc;
-        int success = decode_dc_coefficient(&decoded_dc, buffer);
+        int success = decode_dc_coefficient(&decoded_dc, buffer, NULL);
         
         // Verifica se a decodificação foi bem-sucedida e se o valor é igual ao original
         if (!success || decoded_dc != dc_diffs[i]) {
@@ -1069,7 +1065,7 @@ void testHuffmanRoundtrip() {
         memset(buffer->data, 0, buffer->capacity);
         
         // Codifica o par AC
-        if (!write_ac_coefficient(buffer, ac_cases[i].run, ac_cases[i].value)) {
+        if (!write_ac_coefficient(buffer, ac_cases[i].run, ac_cases[i].value, NULL)) {
             printf("ERRO: Falha ao codificar AC (%d,%d)!\n", 
                    ac_cases[i].run, ac_cases[i].value);
             errors_ac++;
@@ -1082,7 +1078,7 @@ void testHuffmanRoundtrip() {
         
         // Decodifica o par AC
         int run_length, value;
-        int result = decode_ac_coefficient(buffer, &run_length, &value);
+        int result = decode_ac_coefficient(buffer, &run_length, &value, NULL);
         
         // Verifica se a decodificação foi bem-sucedida
         if (result <= 0) {
@@ -1130,6 +1126,55 @@ void testHuffmanRoundtrip() {
     printf("********************************************\n\n");
 }
 
+void testACEmitTable() {
+    /*
+     * Testa a tabela de emissão dos pares AC: para toda carreira de zeros e todo valor da tabela,
+     * a escrita pela tabela deve ser igual à escrita com o símbolo montado na hora, e os pares
+     * sem código (valor zero fora do EOB e do ZRL, valores acima da categoria 10) devem falhar.
+     */
+    printf("\n*************** Teste da tabela de emissão AC ***************\n");
+    HUFFMAN_ENCODE_TABLES *tables = malloc(sizeof(HUFFMAN_ENCODE_TABLES));
+    BitBuffer *with_table = init_bit_buffer(64);
+    BitBuffer *direct = init_bit_buffer(64);
+    if (!tables || !with_table || !direct) {
+        printf("Falha ao criar as tabelas ou os buffers!\n");
+        free(tables);
+        if (with_table) free_bit_buffer(with_table);
+        if (direct) free_bit_buffer(direct);
+        return;
+    }
+    build_huffman_encode_tables(tables);
+    int errors = 0;
+
+    for (int run = 0; run < 40; run++) {
+        for (int value = -AC_EMIT_MAX_VALUE - 1; value <= AC_EMIT_MAX_VALUE + 1; value++) {
+            reset_bit_buffer(with_table);
+            reset_bit_buffer(direct);
+            int ok_table = write_ac_coefficient(with_table, run, value, tables);
+            int ok_direct = write_ac_coefficient(direct, run, value, NULL);
+            int has_code = value >= -AC_EMIT_MAX_VALUE && value <= AC_EMIT_MAX_VALUE &&
+                           (value != 0 || run == 0 || run == 15);
+            if (ok_table != has_code || ok_direct != has_code ||
+                with_table->byte_position != direct->byte_position || with_table->bit_position != direct->bit_position ||
+                memcmp(with_table->data, direct->data, with_table->byte_position + 1) != 0) {
+                if (errors < 10) printf("ERRO AC (%d,%d): tabela=%d, direto=%d, esperado=%d\n", run, value, ok_table, ok_direct, has_code);
+                errors++;
+            }
+        }
+    }
+
+    if (errors == 0) {
+        printf("SUCESSO: A tabela de emissão AC confere com os símbolos montados na hora!\n");
+    } else {
+        printf("FALHA: %d erros na tabela de emissão AC!\n", errors);
+    }
+
+    free(tables);
+    free_bit_buffer(with_table);
+    free_bit_buffer(direct);
+    printf("********************************************\n\n");
+}
+
 long fsize(const char *filename)
 {
     /*
@@ -1146,5 +1191,786 @@ long fsize(const char *filename)
     long size;
     fseek(fp, 0, SEEK_END);
     size = ftell(fp);
+    fclose(fp);
     return size;
 }
+
+static PIXELRGB *create_test_image(int width, int height) {
+    // Gera uma imagem sintética com gradientes e bordas, para os testes que passam pela libcodec
+    PIXELRGB *pixels = malloc((size_t)width * height * sizeof(PIXELRGB));
+    if (!pixels) return NULL;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            PIXELRGB *p = &pixels[(size_t)y * width + x];
+            p->R = (unsigned char)(x * 255 / width);
+            p->G = (unsigned char)(y * 255 / height);
+            p->B = (unsigned char)(((x / 8 + y / 8) % 2) ? 200 : 40);
+        }
+    }
+    return pixels;
+}
+
+static uint8_t *encode_test_image(const PIXELRGB *pixels, int width, int height, const CODEC_OPTIONS *options, size_t *out_size) {
+    // Comprime a imagem na memória com a libcodec; retorna NULL se a compressão falhar
+    size_t capacity = codec_max_encoded_size(width, height, options);
+    uint8_t *data = capacity ? malloc(capacity) : NULL;
+    if (!data) return NULL;
+    if (codec_encode(pixels, width, height, options, data, capacity, out_size, NULL) != CODEC_OK) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+static PIXELRGB *decode_test_image(const uint8_t *data, size_t size, int scale, int num_threads, int *status) {
+    // Descomprime com a libcodec em 1/scale do tamanho; retorna os pixels (mesmo com dados danificados)
+    // ou NULL se a descompressão não gerou a imagem, com o código de retorno em *status
+    int width, height;
+    *status = CODEC_ERROR_INVALID_HEADER;
+    if (!codec_read_info(data, size, &width, &height, NULL)) return NULL;
+    if (!codec_scaled_size(width, height, scale, &width, &height)) width = height = 1;
+    PIXELRGB *pixels = malloc((size_t)width * height * sizeof(PIXELRGB));
+    if (!pixels) return NULL;
+    *status = codec_decode_scaled(data, size, scale, pixels, (size_t)width * height, num_threads, NULL);
+    if (*status != CODEC_OK && *status != CODEC_ERROR_DAMAGED_DATA) {
+        free(pixels);
+        return NULL;
+    }
+    return pixels;
+}
+
+static double psnr_rgb(const PIXELRGB *orig, const PIXELRGB *recon, size_t count) {
+    // PSNR em dB entre duas imagens RGB, com os três canais juntos
+    double squared = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double dR = (double)orig[i].R - recon[i].R;
+        double dG = (double)orig[i].G - recon[i].G;
+        double dB = (double)orig[i].B - recon[i].B;
+        squared += dR * dR + dG * dG + dB * dB;
+    }
+    if (squared == 0.0) return 99.0;
+    return 10.0 * log10(255.0 * 255.0 * 3.0 * count / squared);
+}
+
+static double box_average_error(const PIXELRGB *full, int width, int height, const PIXELRGB *scaled, int scale) {
+    // Diferença absoluta média entre a imagem reduzida e a média de cada bloco scale x scale da
+    // imagem completa (só os pixels dentro da imagem, nos blocos parciais da borda)
+    int scaled_width = (width + scale - 1) / scale;
+    int scaled_height = (height + scale - 1) / scale;
+    double total = 0.0;
+    for (int sy = 0; sy < scaled_height; sy++) {
+        for (int sx = 0; sx < scaled_width; sx++) {
+            double sum[3] = {0.0, 0.0, 0.0};
+            int count = 0;
+            for (int y = sy * scale; y < height && y < (sy + 1) * scale; y++) {
+                for (int x = sx * scale; x < width && x < (sx + 1) * scale; x++) {
+                    const PIXELRGB *p = &full[(size_t)y * width + x];
+                    sum[0] += p->R;
+                    sum[1] += p->G;
+                    sum[2] += p->B;
+                    count++;
+                }
+            }
+            const PIXELRGB *q = &scaled[(size_t)sy * scaled_width + sx];
+            total += fabs(sum[0] / count - q->R) + fabs(sum[1] / count - q->G) + fabs(sum[2] / count - q->B);
+        }
+    }
+    return total / (3.0 * scaled_width * scaled_height);
+}
+
+void testCorruptHeaderQuality() {
+    /*
+     * Testa a leitura de headers com qualidade fora de 1 a 100 e com passos das matrizes
+     * gravadas fora de 1 a QUANT_STEP_MAX_VALUE: a descompressão deve falhar com
+     * CODEC_ERROR_INVALID_HEADER e codec_read_info não deve devolver a qualidade.
+     */
+    printf("\n*************** Teste de headers corrompidos ***************\n");
+    const int width = 48, height = 32;
+    const size_t quality_offset = 54;                            // Depois dos headers do BMP
+    const size_t matrices_offset = quality_offset + 2 * sizeof(int); // Depois da qualidade e do número de macroblocos
+    int bad_qualities[] = {0, 101, 255};
+    int num_bad = sizeof(bad_qualities) / sizeof(bad_qualities[0]);
+    int errors = 0;
+
+    PIXELRGB *pixels = create_test_image(width, height);
+    PIXELRGB *decoded = malloc((size_t)width * height * sizeof(PIXELRGB));
+    QUANT_MATRICES flat;
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 8; j++) {
+            flat.y[i][j] = QUANT_MATRIX_MAX_VALUE;
+            flat.chroma[i][j] = QUANT_MATRIX_MAX_VALUE;
+        }
+    }
+    CODEC_OPTIONS plain = {.quality = 75};
+    CODEC_OPTIONS stored = {.quality = 1, .matrices = &flat};
+    size_t plain_size = 0, stored_size = 0;
+    uint8_t *plain_data = pixels ? encode_test_image(pixels, width, height, &plain, &plain_size) : NULL;
+    uint8_t *stored_data = pixels ? encode_test_image(pixels, width, height, &stored, &stored_size) : NULL;
+    if (!decoded || !plain_data || !stored_data) {
+        printf("Falha ao preparar as imagens do teste!\n");
+        free(pixels);
+        free(decoded);
+        free(plain_data);
+        free(stored_data);
+        return;
+    }
+
+    // Os arquivos válidos, incluindo os passos máximos da qualidade 1, devem ser aceitos
+    if (codec_decode(plain_data, plain_size, decoded, (size_t)width * height, 1, NULL) != CODEC_OK ||
+        codec_decode(stored_data, stored_size, decoded, (size_t)width * height, 1, NULL) != CODEC_OK) {
+        printf("ERRO: Arquivo valido rejeitado!\n");
+        errors++;
+    }
+
+    for (int m = 0; m < 2; m++) {
+        uint8_t *data = m ? stored_data : plain_data;
+        size_t size = m ? stored_size : plain_size;
+        uint8_t original = data[quality_offset];
+        for (int i = 0; i < num_bad; i++) {
+            int quality;
+            data[quality_offset] = (uint8_t)bad_qualities[i];
+            int status = codec_decode(data, size, decoded, (size_t)width * height, 1, NULL);
+            if (status != CODEC_ERROR_INVALID_HEADER || codec_read_info(data, size, NULL, NULL, &quality)) {
+                printf("ERRO: Qualidade %d aceita (matrizes gravadas: %d, codigo %d)!\n", bad_qualities[i], m, status);
+                errors++;
+            }
+        }
+        data[quality_offset] = original;
+    }
+
+    // Passos zerados ou acima do máximo nas matrizes gravadas
+    uint16_t bad_steps[] = {0, QUANT_STEP_MAX_VALUE + 1, 0xFFFF};
+    uint16_t original_step;
+    memcpy(&original_step, stored_data + matrices_offset, sizeof(uint16_t));
+    for (int i = 0; i < 3; i++) {
+        memcpy(stored_data + matrices_offset, &bad_steps[i], sizeof(uint16_t));
+        int status = codec_decode(stored_data, stored_size, decoded, (size_t)width * height, 1, NULL);
+        if (status != CODEC_ERROR_INVALID_HEADER) {
+            printf("ERRO: Passo %d aceito na matriz gravada (codigo %d)!\n", bad_steps[i], status);
+            errors++;
+        }
+    }
+    memcpy(stored_data + matrices_offset, &original_step, sizeof(uint16_t));
+
+    if (errors == 0) {
+        printf("SUCESSO: Todos os headers corrompidos foram rejeitados!\n");
+    } else {
+        printf("FALHA: %d erros nos testes de headers corrompidos!\n", errors);
+    }
+
+    free(pixels);
+    free(decoded);
+    free(plain_data);
+    free(stored_data);
+    printf("********************************************\n\n");
+}
+
+void testIndexedDecode() {
+    /*
+     * Testa o índice de macroblocos: arquivos com índice a cada 1 e 2 linhas de macroblocos,
+     * descomprimidos com 1 e 3 threads, devem gerar exatamente os pixels do arquivo sem índice,
+     * e o índice gravado no fim deve ser lido com uma entrada por intervalo.
+     */
+    printf("\n*************** Teste do índice de macroblocos ***************\n");
+    const int width = 100, height = 90; // 7 x 6 macroblocos, com bordas parciais
+    const int mb_rows = (height + 15) / 16;
+    int errors = 0;
+
+    PIXELRGB *pixels = create_test_image(width, height);
+    CODEC_OPTIONS plain = {.quality = 75};
+    size_t plain_size = 0;
+    uint8_t *plain_data = pixels ? encode_test_image(pixels, width, height, &plain, &plain_size) : NULL;
+    int status;
+    PIXELRGB *reference = plain_data ? decode_test_image(plain_data, plain_size, 1, 1, &status) : NULL;
+    if (!reference || status != CODEC_OK) {
+        printf("Falha ao preparar a imagem de referencia!\n");
+        free(pixels);
+        free(plain_data);
+        free(reference);
+        return;
+    }
+
+    int intervals[] = {1, 2};
+    int threads[] = {1, 3};
+    for (int i = 0; i < 2; i++) {
+        CODEC_OPTIONS indexed = {.quality = 75, .index_interval = intervals[i]};
+        size_t size = 0;
+        uint8_t *data = encode_test_image(pixels, width, height, &indexed, &size);
+        if (!data) {
+            printf("ERRO: Falha ao comprimir com indice a cada %d linhas!\n", intervals[i]);
+            errors++;
+            continue;
+        }
+
+        COMPRESSED_HEADER header;
+        MACROBLOCK_INDEX index;
+        size_t data_start = parse_compressed_header(data, size, &header);
+        int expected_count = (mb_rows + intervals[i] - 1) / intervals[i];
+        if (!data_start || !(header.flags & FORMAT_FLAG_INDEX) || !parse_macroblock_index(data, size, data_start, &index, 0) ||
+            index.interval != intervals[i] || index.count != expected_count) {
+            printf("ERRO: Indice a cada %d linhas nao foi lido do arquivo!\n", intervals[i]);
+            errors++;
+        }
+        if (data_start) free(index.entries);
+
+        for (int t = 0; t < 2; t++) {
+            PIXELRGB *decoded = decode_test_image(data, size, 1, threads[t], &status);
+            if (!decoded || status != CODEC_OK || memcmp(decoded, reference, (size_t)width * height * sizeof(PIXELRGB)) != 0) {
+                printf("ERRO: Indice a cada %d linhas com %d threads difere do arquivo sem indice (codigo %d)!\n", intervals[i], threads[t], status);
+                errors++;
+            }
+            free(decoded);
+        }
+        free(data);
+    }
+
+    if (errors == 0) {
+        printf("SUCESSO: Arquivos com indice geram os mesmos pixels com qualquer numero de threads!\n");
+    } else {
+        printf("FALHA: %d erros nos testes do indice!\n", errors);
+    }
+
+    free(pixels);
+    free(plain_data);
+    free(reference);
+    printf("********************************************\n\n");
+}
+
+void testRestartIntervals() {
+    /*
+     * Testa os intervalos de reinício do preditor DC: arquivos com reinícios a cada 1, 3 e 7
+     * macroblocos devem gerar os pixels do arquivo sem reinícios. Depois corrompe os dados de um
+     * macrobloco da segunda linha de um arquivo com um reinício por linha: o dano deve ser informado
+     * e, a partir da linha seguinte (novo intervalo), os pixels devem continuar idênticos; um arquivo truncado deve
+     * voltar CODEC_ERROR_DAMAGED_DATA com a primeira linha de macroblocos intacta.
+     */
+    printf("\n*************** Teste dos intervalos de reinicio ***************\n");
+    const int width = 100, height = 90;
+    const int mb_cols = (width + 15) / 16;
+    const size_t row_bytes = (size_t)width * 16 * sizeof(PIXELRGB);
+    int errors = 0;
+
+    PIXELRGB *pixels = create_test_image(width, height);
+    CODEC_OPTIONS plain = {.quality = 75};
+    size_t plain_size = 0;
+    uint8_t *plain_data = pixels ? encode_test_image(pixels, width, height, &plain, &plain_size) : NULL;
+    int status;
+    PIXELRGB *reference = plain_data ? decode_test_image(plain_data, plain_size, 1, 1, &status) : NULL;
+    if (!reference || status != CODEC_OK) {
+        printf("Falha ao preparar a imagem de referencia!\n");
+        free(pixels);
+        free(plain_data);
+        free(reference);
+        return;
+    }
+
+    int intervals[] = {1, 3, 7};
+    for (int i = 0; i < 3; i++) {
+        CODEC_OPTIONS restart = {.quality = 75, .restart_interval = intervals[i]};
+        size_t size = 0;
+        uint8_t *data = encode_test_image(pixels, width, height, &restart, &size);
+        PIXELRGB *decoded = data ? decode_test_image(data, size, 1, 3, &status) : NULL;
+        if (!decoded || status != CODEC_OK || memcmp(decoded, reference, (size_t)width * height * sizeof(PIXELRGB)) != 0) {
+            printf("ERRO: Reinicio a cada %d macroblocos difere do arquivo sem reinicios (codigo %d)!\n", intervals[i], status);
+            errors++;
+        }
+        free(decoded);
+        free(data);
+    }
+
+    // Um reinício por linha de macroblocos; os dados do terceiro macrobloco da segunda linha são invertidos
+    CODEC_OPTIONS per_row = {.quality = 75, .restart_interval = mb_cols};
+    size_t size = 0;
+    uint8_t *data = encode_test_image(pixels, width, height, &per_row, &size);
+    COMPRESSED_HEADER header;
+    size_t position = data ? parse_compressed_header(data, size, &header) : 0;
+    if (!position) {
+        printf("ERRO: Falha ao comprimir com um reinicio por linha!\n");
+        errors++;
+    } else {
+        int damaged_mb = mb_cols + 2;
+        size_t length;
+        for (int mb = 0; mb < damaged_mb; mb++) {
+            memcpy(&length, data + position, sizeof(size_t));
+            position += sizeof(size_t) + length;
+        }
+        memcpy(&length, data + position, sizeof(size_t));
+        for (size_t b = 0; b < length; b++) {
+            data[position + sizeof(size_t) + b] ^= 0xFF;
+        }
+
+        PIXELRGB *decoded = decode_test_image(data, size, 1, 1, &status);
+        if (!decoded || status != CODEC_ERROR_DAMAGED_DATA || memcmp(decoded + 2 * 16 * width, reference + 2 * 16 * width, (size_t)width * (height - 32) * sizeof(PIXELRGB)) != 0) {
+            printf("ERRO: Linhas depois do macrobloco corrompido nao foram recuperadas (codigo %d)!\n", status);
+            errors++;
+        }
+        free(decoded);
+
+        // Arquivo truncado na metade: o que foi lido continua certo e o erro é informado
+        decoded = decode_test_image(data, size / 2, 1, 1, &status);
+        if (!decoded || status != CODEC_ERROR_DAMAGED_DATA || memcmp(decoded, reference, row_bytes) != 0) {
+            printf("ERRO: Arquivo truncado nao foi informado ou perdeu a primeira linha (codigo %d)!\n", status);
+            errors++;
+        }
+        free(decoded);
+    }
+    free(data);
+
+    if (errors == 0) {
+        printf("SUCESSO: Reinicios preservam os pixels e isolam os trechos danificados!\n");
+    } else {
+        printf("FALHA: %d erros nos testes de reinicio!\n", errors);
+    }
+
+    free(pixels);
+    free(plain_data);
+    free(reference);
+    printf("********************************************\n\n");
+}
+
+static int expect_status(const char *label, int status, int expected) {
+    // Confere um código de retorno da libcodec; retorna 1 se for diferente do esperado
+    if (status == expected) return 0;
+    printf("ERRO: %s retornou %d, esperado %d!\n", label, status, expected);
+    return 1;
+}
+
+void testCodecErrorCodes() {
+    /*
+     * Testa os códigos de retorno da libcodec: argumentos e opções inválidos, buffers de saída
+     * e de pixels pequenos demais (com o tamanho necessário informado), headers ilegíveis,
+     * escala inválida e arquivo truncado.
+     */
+    printf("\n*************** Teste dos codigos de erro da libcodec ***************\n");
+    const int width = 40, height = 24;
+    const size_t pixel_count = (size_t)width * height;
+    int errors = 0;
+
+    PIXELRGB *pixels = create_test_image(width, height);
+    PIXELRGB *decoded = malloc(pixel_count * sizeof(PIXELRGB));
+    CODEC_OPTIONS options = {.quality = 60};
+    size_t capacity = codec_max_encoded_size(width, height, &options);
+    uint8_t *data = malloc(capacity);
+    if (!pixels || !decoded || !data) {
+        printf("Falha ao preparar o teste!\n");
+        free(pixels);
+        free(decoded);
+        free(data);
+        return;
+    }
+
+    // Compressão: dimensões e opções inválidas
+    size_t size = 0;
+    CODEC_OPTIONS bad_quality = {.quality = 101};
+    CODEC_OPTIONS bad_effort = {.quality = 60, .effort = 2};
+    CODEC_OPTIONS bad_restart = {.quality = 60, .restart_interval = -1};
+    errors += expect_status("codec_encode com largura 0", codec_encode(pixels, 0, height, &options, data, capacity, &size, NULL), CODEC_ERROR_INVALID_ARGUMENT);
+    errors += expect_status("codec_encode com qualidade 101", codec_encode(pixels, width, height, &bad_quality, data, capacity, &size, NULL), CODEC_ERROR_INVALID_ARGUMENT);
+    errors += expect_status("codec_encode com esforço 2", codec_encode(pixels, width, height, &bad_effort, data, capacity, &size, NULL), CODEC_ERROR_INVALID_ARGUMENT);
+    errors += expect_status("codec_encode com reinício negativo", codec_encode(pixels, width, height, &bad_restart, data, capacity, &size, NULL), CODEC_ERROR_INVALID_ARGUMENT);
+
+    // Compressão: sem saída e com saída pequena demais, informando o tamanho necessário
+    size_t needed = 0;
+    errors += expect_status("codec_encode sem saida", codec_encode(pixels, width, height, &options, NULL, 0, &needed, NULL), CODEC_ERROR_BUFFER_TOO_SMALL);
+    errors += expect_status("codec_encode com saida pequena", codec_encode(pixels, width, height, &options, data, needed - 1, &size, NULL), CODEC_ERROR_BUFFER_TOO_SMALL);
+    if (size != needed) {
+        printf("ERRO: Tamanho necessario informado %zu, esperado %zu!\n", size, needed);
+        errors++;
+    }
+    errors += expect_status("codec_encode com o tamanho exato", codec_encode(pixels, width, height, &options, data, needed, &size, NULL), CODEC_OK);
+
+    // Descompressão: headers ilegíveis, escala inválida, pixels insuficientes e arquivo truncado
+    uint8_t garbage[64];
+    memset(garbage, 0xAB, sizeof(garbage));
+    errors += expect_status("codec_decode com lixo", codec_decode(garbage, sizeof(garbage), decoded, pixel_count, 1, NULL), CODEC_ERROR_INVALID_HEADER);
+    errors += expect_status("codec_decode com header cortado", codec_decode(data, 20, decoded, pixel_count, 1, NULL), CODEC_ERROR_INVALID_HEADER);
+    errors += expect_status("codec_decode_scaled com escala 3", codec_decode_scaled(data, size, 3, decoded, pixel_count, 1, NULL), CODEC_ERROR_INVALID_ARGUMENT);
+    errors += expect_status("codec_decode com pixels insuficientes", codec_decode(data, size, decoded, pixel_count - 1, 1, NULL), CODEC_ERROR_BUFFER_TOO_SMALL);
+    errors += expect_status("codec_decode truncado", codec_decode(data, size - 10, decoded, pixel_count, 1, NULL), CODEC_ERROR_DAMAGED_DATA);
+    errors += expect_status("codec_decode completo", codec_decode(data, size, decoded, pixel_count, 1, NULL), CODEC_OK);
+    if (codec_read_info(garbage, sizeof(garbage), NULL, NULL, NULL) || codec_scaled_size(width, height, 3, NULL, NULL)) {
+        printf("ERRO: codec_read_info ou codec_scaled_size aceitaram entradas invalidas!\n");
+        errors++;
+    }
+
+    if (errors == 0) {
+        printf("SUCESSO: Todos os codigos de erro da libcodec conferem!\n");
+    } else {
+        printf("FALHA: %d erros nos codigos da libcodec!\n", errors);
+    }
+
+    free(pixels);
+    free(decoded);
+    free(data);
+    printf("********************************************\n\n");
+}
+
+void testRateDistortion() {
+    /*
+     * Testa a otimização taxa-distorção (--effort 1): o arquivo deve ser descomprimido sem erros,
+     * não pode ficar maior que o de esforço 0 e a qualidade deve continuar próxima da original.
+     */
+    printf("\n*************** Teste da otimizacao taxa-distorcao ***************\n");
+    const int width = 100, height = 90;
+    const size_t pixel_count = (size_t)width * height;
+    int errors = 0;
+
+    PIXELRGB *pixels = create_test_image(width, height);
+    if (!pixels) {
+        printf("Falha ao preparar a imagem!\n");
+        return;
+    }
+
+    int qualities[] = {20, 50, 90};
+    for (int i = 0; i < 3; i++) {
+        CODEC_OPTIONS fast = {.quality = qualities[i]};
+        CODEC_OPTIONS optimized = {.quality = qualities[i], .effort = 1};
+        size_t fast_size = 0, optimized_size = 0;
+        int fast_status = CODEC_ERROR_ENCODING, optimized_status = CODEC_ERROR_ENCODING;
+        uint8_t *fast_data = encode_test_image(pixels, width, height, &fast, &fast_size);
+        uint8_t *optimized_data = encode_test_image(pixels, width, height, &optimized, &optimized_size);
+        PIXELRGB *fast_pixels = fast_data ? decode_test_image(fast_data, fast_size, 1, 1, &fast_status) : NULL;
+        PIXELRGB *optimized_pixels = optimized_data ? decode_test_image(optimized_data, optimized_size, 1, 1, &optimized_status) : NULL;
+
+        if (fast_status != CODEC_OK || optimized_status != CODEC_OK) {
+            printf("ERRO: Qualidade %d: falha na compressao ou descompressao (codigos %d e %d)!\n", qualities[i], fast_status, optimized_status);
+            errors++;
+        } else {
+            double fast_psnr = psnr_rgb(pixels, fast_pixels, pixel_count);
+            double optimized_psnr = psnr_rgb(pixels, optimized_pixels, pixel_count);
+            printf("Qualidade %d: esforco 0 com %zu bytes (%.2f dB), esforco 1 com %zu bytes (%.2f dB)\n",
+                   qualities[i], fast_size, fast_psnr, optimized_size, optimized_psnr);
+            if (optimized_size > fast_size) {
+                printf("ERRO: Qualidade %d: esforco 1 gerou um arquivo maior!\n", qualities[i]);
+                errors++;
+            }
+            if (optimized_psnr < fast_psnr - 2.0) {
+                printf("ERRO: Qualidade %d: esforco 1 perdeu mais de 2 dB!\n", qualities[i]);
+                errors++;
+            }
+        }
+        free(fast_data);
+        free(optimized_data);
+        free(fast_pixels);
+        free(optimized_pixels);
+    }
+
+    if (errors == 0) {
+        printf("SUCESSO: O esforco 1 reduz o arquivo sem perder qualidade perceptivel!\n");
+    } else {
+        printf("FALHA: %d erros na otimizacao taxa-distorcao!\n", errors);
+    }
+
+    free(pixels);
+    printf("********************************************\n\n");
+}
+
+void testAdaptiveQuantization() {
+    /*
+     * Testa a quantização adaptativa (--adaptive): o arquivo deve ser descomprimido sem erros
+     * com qualidade próxima da quantização fixa e, com índice, gerar os mesmos pixels com 1 e 3 threads.
+     */
+    printf("\n*************** Teste da quantizacao adaptativa ***************\n");
+    const int width = 100, height = 90;
+    const size_t pixel_count = (size_t)width * height;
+    int errors = 0;
+
+    PIXELRGB *pixels = create_test_image(width, height);
+    if (!pixels) {
+        printf("Falha ao preparar a imagem!\n");
+        return;
+    }
+
+    int qualities[] = {30, 75};
+    for (int i = 0; i < 2; i++) {
+        CODEC_OPTIONS fixed = {.quality = qualities[i]};
+        CODEC_OPTIONS adaptive = {.quality = qualities[i], .adaptive = 1, .index_interval = 1};
+        size_t fixed_size = 0, adaptive_size = 0;
+        int fixed_status = CODEC_ERROR_ENCODING, adaptive_status = CODEC_ERROR_ENCODING, threaded_status = CODEC_ERROR_ENCODING;
+        uint8_t *fixed_data = encode_test_image(pixels, width, height, &fixed, &fixed_size);
+        uint8_t *adaptive_data = encode_test_image(pixels, width, height, &adaptive, &adaptive_size);
+        PIXELRGB *fixed_pixels = fixed_data ? decode_test_image(fixed_data, fixed_size, 1, 1, &fixed_status) : NULL;
+        PIXELRGB *adaptive_pixels = adaptive_data ? decode_test_image(adaptive_data, adaptive_size, 1, 1, &adaptive_status) : NULL;
+        PIXELRGB *threaded_pixels = adaptive_data ? decode_test_image(adaptive_data, adaptive_size, 1, 3, &threaded_status) : NULL;
+
+        COMPRESSED_HEADER header;
+        if (!adaptive_data || !parse_compressed_header(adaptive_data, adaptive_size, &header) || !(header.flags & FORMAT_FLAG_ADAPTIVE)) {
+            printf("ERRO: Qualidade %d: header sem a marca de quantizacao adaptativa!\n", qualities[i]);
+            errors++;
+        }
+        if (fixed_status != CODEC_OK || adaptive_status != CODEC_OK || threaded_status != CODEC_OK) {
+            printf("ERRO: Qualidade %d: falha na descompressao (codigos %d, %d e %d)!\n", qualities[i], fixed_status, adaptive_status, threaded_status);
+            errors++;
+        } else {
+            double fixed_psnr = psnr_rgb(pixels, fixed_pixels, pixel_count);
+            double adaptive_psnr = psnr_rgb(pixels, adaptive_pixels, pixel_count);
+            printf("Qualidade %d: fixa com %zu bytes (%.2f dB), adaptativa com %zu bytes (%.2f dB)\n",
+                   qualities[i], fixed_size, fixed_psnr, adaptive_size, adaptive_psnr);
+            if (adaptive_psnr < fixed_psnr - 2.0) {
+                printf("ERRO: Qualidade %d: quantizacao adaptativa perdeu mais de 2 dB!\n", qualities[i]);
+                errors++;
+            }
+            if (memcmp(adaptive_pixels, threaded_pixels, pixel_count * sizeof(PIXELRGB)) != 0) {
+                printf("ERRO: Qualidade %d: descompressao com 3 threads difere da sequencial!\n", qualities[i]);
+                errors++;
+            }
+        }
+        free(fixed_data);
+        free(adaptive_data);
+        free(fixed_pixels);
+        free(adaptive_pixels);
+        free(threaded_pixels);
+    }
+
+    if (errors == 0) {
+        printf("SUCESSO: A quantizacao adaptativa preserva a qualidade e o resultado com threads!\n");
+    } else {
+        printf("FALHA: %d erros na quantizacao adaptativa!\n", errors);
+    }
+
+    free(pixels);
+    printf("********************************************\n\n");
+}
+
+void testStoredMatrices() {
+    /*
+     * Testa as matrizes de quantização personalizadas gravadas no header: com as matrizes do
+     * Anexo K o resultado deve ser igual ao da compressão padrão, com as matrizes efetivas da
+     * qualidade gravadas no arquivo, e matrizes planas de 16 na qualidade 50 devem ser gravadas sem escala.
+     */
+    printf("\n*************** Teste das matrizes de quantizacao gravadas ***************\n");
+    const int width = 100, height = 90;
+    const size_t pixel_count = (size_t)width * height;
+    const int quality = 75;
+    int errors = 0;
+
+    PIXELRGB *pixels = create_test_image(width, height);
+    CODEC_OPTIONS plain = {.quality = quality};
+    size_t plain_size = 0;
+    uint8_t *plain_data = pixels ? encode_test_image(pixels, width, height, &plain, &plain_size) : NULL;
+    int status;
+    PIXELRGB *reference = plain_data ? decode_test_image(plain_data, plain_size, 1, 1, &status) : NULL;
+    if (!reference || status != CODEC_OK) {
+        printf("Falha ao preparar a imagem de referencia!\n");
+        free(pixels);
+        free(plain_data);
+        free(reference);
+        return;
+    }
+
+    // Matrizes do Anexo K: mesmos pixels da compressão padrão e matrizes efetivas da qualidade no header
+    CODEC_TABLES tables;
+    init_codec_tables(&tables, quality);
+    set_codec_tables_base(&tables, NULL);
+    QUANT_MATRICES annex_k = tables.base;
+    QUANT_MATRICES expected;
+    get_codec_tables_matrices(&tables, &expected);
+    CODEC_OPTIONS stored = {.quality = quality, .matrices = &annex_k};
+    size_t size = 0;
+    uint8_t *data = encode_test_image(pixels, width, height, &stored, &size);
+    PIXELRGB *decoded = data ? decode_test_image(data, size, 1, 1, &status) : NULL;
+    COMPRESSED_HEADER header;
+    if (!data || !parse_compressed_header(data, size, &header) || !(header.flags & FORMAT_FLAG_MATRICES) ||
+        memcmp(&header.matrices, &expected, sizeof(expected)) != 0) {
+        printf("ERRO: Matrizes do Anexo K nao foram gravadas com os passos da qualidade %d!\n", quality);
+        errors++;
+    }
+    if (!decoded || status != CODEC_OK || memcmp(decoded, reference, pixel_count * sizeof(PIXELRGB)) != 0) {
+        printf("ERRO: Matrizes do Anexo K gravadas geram pixels diferentes da compressao padrao (codigo %d)!\n", status);
+        errors++;
+    }
+    free(data);
+    free(decoded);
+
+    // Matrizes planas de 16 na qualidade 50: gravadas sem escala e descomprimidas sem erros
+    QUANT_MATRICES flat;
+    for (int u = 0; u < 8; u++) {
+        for (int v = 0; v < 8; v++) {
+            flat.y[u][v] = 16;
+            flat.chroma[u][v] = 16;
+        }
+    }
+    CODEC_OPTIONS flat_options = {.quality = 50, .matrices = &flat};
+    data = encode_test_image(pixels, width, height, &flat_options, &size);
+    decoded = data ? decode_test_image(data, size, 1, 1, &status) : NULL;
+    if (!data || !parse_compressed_header(data, size, &header) || !(header.flags & FORMAT_FLAG_MATRICES) ||
+        memcmp(&header.matrices, &flat, sizeof(flat)) != 0) {
+        printf("ERRO: Matrizes planas de 16 nao foram gravadas sem escala na qualidade 50!\n");
+        errors++;
+    }
+    if (!decoded || status != CODEC_OK || psnr_rgb(pixels, decoded, pixel_count) < 30.0) {
+        printf("ERRO: Matrizes planas de 16 nao foram descomprimidas corretamente (codigo %d)!\n", status);
+        errors++;
+    }
+    free(data);
+    free(decoded);
+
+    if (errors == 0) {
+        printf("SUCESSO: As matrizes gravadas no header reproduzem a quantizacao usada na compressao!\n");
+    } else {
+        printf("FALHA: %d erros nas matrizes gravadas!\n", errors);
+    }
+
+    free(pixels);
+    free(plain_data);
+    free(reference);
+    printf("********************************************\n\n");
+}
+
+void testCodedBlockPattern() {
+    /*
+     * Testa o padrão de blocos codificados (--cbp): o arquivo deve gerar exatamente os pixels do
+     * arquivo sem cbp, inclusive com reinícios, e numa imagem lisa, cheia de blocos vazios, deve ficar menor.
+     */
+    printf("\n*************** Teste do padrao de blocos codificados ***************\n");
+    const int width = 100, height = 90;
+    const size_t pixel_count = (size_t)width * height;
+    int errors = 0;
+
+    PIXELRGB *pixels = create_test_image(width, height);
+    PIXELRGB *flat = malloc(pixel_count * sizeof(PIXELRGB));
+    if (!pixels || !flat) {
+        printf("Falha ao preparar as imagens!\n");
+        free(pixels);
+        free(flat);
+        return;
+    }
+    for (size_t i = 0; i < pixel_count; i++) {
+        flat[i].R = 90;
+        flat[i].G = 120;
+        flat[i].B = 150;
+    }
+
+    const PIXELRGB *images[] = {pixels, flat};
+    const char *names[] = {"gradiente", "lisa"};
+    int qualities[] = {20, 75};
+    int restarts[] = {0, 3};
+    for (int img = 0; img < 2; img++) {
+        for (int i = 0; i < 2; i++) {
+            CODEC_OPTIONS plain = {.quality = qualities[i], .restart_interval = restarts[i]};
+            CODEC_OPTIONS cbp = {.quality = qualities[i], .restart_interval = restarts[i], .cbp = 1};
+            size_t plain_size = 0, cbp_size = 0;
+            int plain_status = CODEC_ERROR_ENCODING, cbp_status = CODEC_ERROR_ENCODING;
+            uint8_t *plain_data = encode_test_image(images[img], width, height, &plain, &plain_size);
+            uint8_t *cbp_data = encode_test_image(images[img], width, height, &cbp, &cbp_size);
+            PIXELRGB *plain_pixels = plain_data ? decode_test_image(plain_data, plain_size, 1, 1, &plain_status) : NULL;
+            PIXELRGB *cbp_pixels = cbp_data ? decode_test_image(cbp_data, cbp_size, 1, 1, &cbp_status) : NULL;
+
+            if (plain_status != CODEC_OK || cbp_status != CODEC_OK) {
+                printf("ERRO: Imagem %s, qualidade %d: falha na compressao ou descompressao (codigos %d e %d)!\n", names[img], qualities[i], plain_status, cbp_status);
+                errors++;
+            } else {
+                printf("Imagem %s, qualidade %d: %zu bytes sem cbp, %zu bytes com cbp\n", names[img], qualities[i], plain_size, cbp_size);
+                if (memcmp(plain_pixels, cbp_pixels, pixel_count * sizeof(PIXELRGB)) != 0) {
+                    printf("ERRO: Imagem %s, qualidade %d: pixels com cbp diferem dos pixels sem cbp!\n", names[img], qualities[i]);
+                    errors++;
+                }
+                if (images[img] == flat && cbp_size >= plain_size) {
+                    printf("ERRO: Imagem %s, qualidade %d: arquivo com cbp nao ficou menor!\n", names[img], qualities[i]);
+                    errors++;
+                }
+            }
+            free(plain_data);
+            free(cbp_data);
+            free(plain_pixels);
+            free(cbp_pixels);
+        }
+    }
+
+    if (errors == 0) {
+        printf("SUCESSO: O padrao de blocos codificados preserva os pixels e reduz imagens lisas!\n");
+    } else {
+        printf("FALHA: %d erros no padrao de blocos codificados!\n", errors);
+    }
+
+    free(pixels);
+    free(flat);
+    printf("********************************************\n\n");
+}
+
+void testScaledDecode() {
+    /*
+     * Testa a descompressão reduzida: as dimensões de codec_scaled_size devem ser arredondadas
+     * para cima, a descompressão deve aceitar o buffer exato e recusar um pixel a menos, e cada
+     * pixel reduzido deve ficar próximo da média do bloco correspondente da descompressão completa.
+     */
+    printf("\n*************** Teste da descompressao reduzida ***************\n");
+    int errors = 0;
+
+    // Dimensões arredondadas para cima, inclusive em imagens menores que a escala
+    int sizes[][2] = {{100, 90}, {1, 1}, {17, 9}, {64, 48}};
+    for (int i = 0; i < 4; i++) {
+        int w = sizes[i][0], h = sizes[i][1];
+        int scaled_width, scaled_height;
+        for (int scale = 2; scale <= 8; scale *= 2) {
+            if (!codec_scaled_size(w, h, scale, &scaled_width, &scaled_height) ||
+                scaled_width != (w + scale - 1) / scale || scaled_height != (h + scale - 1) / scale) {
+                printf("ERRO: Dimensoes de %dx%d em 1/%d calculadas errado!\n", w, h, scale);
+                errors++;
+            }
+        }
+    }
+
+    // Sem o xadrez de 8 pixels no azul: em 1/8 a crominância 4:2:0 só guarda a média de 16x16 pixels
+    const int width = 100, height = 90;
+    PIXELRGB *pixels = create_test_image(width, height);
+    for (int y = 0; pixels && y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            pixels[(size_t)y * width + x].B = (unsigned char)((x + y) * 255 / (width + height));
+        }
+    }
+    CODEC_OPTIONS options = {.quality = 75};
+    size_t size = 0;
+    uint8_t *data = pixels ? encode_test_image(pixels, width, height, &options, &size) : NULL;
+    int status;
+    PIXELRGB *full = data ? decode_test_image(data, size, 1, 1, &status) : NULL;
+    if (!full || status != CODEC_OK) {
+        printf("Falha ao preparar a imagem de referencia!\n");
+        free(pixels);
+        free(data);
+        free(full);
+        return;
+    }
+
+    int scales[] = {2, 4, 8};
+    for (int i = 0; i < (int)(sizeof(scales) / sizeof(scales[0])); i++) {
+        int scaled_width, scaled_height;
+        codec_scaled_size(width, height, scales[i], &scaled_width, &scaled_height);
+        size_t scaled_count = (size_t)scaled_width * scaled_height;
+        PIXELRGB *scaled = malloc(scaled_count * sizeof(PIXELRGB));
+        if (!scaled) {
+            errors++;
+            continue;
+        }
+
+        status = codec_decode_scaled(data, size, scales[i], scaled, scaled_count - 1, 1, NULL);
+        if (status != CODEC_ERROR_BUFFER_TOO_SMALL) {
+            printf("ERRO: Escala 1/%d com um pixel a menos retornou %d!\n", scales[i], status);
+            errors++;
+        }
+        status = codec_decode_scaled(data, size, scales[i], scaled, scaled_count, 1, NULL);
+        if (status != CODEC_OK) {
+            printf("ERRO: Escala 1/%d com o buffer exato retornou %d!\n", scales[i], status);
+            errors++;
+        } else {
+            double error = box_average_error(full, width, height, scaled, scales[i]);
+            printf("Escala 1/%d: %dx%d, diferenca media de %.2f para a media dos blocos\n", scales[i], scaled_width, scaled_height, error);
+            if (error > 6.0) {
+                printf("ERRO: Escala 1/%d se afasta demais da media dos blocos da imagem completa!\n", scales[i]);
+                errors++;
+            }
+        }
+        free(scaled);
+    }
+
+    if (errors == 0) {
+        printf("SUCESSO: A descompressao reduzida gera as dimensoes e os pixels esperados!\n");
+    } else {
+        printf("FALHA: %d erros na descompressao reduzida!\n", errors);
+    }
+
+    free(pixels);
+    free(data);
+    free(full);
+    printf("********************************************\n\n");
+}
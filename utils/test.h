@@ -5,6 +5,7 @@
     #include "codec.h"
     #include "dct.h"
     #include "huffman.h"
+    #include "libcodec.h"
     #include <stdlib.h>
     #include <string.h>
 
@@ -24,6 +25,16 @@
     void testBitBufferSimple();
     void testBitBufferExtensive();
     void testHuffmanRoundtrip();
+    void testACEmitTable();
     long fsize(const char *filename);
+    void testCorruptHeaderQuality();
+    void testIndexedDecode();
+    void testRestartIntervals();
+    void testCodecErrorCodes();
+    void testRateDistortion();
+    void testAdaptiveQuantization();
+    void testStoredMatrices();
+    void testCodedBlockPattern();
+    void testScaledDecode();
 
 #endif
\ No newline at end of file